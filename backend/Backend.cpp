@@ -16,10 +16,14 @@
 
 #include "Backend.h"
 
+#include <algorithm>
 #include <climits>
 
 #include "BackendManager.h"
 #include "bufferinfo/BufferInfoGetter.h"
+#include "compositor/BandwidthEstimator.h"
+#include "compositor/DrmKmsPlan.h"
+#include "drm/DrmPlane.h"
 
 namespace android {
 
@@ -28,13 +32,21 @@ HWC2::Error Backend::ValidateDisplay(HwcDisplay *display, uint32_t *num_types,
   *num_types = 0;
   *num_requests = 0;
 
+  planes_ = display->GetPipe().GetUsablePlanes();
+  auto ret = ValidateLayers(display, num_types);
+  planes_.clear();
+
+  return ret;
+}
+
+HWC2::Error Backend::ValidateLayers(HwcDisplay *display, uint32_t *num_types) {
   auto layers = display->GetOrderLayersByZPos();
 
   int client_start = -1;
   size_t client_size = 0;
 
   auto flatcon = display->GetFlatCon();
-  if (flatcon) {
+  if (flatcon && !display->IsDozing()) {
     bool should_flatten = false;
     if (layers.size() <= 1)
       flatcon->Disable();
@@ -43,13 +55,24 @@ HWC2::Error Backend::ValidateDisplay(HwcDisplay *display, uint32_t *num_types,
 
     if (should_flatten) {
       display->total_stats().frames_flattened_++;
+      display->SetOutputTransfer(BufferTransfer::kSdr);
       MarkValidated(layers, 0, layers.size());
       *num_types = layers.size();
       return HWC2::Error::HasChanges;
     }
   }
 
-  std::tie(client_start, client_size) = GetClientLayers(display, layers);
+  CullInvisibleLayers(display, layers);
+
+  if (display->IsDozing() && layers.size() > 1) {
+    /* Always-on content is scanned out from a single plane */
+    display->SetOutputTransfer(BufferTransfer::kSdr);
+    client_start = 0;
+    client_size = layers.size();
+  } else {
+    SelectOutputTransfer(display, layers);
+    std::tie(client_start, client_size) = GetClientLayers(display, layers);
+  }
 
   MarkValidated(layers, client_start, client_size);
 
@@ -62,6 +85,7 @@ HWC2::Error Backend::ValidateDisplay(HwcDisplay *display, uint32_t *num_types,
     ++display->total_stats().failed_kms_validate_;
     client_start = 0;
     client_size = layers.size();
+    display->SetOutputTransfer(BufferTransfer::kSdr);
     MarkValidated(layers, 0, client_size);
   }
 
@@ -87,14 +111,80 @@ std::tuple<int, size_t> Backend::GetClientLayers(
     }
   }
 
-  return GetExtraClientRange(display, layers, client_start, client_size);
+  std::tie(client_start, client_size) = GetExtraClientRange(display, layers,
+                                                            client_start,
+                                                            client_size);
+
+  return GetBudgetClientRange(display, layers, client_start, client_size);
 }
 
 bool Backend::IsClientLayer(HwcDisplay *display, HwcLayer *layer) {
+  const auto &pi = layer->GetLayerData().pi;
   return !HardwareSupportsLayerType(layer->GetSfType()) ||
          !layer->IsLayerUsableAsDevice() || display->CtmByGpu() ||
-         (layer->GetLayerData().pi.RequireScalingOrPhasing() &&
-          display->GetHwc2()->GetResMan().ForcedScalingWithGpu());
+         (pi.RequireScalingOrPhasing() &&
+          (display->GetHwc2()->GetResMan().ForcedScalingWithGpu() ||
+           !IsScalingSupported(pi))) ||
+         !IsTransferSupported(display, layer);
+}
+
+bool Backend::IsScalingSupported(const PresentInfo &pi) const {
+  return std::any_of(planes_.begin(), planes_.end(), [&pi](auto &plane) {
+    return plane->Get()->IsScalingSupported(pi);
+  });
+}
+
+bool Backend::IsTransferSupported(HwcDisplay *display, HwcLayer *layer) const {
+  const auto output = display->GetOutputTransfer();
+  const auto &bi = layer->GetLayerData().bi;
+  const auto transfer = bi ? bi->transfer : BufferTransfer::kSdr;
+  return std::any_of(planes_.begin(), planes_.end(), [&](auto &plane) {
+    return plane->Get()->IsTransferSupported(transfer, output);
+  });
+}
+
+/*
+ * Switches the output to the encoding of the first HDR layer if the sink
+ * supports it, and the planes can convert the rest of the content, including
+ * the client target, to it. Otherwise the output stays SDR.
+ */
+void Backend::SelectOutputTransfer(
+    HwcDisplay *display, const std::vector<HwcLayer *> &layers) const {
+  auto layer_transfer = [display](HwcLayer *layer) {
+    const auto &bi = layer->GetLayerData().bi;
+    if (!HardwareSupportsLayerType(layer->GetSfType()) ||
+        !layer->IsLayerUsableAsDevice() || display->CtmByGpu() || !bi ||
+        bi->transfer == BufferTransfer::kUndefined)
+      return BufferTransfer::kSdr;
+
+    return bi->transfer;
+  };
+
+  auto output = BufferTransfer::kSdr;
+  const auto *caps = display->GetConnectorHdrCapabilities();
+  for (auto *layer : layers) {
+    auto transfer = layer_transfer(layer);
+    if (caps != nullptr &&
+        ((transfer == BufferTransfer::kSt2084 && caps->st2084) ||
+         (transfer == BufferTransfer::kHlg && caps->hlg))) {
+      output = transfer;
+      break;
+    }
+  }
+
+  auto mixed = std::any_of(layers.begin(), layers.end(),
+                           [&](HwcLayer *layer) {
+                             return layer_transfer(layer) != output;
+                           });
+  if (output != BufferTransfer::kSdr && mixed) {
+    if (std::none_of(planes_.begin(), planes_.end(), [output](auto &plane) {
+          return plane->Get()->IsTransferSupported(BufferTransfer::kSdr,
+                                                   output);
+        }))
+      output = BufferTransfer::kSdr;
+  }
+
+  display->SetOutputTransfer(output);
 }
 
 bool Backend::HardwareSupportsLayerType(HWC2::Composition comp_type) {
@@ -102,6 +192,84 @@ bool Backend::HardwareSupportsLayerType(HWC2::Composition comp_type) {
          comp_type == HWC2::Composition::Cursor;
 }
 
+/* Removes the edge band of |rect| hidden by |opaque|. Only cuts spanning
+ * the whole side keep the rest a single rectangle.
+ */
+static void CutOccludedEdge(hwc_rect_t &rect, const hwc_rect_t &opaque) {
+  if (opaque.left <= rect.left && opaque.right >= rect.right) {
+    if (opaque.top <= rect.top && opaque.bottom > rect.top)
+      rect.top = std::min(opaque.bottom, rect.bottom);
+    if (opaque.bottom >= rect.bottom && opaque.top < rect.bottom)
+      rect.bottom = std::max(opaque.top, rect.top);
+  }
+
+  if (opaque.top <= rect.top && opaque.bottom >= rect.bottom) {
+    if (opaque.left <= rect.left && opaque.right > rect.left)
+      rect.left = std::min(opaque.right, rect.right);
+    if (opaque.right >= rect.right && opaque.left < rect.right)
+      rect.right = std::max(opaque.left, rect.left);
+  }
+}
+
+/*
+ * Device layers that are off-screen, fully transparent or entirely covered by
+ * opaque layers above them are removed from |layers|. They stay Device for
+ * the client, but get no plane. The rest get their plane clipped to the
+ * on-screen, visible part of the display frame.
+ */
+void Backend::CullInvisibleLayers(HwcDisplay *display,
+                                  std::vector<HwcLayer *> &layers) {
+  const auto screen = display->GetScreenRect();
+  std::vector<hwc_rect_t> opaque_rects;
+  std::vector<HwcLayer *> visible;
+  for (auto it = layers.rbegin(); it != layers.rend(); ++it) {
+    auto *layer = *it;
+    layer->SetCulled(false);
+    layer->SetPlaneClip({});
+    if (!HardwareSupportsLayerType(layer->GetSfType())) {
+      visible.emplace_back(layer);
+      continue;
+    }
+
+    const auto &df = layer->GetLayerData().pi.display_frame;
+    auto clip = df;
+    auto intersect = [&clip](const hwc_rect_t &r) {
+      clip.left = std::max(clip.left, r.left);
+      clip.top = std::max(clip.top, r.top);
+      clip.right = std::max(std::min(clip.right, r.right), clip.left);
+      clip.bottom = std::max(std::min(clip.bottom, r.bottom), clip.top);
+    };
+
+    intersect(screen);
+    if (layer->GetVisibleBounds())
+      intersect(*layer->GetVisibleBounds());
+
+    for (const auto &opaque : opaque_rects)
+      CutOccludedEdge(clip, opaque);
+
+    if (clip.left >= clip.right || clip.top >= clip.bottom ||
+        layer->GetLayerData().pi.alpha == 0) {
+      layer->SetCulled(true);
+      layer->SetValidatedType(HWC2::Composition::Device);
+      continue;
+    }
+
+    if (clip.left != df.left || clip.top != df.top || clip.right != df.right ||
+        clip.bottom != df.bottom)
+      layer->SetPlaneClip(clip);
+
+    if (layer->IsLayerUsableAsDevice()) {
+      layer->PopulateLayerData();
+      if (layer->GetLayerData().IsOpaque())
+        opaque_rects.emplace_back(df);
+    }
+
+    visible.emplace_back(layer);
+  }
+
+  layers.assign(visible.rbegin(), visible.rend());
+}
+
 uint32_t Backend::CalcPixOps(const std::vector<HwcLayer *> &layers,
                              size_t first_z, size_t size) {
   uint32_t pixops = 0;
@@ -126,15 +294,14 @@ void Backend::MarkValidated(std::vector<HwcLayer *> &layers,
 
 std::tuple<int, int> Backend::GetExtraClientRange(
     HwcDisplay *display, const std::vector<HwcLayer *> &layers,
-    int client_start, size_t client_size) {
-  auto planes = display->GetPipe().GetUsablePlanes();
-  size_t avail_planes = planes.size();
+    int client_start, size_t client_size) const {
+  size_t avail_planes = planes_.size();
 
   /*
    * If more layers then planes, save one plane
    * for client composited layers
    */
-  if (avail_planes < display->layers().size())
+  if (avail_planes < layers.size())
     avail_planes--;
 
   const int extra_client = int(layers.size() - client_size) - int(avail_planes);
@@ -169,6 +336,150 @@ std::tuple<int, int> Backend::GetExtraClientRange(
   return std::make_tuple(client_start, client_size);
 }
 
+/*
+ * Some display controllers underflow on configurations the kernel accepts in
+ * TEST_ONLY. Extend the client range until the remaining planes fit into the
+ * bandwidth and scaler budget of every CRTC, picking the range the GPU
+ * fetches the least for.
+ */
+std::tuple<int, size_t> Backend::GetBudgetClientRange(
+    HwcDisplay *display, const std::vector<HwcLayer *> &layers,
+    int client_start, size_t client_size) {
+  const auto &budget = display->GetHwc2()->GetResMan().GetPlaneBudget();
+  if (budget.bandwidth_mbps == 0 && budget.scalers < 0)
+    return std::make_tuple(client_start, client_size);
+
+  constexpr double kBytesInMb = 1e6;
+  constexpr double kNsInSec = 1e9;
+  uint32_t vperiod_ns = 0;
+  display->GetDisplayVsyncPeriod(&vperiod_ns);
+  const auto max_bytes = budget.bandwidth_mbps == 0
+                             ? UINT64_MAX
+                             : uint64_t(double(budget.bandwidth_mbps) *
+                                        kBytesInMb * vperiod_ns / kNsInSec);
+  const auto max_scalers = budget.scalers < 0 ? SIZE_MAX
+                                              : size_t(budget.scalers);
+
+  /* Planes fetch only the visible part */
+  std::vector<LayerData> visible(layers.size());
+  std::vector<uint64_t> fetch_bytes(layers.size());
+  for (size_t z_order = 0; z_order < layers.size(); ++z_order) {
+    auto *layer = layers[z_order];
+    if (layer->IsLayerUsableAsDevice())
+      layer->PopulateLayerData();
+    visible[z_order] = {.bi = layer->GetLayerData().bi,
+                        .pi = layer->GetLayerData().pi};
+    if (layer->GetPlaneClip())
+      visible[z_order].pi.ClipDisplayFrame(*layer->GetPlaneClip());
+
+    fetch_bytes[z_order] = BandwidthEstimator::GetFetchBytes(visible[z_order]);
+  }
+
+  /* Tiles of a tiled display are separate CRTCs, each with its own budget */
+  struct CrtcCost {
+    std::optional<hwc_rect_t> rect;
+    std::vector<uint64_t> bytes;
+    std::vector<bool> scaling;
+  };
+  auto on_crtc = [](LayerData &layer, const std::optional<hwc_rect_t> &rect) {
+    return !rect || layer.pi.ClipDisplayFrame(*rect);
+  };
+  std::vector<CrtcCost> crtcs;
+  for (auto *tile_pipe : display->GetPipe().GetTilePipelines()) {
+    CrtcCost crtc = {.rect = DrmKmsPlan::GetTileRect(*tile_pipe),
+                     .bytes = std::vector<uint64_t>(layers.size()),
+                     .scaling = std::vector<bool>(layers.size())};
+    for (size_t z_order = 0; z_order < layers.size(); ++z_order) {
+      auto layer = visible[z_order];
+      if (!on_crtc(layer, crtc.rect))
+        continue;
+
+      crtc.bytes[z_order] = BandwidthEstimator::GetFetchBytes(layer);
+      crtc.scaling[z_order] = layer.pi.RequireScalingOrPhasing();
+    }
+    crtcs.emplace_back(std::move(crtc));
+  }
+
+  /* As presented by CreateComposition(): cropped to the client layers unless
+   * it is bottom-most, scaled up from a reduced UI size
+   */
+  const auto &client = display->GetClientLayer().GetLayerData();
+  auto client_target = [&](size_t start, size_t size) {
+    LayerData target = {.bi = client.bi, .pi = client.pi};
+    if (start == 0)
+      return target;
+
+    hwc_rect_t region = {INT_MAX, INT_MAX, INT_MIN, INT_MIN};
+    for (size_t z_order = start; z_order < start + size; ++z_order) {
+      const auto &df = layers[z_order]->GetLayerData().pi.display_frame;
+      region.left = std::min(region.left, df.left);
+      region.top = std::min(region.top, df.top);
+      region.right = std::max(region.right, df.right);
+      region.bottom = std::max(region.bottom, df.bottom);
+    }
+    auto pi = target.pi;
+    if (pi.ClipDisplayFrame(region))
+      target.pi = pi;
+    return target;
+  };
+
+  auto fits = [&](size_t start, size_t size) {
+    std::optional<LayerData> target;
+    if (size != 0)
+      target = client_target(start, size);
+
+    for (const auto &crtc : crtcs) {
+      uint64_t bytes = 0;
+      size_t scalers = 0;
+      if (target) {
+        auto crtc_target = *target;
+        if (on_crtc(crtc_target, crtc.rect)) {
+          bytes += BandwidthEstimator::GetFetchBytes(crtc_target);
+          scalers += crtc_target.pi.RequireScalingOrPhasing() ? 1 : 0;
+        }
+      }
+
+      for (size_t z_order = 0; z_order < layers.size(); ++z_order) {
+        if (z_order >= start && z_order < start + size)
+          continue;
+        bytes += crtc.bytes[z_order];
+        scalers += crtc.scaling[z_order] ? 1 : 0;
+      }
+
+      if (bytes > max_bytes || scalers > max_scalers)
+        return false;
+    }
+    return true;
+  };
+
+  if (fits(size_t(std::max(client_start, 0)), client_size))
+    return std::make_tuple(client_start, client_size);
+
+  /* Candidates contain the current range, so the plane count still fits */
+  auto best_start = 0;
+  auto best_size = layers.size();
+  auto best_gpu_bytes = UINT64_MAX;
+  for (size_t start = 0; start < layers.size(); ++start) {
+    uint64_t gpu_bytes = 0;
+    for (size_t end = start + 1; end <= layers.size(); ++end) {
+      gpu_bytes += fetch_bytes[end - 1];
+      if (client_size != 0 &&
+          (start > size_t(client_start) ||
+           end < size_t(client_start) + client_size))
+        continue;
+
+      if (gpu_bytes < best_gpu_bytes && fits(start, end - start)) {
+        best_start = int(start);
+        best_size = end - start;
+        best_gpu_bytes = gpu_bytes;
+      }
+    }
+  }
+
+  ++display->total_stats().frames_budget_limited_;
+  return std::make_tuple(best_start, best_size);
+}
+
 // clang-format off
 // NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables, cert-err58-cpp)
 REGISTER_BACKEND("generic", Backend);
@@ -30,13 +30,31 @@ class Backend {
   virtual bool IsClientLayer(HwcDisplay *display, HwcLayer *layer);
 
  protected:
+  HWC2::Error ValidateLayers(HwcDisplay *display, uint32_t *num_types);
+
   static bool HardwareSupportsLayerType(HWC2::Composition comp_type);
+  /* True if any of the planes can scale a layer presented as |pi| */
+  bool IsScalingSupported(const PresentInfo &pi) const;
+  /* True if any of the planes can present |layer| in the output encoding */
+  bool IsTransferSupported(HwcDisplay *display, HwcLayer *layer) const;
+  void SelectOutputTransfer(HwcDisplay *display,
+                            const std::vector<HwcLayer *> &layers) const;
+  static void CullInvisibleLayers(HwcDisplay *display,
+                                  std::vector<HwcLayer *> &layers);
   static uint32_t CalcPixOps(const std::vector<HwcLayer *> &layers,
                              size_t first_z, size_t size);
   static void MarkValidated(std::vector<HwcLayer *> &layers,
                             size_t client_first_z, size_t client_size);
-  static std::tuple<int, int> GetExtraClientRange(
+  std::tuple<int, int> GetExtraClientRange(
+      HwcDisplay *display, const std::vector<HwcLayer *> &layers,
+      int client_start, size_t client_size) const;
+  static std::tuple<int, size_t> GetBudgetClientRange(
       HwcDisplay *display, const std::vector<HwcLayer *> &layers,
       int client_start, size_t client_size);
+
+  /* Usable planes of the display, fetched once per ValidateDisplay(). Not
+   * kept in between, the planes stay bound to the pipeline while held.
+   */
+  std::vector<std::shared_ptr<BindingOwner<DrmPlane>>> planes_;
 };
 }  // namespace android
@@ -33,6 +33,27 @@ enum class BufferSampleRange : int32_t {
   kLimitedRange,
 };
 
+/* Transfer function of the buffer content */
+enum class BufferTransfer : int32_t {
+  kUndefined,
+  /* sRGB and the other gamma curves of SDR content */
+  kSdr,
+  kSt2084,
+  kHlg,
+};
+
+/* SMPTE ST 2086 mastering display and CTA-861.3 content light level of HDR
+ * content. Chromaticities are CIE 1931 xy, luminances in nits, 0 is unknown.
+ */
+struct HdrStaticMetadata {
+  float display_primaries[3][2]; /* Red, green, blue */
+  float white_point[2];
+  float max_mastering_luminance;
+  float min_mastering_luminance;
+  float max_content_light_level;
+  float max_frame_average_light_level;
+};
+
 enum class BufferBlendMode : int32_t {
   kUndefined,
   kNone,
@@ -53,5 +74,7 @@ struct BufferInfo {
 
   BufferColorSpace color_space;
   BufferSampleRange sample_range;
+  BufferTransfer transfer;
+  HdrStaticMetadata hdr_metadata;
   BufferBlendMode blend_mode;
 };
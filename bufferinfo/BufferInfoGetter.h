@@ -44,6 +44,11 @@ class BufferInfoGetter {
   static BufferInfoGetter *GetInstance();
 
   static bool IsDrmFormatRgb(uint32_t drm_format);
+
+  /* True for formats known to carry no alpha channel */
+  static bool IsDrmFormatOpaque(uint32_t drm_format);
+
+  static bool IsDrmFormatYuv(uint32_t drm_format);
 };
 
 class LegacyBufferInfoGetter : public BufferInfoGetter {
@@ -60,6 +60,8 @@ static const struct DroidYuvFormat kDroidYuvFormats[] = {
     {HAL_PIXEL_FORMAT_YCbCr_420_888, kYCbCr, 1, DRM_FORMAT_YUV420},
     {HAL_PIXEL_FORMAT_YCbCr_420_888, kYCrCb, 1, DRM_FORMAT_YVU420},
     {HAL_PIXEL_FORMAT_YV12, kYCrCb, 1, DRM_FORMAT_YVU420},
+    /* 10 bits in the high bits of 16-bit words, semi-planar */
+    {HAL_PIXEL_FORMAT_YCBCR_P010, kYCbCr, 4, DRM_FORMAT_P010},
     /* HACK: See droid_create_image_from_prime_fds() and
      * https://issuetracker.google.com/32077885. */
     {HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED, kYCbCr, 2, DRM_FORMAT_NV12},
@@ -132,7 +134,7 @@ bool BufferInfoLibdrm::GetYuvPlaneInfo(uint32_t hal_format, int num_fds,
    * Cb/Cr/CbCr planes, assumed to be the same for Cb and Cr for fully
    * planar formats. */
   bo->pitches[0] = ycbcr.ystride;
-  bo->pitches[1] = bo->pitches[2] = ycbcr.cstride;
+  bo->pitches[1] = ycbcr.cstride;
 
   /* .chroma_step is the byte distance between the same chroma channel
    * values of subsequent pixels, assumed to be the same for Cb and Cr. */
@@ -146,17 +148,25 @@ bool BufferInfoLibdrm::GetYuvPlaneInfo(uint32_t hal_format, int num_fds,
     return false;
   }
 
+  /* Fully planar formats have a chroma step of 1. Semi-planar ones have no
+   * third plane, leave it empty for the FB import. */
+  const int planes = (ycbcr.chroma_step == 1) ? 3 : 2;
+  if (planes == 3) {
+    bo->pitches[2] = ycbcr.cstride;
+  } else {
+    bo->offsets[2] = 0;
+  }
+
   /*
    * Since this is EGL_NATIVE_BUFFER_ANDROID don't assume that
    * the single-fd case cannot happen.  So handle eithe single
    * fd or fd-per-plane case:
    */
   if (num_fds == 1) {
-    bo->prime_fds[2] = bo->prime_fds[1] = bo->prime_fds[0];
-  } else {
-    const int expected_planes = (ycbcr.chroma_step == 2) ? 2 : 3;
-    if (num_fds != expected_planes)
-      return false;
+    for (int i = 1; i < planes; i++)
+      bo->prime_fds[i] = bo->prime_fds[0];
+  } else if (num_fds != planes) {
+    return false;
   }
 
   return true;
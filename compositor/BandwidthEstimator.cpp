@@ -0,0 +1,277 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define ATRACE_TAG ATRACE_TAG_GRAPHICS
+#define LOG_TAG "hwc-bandwidth-estimator"
+
+#include "BandwidthEstimator.h"
+
+#include <drm/drm_fourcc.h>
+#include <utils/Trace.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+#include "DrmKmsPlan.h"
+#include "drm/ResourceManager.h"
+
+namespace android {
+
+constexpr double kNsInSec = 1e9;
+constexpr double kBytesInMb = 1e6;
+constexpr uint32_t kBitsInByte = 8;
+constexpr uint32_t kDefaultBitsPerPixel = 32;
+/* Typical saving of lossless framebuffer compression on UI content */
+constexpr double kCompressedRatio = 0.5;
+constexpr uint32_t kDefaultVPeriodNs = 16666666;
+
+BandwidthEstimator::BandwidthEstimator(std::string name)
+    : scanout_counter_(name + " scanout MB/s"),
+      gpu_counter_(name + " GPU MB/s") {
+}
+
+auto BandwidthEstimator::GetBitsPerPixel(uint32_t drm_format) -> uint32_t {
+  switch (drm_format) {
+    case DRM_FORMAT_C8:
+    case DRM_FORMAT_R8:
+      return 8;
+    case DRM_FORMAT_NV12:
+    case DRM_FORMAT_NV21:
+    case DRM_FORMAT_YUV420:
+    case DRM_FORMAT_YVU420:
+    case DRM_FORMAT_YUV420_8BIT:
+      return 12;
+    case DRM_FORMAT_NV15:
+    case DRM_FORMAT_YUV420_10BIT:
+      return 15;
+    case DRM_FORMAT_RGB565:
+    case DRM_FORMAT_BGR565:
+    case DRM_FORMAT_ARGB4444:
+    case DRM_FORMAT_ARGB1555:
+    case DRM_FORMAT_NV16:
+    case DRM_FORMAT_NV61:
+    case DRM_FORMAT_YUV422:
+    case DRM_FORMAT_YUYV:
+    case DRM_FORMAT_YVYU:
+    case DRM_FORMAT_UYVY:
+    case DRM_FORMAT_VYUY:
+      return 16;
+    case DRM_FORMAT_RGB888:
+    case DRM_FORMAT_BGR888:
+    case DRM_FORMAT_NV24:
+    case DRM_FORMAT_NV42:
+    case DRM_FORMAT_YUV444:
+    case DRM_FORMAT_P010:
+    case DRM_FORMAT_P012:
+    case DRM_FORMAT_P016:
+      return 24;
+    case DRM_FORMAT_P210:
+    case DRM_FORMAT_Y210:
+      return 32;
+    case DRM_FORMAT_ARGB16161616F:
+    case DRM_FORMAT_XRGB16161616F:
+    case DRM_FORMAT_ABGR16161616F:
+    case DRM_FORMAT_XBGR16161616F:
+      return 64;
+    default:
+      /* 8888 and 2101010 RGB, packed 4:4:4 YUV */
+      return kDefaultBitsPerPixel;
+  }
+}
+
+auto BandwidthEstimator::GetCompressionRatio(uint64_t modifier) -> double {
+  if (modifier == DRM_FORMAT_MOD_LINEAR || modifier == DRM_FORMAT_MOD_INVALID)
+    return 1.0;
+
+  constexpr int kVendorShift = 56;
+  constexpr int kArmTypeShift = 52;
+  constexpr uint64_t kArmTypeMask = 0xf;
+
+  switch (modifier >> kVendorShift) {
+    case DRM_FORMAT_MOD_VENDOR_ARM: {
+      auto type = (modifier >> kArmTypeShift) & kArmTypeMask;
+#ifdef DRM_FORMAT_MOD_ARM_TYPE_AFRC
+      if (type == DRM_FORMAT_MOD_ARM_TYPE_AFRC)
+        return kCompressedRatio;
+#endif
+      return type == DRM_FORMAT_MOD_ARM_TYPE_AFBC ? kCompressedRatio : 1.0;
+    }
+#ifdef AMD_FMT_MOD_GET
+    case DRM_FORMAT_MOD_VENDOR_AMD:
+      return AMD_FMT_MOD_GET(DCC, modifier) != 0 ? kCompressedRatio : 1.0;
+#endif
+    case DRM_FORMAT_MOD_VENDOR_INTEL:
+      switch (modifier) {
+        case I915_FORMAT_MOD_Y_TILED_CCS:
+        case I915_FORMAT_MOD_Yf_TILED_CCS:
+        case I915_FORMAT_MOD_Y_TILED_GEN12_RC_CCS:
+        case I915_FORMAT_MOD_Y_TILED_GEN12_MC_CCS:
+        case I915_FORMAT_MOD_Y_TILED_GEN12_RC_CCS_CC:
+#ifdef I915_FORMAT_MOD_4_TILED_DG2_RC_CCS
+        case I915_FORMAT_MOD_4_TILED_DG2_RC_CCS:
+        case I915_FORMAT_MOD_4_TILED_DG2_MC_CCS:
+        case I915_FORMAT_MOD_4_TILED_DG2_RC_CCS_CC:
+#endif
+          return kCompressedRatio;
+        default:
+          return 1.0;
+      }
+    default:
+      /* Tiled, but not compressed */
+      return 1.0;
+  }
+}
+
+auto BandwidthEstimator::GetFetchBytes(const LayerData &layer) -> uint64_t {
+  const auto &crop = layer.pi.source_crop;
+  auto src_w = double(std::max(crop.right - crop.left, 0.0F));
+  auto src_h = double(std::max(crop.bottom - crop.top, 0.0F));
+
+  if (!layer.bi) {
+    /* Not imported yet, assume 32bpp linear of the display frame size */
+    const auto &df = layer.pi.display_frame;
+    return uint64_t(std::max(df.right - df.left, 0)) *
+           uint64_t(std::max(df.bottom - df.top, 0)) * kDefaultBitsPerPixel /
+           kBitsInByte;
+  }
+
+  if (src_w == 0 || src_h == 0) {
+    src_w = layer.bi->width;
+    src_h = layer.bi->height;
+  }
+
+  auto bits = double(GetBitsPerPixel(layer.bi->format)) *
+              GetCompressionRatio(layer.bi->modifiers[0]);
+  return uint64_t(src_w * src_h * bits / kBitsInByte);
+}
+
+auto BandwidthEstimator::GetClientTargetBytes(const LayerData &client_target)
+    -> uint64_t {
+  const auto &df = client_target.pi.display_frame;
+  auto area = uint64_t(std::max(df.right - df.left, 0)) *
+              uint64_t(std::max(df.bottom - df.top, 0));
+
+  if (!client_target.bi)
+    return area * kDefaultBitsPerPixel / kBitsInByte;
+
+  /* Rendered at the buffer size, which may be below the display frame */
+  area = uint64_t(client_target.bi->width) * client_target.bi->height;
+  auto bits = double(GetBitsPerPixel(client_target.bi->format)) *
+              GetCompressionRatio(client_target.bi->modifiers[0]);
+  return uint64_t(double(area) * bits / kBitsInByte);
+}
+
+auto BandwidthEstimator::EstimateFrame(
+    const DrmKmsPlan &plan, const std::vector<LayerData *> &client_layers,
+    const LayerData *client_target) -> FrameBandwidth {
+  FrameBandwidth frame{};
+  for (const auto &joining : plan.plan)
+    frame.scanout_bytes += GetFetchBytes(joining.layer);
+
+  if (client_target != nullptr) {
+    for (const auto *layer : client_layers)
+      frame.gpu_bytes += GetFetchBytes(*layer);
+
+    frame.gpu_bytes += GetClientTargetBytes(*client_target);
+  }
+
+  return frame;
+}
+
+void BandwidthEstimator::OnFrame(const FrameBandwidth &frame,
+                                 uint32_t vperiod_ns) {
+  auto now = ResourceManager::GetTimeMonotonicNs();
+  if (vperiod_ns == 0)
+    vperiod_ns = kDefaultVPeriodNs;
+
+  if (window_start_ns_ == 0)
+    window_start_ns_ = now;
+
+  /* Previous frame was scanned out until now */
+  if (last_frame_ns_ != 0) {
+    auto since = std::max(last_frame_ns_, window_start_ns_);
+    window_scanout_bytes_ += double(last_.scanout_bps) * double(now - since) /
+                             kNsInSec;
+  }
+
+  /* GPU renders once per presented frame, no faster than the refresh */
+  auto interval_ns = last_frame_ns_ == 0
+                         ? int64_t(vperiod_ns)
+                         : std::max(now - last_frame_ns_, int64_t(vperiod_ns));
+
+  last_.scanout_bps = uint64_t(double(frame.scanout_bytes) * kNsInSec /
+                               vperiod_ns);
+  last_.gpu_bps = uint64_t(double(frame.gpu_bytes) * kNsInSec /
+                           double(interval_ns));
+  peak_.scanout_bps = std::max(peak_.scanout_bps, last_.scanout_bps);
+  peak_.gpu_bps = std::max(peak_.gpu_bps, last_.gpu_bps);
+
+  window_frames_++;
+  window_gpu_bytes_ += frame.gpu_bytes;
+  last_frame_ns_ = now;
+
+  ATRACE_INT64(scanout_counter_.c_str(),
+               int64_t(double(last_.scanout_bps) / kBytesInMb));
+  ATRACE_INT64(gpu_counter_.c_str(),
+               int64_t(double(last_.gpu_bps) / kBytesInMb));
+}
+
+auto BandwidthEstimator::GetAverageAndReset() -> Rates {
+  auto now = ResourceManager::GetTimeMonotonicNs();
+  if (window_start_ns_ == 0 || now <= window_start_ns_)
+    return last_;
+
+  auto scanout_bytes = window_scanout_bytes_;
+  if (last_frame_ns_ != 0) {
+    auto since = std::max(last_frame_ns_, window_start_ns_);
+    scanout_bytes += double(last_.scanout_bps) * double(now - since) /
+                     kNsInSec;
+  }
+
+  auto elapsed_s = double(now - window_start_ns_) / kNsInSec;
+  const Rates average = {
+      .scanout_bps = uint64_t(scanout_bytes / elapsed_s),
+      .gpu_bps = uint64_t(double(window_gpu_bytes_) / elapsed_s),
+  };
+
+  window_start_ns_ = now;
+  window_frames_ = 0;
+  window_scanout_bytes_ = 0;
+  window_gpu_bytes_ = 0;
+  return average;
+}
+
+auto BandwidthEstimator::Dump() -> std::string {
+  auto frames = window_frames_;
+  auto average = GetAverageAndReset();
+
+  auto mbps = [](uint64_t bps) { return double(bps) / kBytesInMb; };
+
+  std::stringstream ss;
+  ss << std::fixed << std::setprecision(1) << "Bandwidth estimate (MB/s):\n"
+     << " Last frame: scanout " << mbps(last_.scanout_bps) << ", GPU "
+     << mbps(last_.gpu_bps) << "\n"
+     << " Average since last dumpsys request (" << frames
+     << " frames): scanout " << mbps(average.scanout_bps) << ", GPU "
+     << mbps(average.gpu_bps) << "\n"
+     << " Peak: scanout " << mbps(peak_.scanout_bps) << ", GPU "
+     << mbps(peak_.gpu_bps) << "\n";
+
+  return ss.str();
+}
+
+}  // namespace android
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "LayerData.h"
+
+namespace android {
+
+struct DrmKmsPlan;
+
+/* DDR traffic of a single frame, in bytes */
+struct FrameBandwidth {
+  /* Fetched by the display controller on every refresh */
+  uint64_t scanout_bytes{};
+  /* Client composition: layers read and client target written by the GPU */
+  uint64_t gpu_bytes{};
+};
+
+/* Estimates memory bandwidth of the composition from buffer formats,
+ * modifiers and crops. Numbers are approximations meant for budgeting and
+ * comparing plans, not for exact accounting.
+ */
+class BandwidthEstimator {
+ public:
+  /* Counter names are prefixed by |name| */
+  explicit BandwidthEstimator(std::string name);
+
+  /* Bytes read to scan out (or GPU-compose) |layer| once. Whole source crop
+   * is fetched, so downscaling costs more than the display frame suggests.
+   */
+  static auto GetFetchBytes(const LayerData &layer) -> uint64_t;
+
+  /* Bytes written by the GPU to render the |client_target| */
+  static auto GetClientTargetBytes(const LayerData &client_target)
+      -> uint64_t;
+
+  /* |client_target| is nullptr if the frame has no client composition */
+  static auto EstimateFrame(const DrmKmsPlan &plan,
+                            const std::vector<LayerData *> &client_layers,
+                            const LayerData *client_target) -> FrameBandwidth;
+
+  /* Bits per pixel averaged over all planes of the DRM format */
+  static auto GetBitsPerPixel(uint32_t drm_format) -> uint32_t;
+
+  /* Fetch size relative to linear layout, lower for compressed modifiers */
+  static auto GetCompressionRatio(uint64_t modifier) -> double;
+
+  /* Accounts a presented frame, scanned out every |vperiod_ns| until the
+   * next one.
+   */
+  void OnFrame(const FrameBandwidth &frame, uint32_t vperiod_ns);
+
+  struct Rates {
+    /* Bytes per second */
+    uint64_t scanout_bps{};
+    uint64_t gpu_bps{};
+  };
+
+  auto GetLast() const -> Rates {
+    return last_;
+  }
+
+  /* Time-weighted average since the previous call */
+  auto GetAverageAndReset() -> Rates;
+
+  /* Resets the averaging window */
+  auto Dump() -> std::string;
+
+ private:
+  std::string scanout_counter_;
+  std::string gpu_counter_;
+
+  Rates last_;
+  Rates peak_;
+  int64_t last_frame_ns_{};
+
+  /* Averaging window */
+  int64_t window_start_ns_{};
+  uint64_t window_frames_{};
+  double window_scanout_bytes_{};
+  uint64_t window_gpu_bytes_{};
+};
+
+}  // namespace android
@@ -18,16 +18,15 @@
 
 #include "DrmKmsPlan.h"
 
+#include "drm/DrmConnector.h"
 #include "drm/DrmDevice.h"
 #include "drm/DrmPlane.h"
 #include "utils/log.h"
 
 namespace android {
-auto DrmKmsPlan::CreateDrmKmsPlan(DrmDisplayPipeline &pipe,
-                                  std::vector<LayerData> composition)
-    -> std::unique_ptr<DrmKmsPlan> {
-  auto plan = std::make_unique<DrmKmsPlan>();
 
+static auto AssignPlanes(DrmKmsPlan &plan, DrmDisplayPipeline &pipe,
+                         std::vector<LayerData> composition) -> bool {
   auto avail_planes = pipe.GetUsablePlanes();
 
   int z_pos = 0;
@@ -37,20 +36,86 @@ auto DrmKmsPlan::CreateDrmKmsPlan(DrmDisplayPipeline &pipe,
     /* Skip unsupported planes */
     do {
       if (avail_planes.empty()) {
-        return {};
+        return false;
       }
 
       plane = *avail_planes.begin();
       avail_planes.erase(avail_planes.begin());
     } while (!plane->Get()->IsValidForLayer(&dhl, z_pos == 0));
 
-    LayerToPlaneJoining joining = {
+    DrmKmsPlan::LayerToPlaneJoining joining = {
         .layer = std::move(dhl),
         .plane = plane,
         .z_pos = z_pos++,
     };
 
-    plan->plan.emplace_back(std::move(joining));
+    plan.plan.emplace_back(std::move(joining));
+  }
+
+  return true;
+}
+
+auto DrmKmsPlan::GetTileRect(DrmDisplayPipeline &tile_pipe)
+    -> std::optional<hwc_rect_t> {
+  auto &tile = tile_pipe.connector->Get()->GetTile();
+  if (!tile)
+    return {};
+
+  auto x_offset = int(tile->h_loc * tile->h_size);
+  auto y_offset = int(tile->v_loc * tile->v_size);
+  return (hwc_rect_t){
+      .left = x_offset,
+      .top = y_offset,
+      .right = x_offset + int(tile->h_size),
+      .bottom = y_offset + int(tile->v_size),
+  };
+}
+
+/* Splits the composition between the tiles of a tiled display. Every tile
+ * receives the layers intersecting it, clipped and translated into the tile
+ * coordinates. */
+static auto AssignTiledPlanes(DrmKmsPlan &plan, DrmDisplayPipeline &pipe,
+                              const std::vector<LayerData> &composition)
+    -> bool {
+  for (auto *tile_pipe : pipe.GetTilePipelines()) {
+    auto tile_rect = DrmKmsPlan::GetTileRect(*tile_pipe);
+    if (!tile_rect) {
+      return false;
+    }
+
+    std::vector<LayerData> tile_composition;
+    for (const auto &layer : composition) {
+      auto tile_layer = layer;
+      if (!tile_layer.pi.ClipDisplayFrame(*tile_rect)) {
+        continue;
+      }
+
+      auto &df = tile_layer.pi.display_frame;
+      df.left -= tile_rect->left;
+      df.right -= tile_rect->left;
+      df.top -= tile_rect->top;
+      df.bottom -= tile_rect->top;
+      tile_composition.emplace_back(std::move(tile_layer));
+    }
+
+    if (!AssignPlanes(plan, *tile_pipe, std::move(tile_composition))) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+auto DrmKmsPlan::CreateDrmKmsPlan(DrmDisplayPipeline &pipe,
+                                  std::vector<LayerData> composition)
+    -> std::unique_ptr<DrmKmsPlan> {
+  auto plan = std::make_unique<DrmKmsPlan>();
+
+  auto success = pipe.tiles.empty()
+                     ? AssignPlanes(*plan, pipe, std::move(composition))
+                     : AssignTiledPlanes(*plan, pipe, composition);
+  if (!success) {
+    return {};
   }
 
   return plan;
@@ -17,6 +17,7 @@
 #pragma once
 
 #include <memory>
+#include <optional>
 #include <vector>
 
 #include "LayerData.h"
@@ -37,6 +38,10 @@ struct DrmKmsPlan {
   static auto CreateDrmKmsPlan(DrmDisplayPipeline &pipe,
                                std::vector<LayerData> composition)
       -> std::unique_ptr<DrmKmsPlan>;
+
+  /* Area of the display a tile pipeline scans out, unset if not tiled */
+  static auto GetTileRect(DrmDisplayPipeline &tile_pipe)
+      -> std::optional<hwc_rect_t>;
 };
 
 }  // namespace android
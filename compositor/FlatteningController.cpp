@@ -37,20 +37,37 @@
 
 namespace android {
 
-auto FlatteningController::CreateInstance(FlatConCallbacks &cbks)
+auto FlatteningController::CreateInstance(
+    const std::shared_ptr<Reactor> &reactor, FlatConCallbacks &cbks)
     -> std::shared_ptr<FlatteningController> {
+  if (!reactor)
+    return {};
+
   auto fc = std::shared_ptr<FlatteningController>(new FlatteningController());
 
   fc->cbks_ = cbks;
 
-  std::thread(&FlatteningController::ThreadFn, fc).detach();
+  std::weak_ptr<FlatteningController> weak_fc = fc;
+  fc->timer_ = reactor->CreateTimer([weak_fc]() {
+    auto flatcon = weak_fc.lock();
+    if (flatcon)
+      flatcon->OnTimeout();
+  });
+  if (!fc->timer_)
+    return {};
 
   return fc;
 }
 
+static auto ToMonotonicNs(std::chrono::steady_clock::time_point time)
+    -> int64_t {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             time.time_since_epoch())
+      .count();
+}
+
 /* Compositor should call this every frame */
 bool FlatteningController::NewFrame() {
-  bool wake_it = false;
   auto lock = std::lock_guard<std::mutex>(mutex_);
 
   if (flatten_next_frame_) {
@@ -58,41 +75,40 @@ bool FlatteningController::NewFrame() {
     return true;
   }
 
-  sleep_until_ = std::chrono::system_clock::now() + kTimeout;
-  if (disabled_) {
-    wake_it = true;
-    disabled_ = false;
-  }
+  sleep_until_ = std::chrono::steady_clock::now() + kTimeout;
+  disabled_ = false;
 
-  if (wake_it)
-    cv_.notify_all();
+  if (!timer_armed_ && timer_) {
+    timer_->ArmAt(ToMonotonicNs(sleep_until_));
+    timer_armed_ = true;
+  }
 
   return false;
 }
 
-void FlatteningController::ThreadFn(
-    const std::shared_ptr<FlatteningController> &fc) {
-  for (;;) {
-    std::unique_lock<std::mutex> lock(fc->mutex_);
-    if (fc.use_count() == 1 || !fc->cbks_.trigger)
-      break;
-
-    if (fc->sleep_until_ <= std::chrono::system_clock::now() &&
-        !fc->disabled_) {
-      fc->disabled_ = true;
-      fc->flatten_next_frame_ = true;
-      ALOGV("Timeout. Sending an event to compositor");
-      fc->cbks_.trigger();
+/* Called on the reactor thread */
+void FlatteningController::OnTimeout() {
+  decltype(cbks_.trigger) trigger;
+  {
+    auto lock = std::lock_guard<std::mutex>(mutex_);
+    timer_armed_ = false;
+    if (disabled_ || !timer_)
+      return;
+
+    if (sleep_until_ > std::chrono::steady_clock::now()) {
+      timer_->ArmAt(ToMonotonicNs(sleep_until_));
+      timer_armed_ = true;
+      return;
     }
 
-    if (fc->disabled_) {
-      ALOGV("Wait");
-      fc->cv_.wait(lock);
-    } else {
-      ALOGV("Wait_until");
-      fc->cv_.wait_until(lock, fc->sleep_until_);
-    }
+    disabled_ = true;
+    flatten_next_frame_ = true;
+    trigger = cbks_.trigger;
   }
+
+  ALOGV("Timeout. Sending an event to compositor");
+  if (trigger)
+    trigger();
 }
 
 }  // namespace android
@@ -17,9 +17,10 @@
 #pragma once
 
 #include <chrono>
-#include <condition_variable>
 #include <functional>
-#include <thread>
+#include <mutex>
+
+#include "utils/Reactor.h"
 
 namespace android {
 
@@ -32,7 +33,8 @@ struct FlatConCallbacks {
 
 class FlatteningController {
  public:
-  static auto CreateInstance(FlatConCallbacks &cbks)
+  static auto CreateInstance(const std::shared_ptr<Reactor> &reactor,
+                             FlatConCallbacks &cbks)
       -> std::shared_ptr<FlatteningController>;
 
   void Disable() {
@@ -48,23 +50,26 @@ class FlatteningController {
     return flatten_next_frame_;
   }
 
-  void StopThread() {
+  void Stop() {
+    std::unique_ptr<ReactorTimer> timer;
     auto lock = std::lock_guard<std::mutex>(mutex_);
     cbks_ = {};
-    cv_.notify_all();
+    timer = std::move(timer_);
   }
 
   static constexpr auto kTimeout = 1s;
 
  private:
   FlatteningController() = default;
-  static void ThreadFn(const std::shared_ptr<FlatteningController> &fc);
+  void OnTimeout();
 
   bool flatten_next_frame_{};
   bool disabled_{};
-  decltype(std::chrono::system_clock::now()) sleep_until_{};
+  decltype(std::chrono::steady_clock::now()) sleep_until_{};
+  /* Timer is re-armed lazily, NewFrame() only moves sleep_until_ forward */
+  bool timer_armed_{};
+  std::unique_ptr<ReactorTimer> timer_;
   std::mutex mutex_;
-  std::condition_variable cv_;
   FlatConCallbacks cbks_;
 };
 
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "hwc-frame-rate-estimator"
+
+#include "FrameRateEstimator.h"
+
+#include <cmath>
+
+#include "utils/log.h"
+
+namespace android {
+
+/* About 2 seconds of film. Buffers are latched on the display vsync, so the
+ * error of a single interval is up to a refresh period.
+ */
+constexpr size_t kWindow = 48;
+/* Longer gaps are a pause or a seek, not a frame */
+constexpr int64_t kMaxIntervalNs = 200000000;
+constexpr double kNsInSec = 1e9;
+/* Within half of the distance between 24 and 25 */
+constexpr double kTolerance = 0.02;
+constexpr uint32_t kVideoRates[] = {24, 25, 30, 48, 50, 60};
+
+void FrameRateEstimator::OnNewBuffer(int64_t time_ns) {
+  if (!times_.empty() && time_ns - times_.back() > kMaxIntervalNs)
+    times_.clear();
+
+  times_.emplace_back(time_ns);
+  if (times_.size() > kWindow)
+    times_.pop_front();
+
+  if (times_.size() < kWindow)
+    return;
+
+  auto rate = double(times_.size() - 1) * kNsInSec /
+              double(times_.back() - times_.front());
+
+  uint32_t video_rate = 0;
+  for (auto candidate : kVideoRates) {
+    if (std::abs(rate / candidate - 1.0) < kTolerance)
+      video_rate = candidate;
+  }
+
+  if (video_rate != rate_)
+    ALOGV("Content frame rate %.3f, video rate %u", rate, video_rate);
+
+  rate_ = video_rate;
+}
+
+}  // namespace android
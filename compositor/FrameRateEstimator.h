@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+
+namespace android {
+
+/* Frame rate of a video, estimated from the times its layer gets new
+ * buffers. HWC2 has no way to pass the rate itself.
+ */
+class FrameRateEstimator {
+ public:
+  void OnNewBuffer(int64_t time_ns);
+
+  void Reset() {
+    times_.clear();
+    rate_ = 0;
+  }
+
+  /* One of the common video rates, 0 if unknown yet or none of them. The
+   * 1000/1001 variants are reported as the integer rate, as the two can't
+   * be told apart at the rate buffers are presented. Kept while the video
+   * is paused.
+   */
+  auto GetRate() const {
+    return rate_;
+  }
+
+ private:
+  std::deque<int64_t> times_;
+  uint32_t rate_{};
+};
+
+}  // namespace android
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Static content looks the same at any refresh rate, while every refresh
+ * costs scanout bandwidth and panel power.
+ *
+ * If no frame is presented for the idle period, IdleRefreshController calls
+ * back once. The display then switches to a lower refresh rate on its own,
+ * without a frame from the client, and restores the rate with the next
+ * presented frame.
+ */
+
+#define LOG_TAG "hwc-idle-refresh"
+
+#include "IdleRefreshController.h"
+
+#include "utils/log.h"
+
+namespace android {
+
+auto IdleRefreshController::CreateInstance(
+    const std::shared_ptr<Reactor> &reactor, std::chrono::milliseconds period,
+    IdleRefreshCallbacks &cbks) -> std::shared_ptr<IdleRefreshController> {
+  if (!reactor)
+    return {};
+
+  auto irc = std::shared_ptr<IdleRefreshController>(
+      new IdleRefreshController(period));
+
+  irc->cbks_ = cbks;
+
+  std::weak_ptr<IdleRefreshController> weak_irc = irc;
+  irc->timer_ = reactor->CreateTimer([weak_irc]() {
+    auto idlecon = weak_irc.lock();
+    if (idlecon)
+      idlecon->OnTimeout();
+  });
+  if (!irc->timer_)
+    return {};
+
+  return irc;
+}
+
+static auto ToMonotonicNs(std::chrono::steady_clock::time_point time)
+    -> int64_t {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             time.time_since_epoch())
+      .count();
+}
+
+void IdleRefreshController::NewFrame() {
+  auto lock = std::lock_guard<std::mutex>(mutex_);
+
+  idle_at_ = std::chrono::steady_clock::now() + period_;
+  idle_ = false;
+
+  if (!timer_armed_ && timer_) {
+    timer_->ArmAt(ToMonotonicNs(idle_at_));
+    timer_armed_ = true;
+  }
+}
+
+/* Called on the reactor thread */
+void IdleRefreshController::OnTimeout() {
+  decltype(cbks_.idle) idle;
+  {
+    auto lock = std::lock_guard<std::mutex>(mutex_);
+    timer_armed_ = false;
+    if (idle_ || !timer_)
+      return;
+
+    if (idle_at_ > std::chrono::steady_clock::now()) {
+      timer_->ArmAt(ToMonotonicNs(idle_at_));
+      timer_armed_ = true;
+      return;
+    }
+
+    idle_ = true;
+    idle = cbks_.idle;
+  }
+
+  ALOGV("No frames for %lld ms", static_cast<long long>(period_.count()));
+  if (idle)
+    idle();
+}
+
+}  // namespace android
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <mutex>
+
+#include "utils/Reactor.h"
+
+namespace android {
+
+struct IdleRefreshCallbacks {
+  /* Called on the reactor thread once per idle period */
+  std::function<void()> idle;
+};
+
+class IdleRefreshController {
+ public:
+  static auto CreateInstance(const std::shared_ptr<Reactor> &reactor,
+                             std::chrono::milliseconds period,
+                             IdleRefreshCallbacks &cbks)
+      -> std::shared_ptr<IdleRefreshController>;
+
+  /* Compositor should call this every presented frame */
+  void NewFrame();
+
+  void Stop() {
+    std::unique_ptr<ReactorTimer> timer;
+    auto lock = std::lock_guard<std::mutex>(mutex_);
+    cbks_ = {};
+    timer = std::move(timer_);
+  }
+
+ private:
+  explicit IdleRefreshController(std::chrono::milliseconds period)
+      : period_(period){};
+  void OnTimeout();
+
+  const std::chrono::milliseconds period_;
+  decltype(std::chrono::steady_clock::now()) idle_at_{};
+  /* Timer is re-armed lazily, NewFrame() only moves idle_at_ forward */
+  bool timer_armed_{};
+  /* Set once the callback is called, until the next frame */
+  bool idle_{};
+  std::unique_ptr<ReactorTimer> timer_;
+  std::mutex mutex_;
+  IdleRefreshCallbacks cbks_;
+};
+
+}  // namespace android
@@ -19,13 +19,16 @@
 #include <hardware/hardware.h>
 #include <hardware/hwcomposer.h>
 
+#include <algorithm>
 #include <cmath>
 #include <cstdbool>
 #include <cstdint>
 #include <optional>
+#include <utility>
 #include <vector>
 
 #include "bufferinfo/BufferInfo.h"
+#include "bufferinfo/BufferInfoGetter.h"
 #include "drm/DrmFbImporter.h"
 #include "utils/fd.h"
 
@@ -47,6 +50,8 @@ struct PresentInfo {
   uint16_t alpha = UINT16_MAX;
   hwc_frect_t source_crop{};
   hwc_rect_t display_frame{};
+  /* Encoding of the display output, the plane converts the layer to it */
+  BufferTransfer output_transfer = BufferTransfer::kSdr;
 
   bool RequireScalingOrPhasing() const {
     const float src_width = source_crop.right - source_crop.left;
@@ -60,6 +65,104 @@ struct PresentInfo {
                    (source_crop.top - std::floor(source_crop.top) != 0);
     return scaling || phasing;
   }
+
+  /* Upscaling by the same whole factor in both directions, from a source
+   * crop on pixel boundaries. Nearest neighbour keeps such content sharp.
+   */
+  bool IsIntegerUpscale() const {
+    auto src_width = source_crop.right - source_crop.left;
+    auto src_height = source_crop.bottom - source_crop.top;
+    if ((transform & (LayerTransform::kRotate90 |
+                      LayerTransform::kRotate270)) != 0)
+      std::swap(src_width, src_height);
+
+    if (src_width <= 0 || src_height <= 0 ||
+        source_crop.left != std::floor(source_crop.left) ||
+        source_crop.top != std::floor(source_crop.top))
+      return false;
+
+    auto scale = float(display_frame.right - display_frame.left) / src_width;
+    return scale >= 2.0F && scale == std::floor(scale) &&
+           float(display_frame.bottom - display_frame.top) ==
+               src_height * scale;
+  }
+
+  /* Crops display frame to the |clip| rectangle and shrinks the source crop
+   * proportionally, taking layer transform into account.
+   * Returns false if nothing is left to display.
+   */
+  bool ClipDisplayFrame(const hwc_rect_t &clip) {
+    auto &df = display_frame;
+    const int left = std::max(df.left, clip.left);
+    const int top = std::max(df.top, clip.top);
+    const int right = std::min(df.right, clip.right);
+    const int bottom = std::min(df.bottom, clip.bottom);
+
+    if (left >= right || top >= bottom) {
+      return false;
+    }
+
+    if (left == df.left && top == df.top && right == df.right &&
+        bottom == df.bottom) {
+      return true;
+    }
+
+    /* Fractions of the display frame cut from each side */
+    auto dest_width = float(df.right - df.left);
+    auto dest_height = float(df.bottom - df.top);
+    const float cut_l = float(left - df.left) / dest_width;
+    const float cut_t = float(top - df.top) / dest_height;
+    const float cut_r = float(df.right - right) / dest_width;
+    const float cut_b = float(df.bottom - bottom) / dest_height;
+
+    /* Source is flipped first and then rotated clockwise, undo the rotation
+     * and then the flips to get the cuts in the source orientation.
+     */
+    float src_l = cut_l;
+    float src_t = cut_t;
+    float src_r = cut_r;
+    float src_b = cut_b;
+    if ((transform & LayerTransform::kRotate90) != 0) {
+      src_l = cut_t;
+      src_t = cut_r;
+      src_r = cut_b;
+      src_b = cut_l;
+    } else if ((transform & LayerTransform::kRotate180) != 0) {
+      src_l = cut_r;
+      src_t = cut_b;
+      src_r = cut_l;
+      src_b = cut_t;
+    } else if ((transform & LayerTransform::kRotate270) != 0) {
+      src_l = cut_b;
+      src_t = cut_l;
+      src_r = cut_t;
+      src_b = cut_r;
+    }
+
+    if ((transform & LayerTransform::kFlipH) != 0) {
+      std::swap(src_l, src_r);
+    }
+    if ((transform & LayerTransform::kFlipV) != 0) {
+      std::swap(src_t, src_b);
+    }
+
+    const float src_width = source_crop.right - source_crop.left;
+    const float src_height = source_crop.bottom - source_crop.top;
+    source_crop = (hwc_frect_t){
+        .left = source_crop.left + src_width * src_l,
+        .top = source_crop.top + src_height * src_t,
+        .right = source_crop.right - src_width * src_r,
+        .bottom = source_crop.bottom - src_height * src_b,
+    };
+    df = (hwc_rect_t){
+        .left = left,
+        .top = top,
+        .right = right,
+        .bottom = bottom,
+    };
+
+    return true;
+  }
 };
 
 struct LayerData {
@@ -67,6 +170,19 @@ struct LayerData {
   std::shared_ptr<DrmFbIdHandle> fb;
   PresentInfo pi;
   SharedFd acquire_fence;
+  /* Composed by the client, the scaling filter policy leaves it alone */
+  bool client_target{};
+
+  /* Hides whatever is below it: no plane alpha, and either blending is
+   * disabled or the format has no alpha channel.
+   */
+  bool IsOpaque() const {
+    if (!bi || pi.alpha != UINT16_MAX)
+      return false;
+
+    return bi->blend_mode == BufferBlendMode::kNone ||
+           BufferInfoGetter::IsDrmFormatOpaque(bi->format);
+  }
 };
 
 }  // namespace android
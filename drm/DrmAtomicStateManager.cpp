@@ -24,8 +24,12 @@
 #include <drm/drm_mode.h>
 #include <sync/sync.h>
 #include <utils/Trace.h>
+#include <xf86drm.h>
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <cstring>
 
 #include "drm/DrmCrtc.h"
 #include "drm/DrmDevice.h"
@@ -41,27 +45,189 @@ auto DrmAtomicStateManager::CreateInstance(DrmDisplayPipeline *pipe)
       new DrmAtomicStateManager());
 
   dasm->pipe_ = pipe;
-  std::thread(&DrmAtomicStateManager::ThreadFn, dasm.get(), dasm).detach();
+  dasm->reactor_ = pipe->device->GetResMan().GetReactor();
+  if (!dasm->reactor_)
+    return {};
+
+  std::weak_ptr<DrmAtomicStateManager> weak_dasm = dasm;
+  dasm->flip_handler_token_ = pipe->device->SetFlipHandler(
+      pipe->crtc->Get()->GetId(),
+      [weak_dasm](uint32_t sequence, int64_t timestamp) {
+        auto manager = weak_dasm.lock();
+        if (manager)
+          manager->present_timing_.OnFlipComplete(sequence, timestamp);
+      });
+
+  if (pipe->device->IsFirmwareStateAdoptable())
+    dasm->AdoptActiveCrtc();
 
   return dasm;
 }
 
+/* The firmware (bootloader or kernel splash) may have lit the display
+ * already. Taking over its state lets the first frame be a plain flip
+ * instead of a modeset blanking the splash. Every tile CRTC has to be
+ * active and driving its connector.
+ */
+void DrmAtomicStateManager::AdoptActiveCrtc() {
+  auto *drm = pipe_->device;
+  std::optional<DrmMode> mode;
+  for (auto *tile_pipe : pipe_->GetTilePipelines()) {
+    auto crtc_id = tile_pipe->crtc->Get()->GetId();
+    auto connector_id = tile_pipe->connector->Get()->GetId();
+
+    DrmProperty active;
+    DrmProperty connector_crtc_id;
+    if (drm->GetProperty(crtc_id, DRM_MODE_OBJECT_CRTC, "ACTIVE", &active) !=
+            0 ||
+        drm->GetProperty(connector_id, DRM_MODE_OBJECT_CONNECTOR, "CRTC_ID",
+                         &connector_crtc_id) != 0 ||
+        active.GetValue().value_or(0) == 0 ||
+        connector_crtc_id.GetValue().value_or(0) != crtc_id)
+      return;
+
+    auto crtc = MakeDrmModeCrtcUnique(*drm->GetFd(), crtc_id);
+    if (!crtc || crtc->mode_valid == 0)
+      return;
+
+    if (mode && !mode->HasSameTimings(DrmMode(&crtc->mode)))
+      return;
+    mode = DrmMode(&crtc->mode);
+  }
+
+  /* Planes lit by the firmware are disabled by the first composition, unless
+   * it reuses them
+   */
+  for (auto *tile_pipe : pipe_->GetTilePipelines()) {
+    for (auto &plane : tile_pipe->GetLitPlanes())
+      active_frame_state_.used_planes.emplace_back(plane);
+  }
+
+  active_frame_state_.crtc_active_state = true;
+  adopted_mode_ = mode;
+  ALOGI("Connector %s is lit in %s, adopting it",
+        pipe_->connector->Get()->GetName().c_str(), mode->GetName().c_str());
+}
+
+void DrmAtomicStateManager::Stop() {
+  pipe_->device->ResetFlipHandler(pipe_->crtc->Get()->GetId(),
+                                  flip_handler_token_);
+
+  const std::unique_lock lock(mutex_);
+  exit_ = true;
+  if (last_present_fence_)
+    reactor_->RemoveFd(*last_present_fence_);
+}
+
+/* CTA-861.3 Static Metadata Type 1 of the HDR Dynamic Range and Mastering
+ * InfoFrame
+ */
+static auto MakeHdrOutputMetadata(BufferTransfer transfer,
+                                  const HdrStaticMetadata &md)
+    -> std::optional<hdr_output_metadata> {
+  constexpr uint8_t kStaticMetadataType1 = 0;
+  constexpr uint8_t kEotfSt2084 = 2;
+  constexpr uint8_t kEotfHlg = 3;
+  /* Chromaticity is in 0.00002 units, minimum luminance in 0.0001 nits */
+  constexpr float kChromaticityScale = 50000.0F;
+  constexpr float kMinLuminanceScale = 10000.0F;
+
+  if (transfer != BufferTransfer::kSt2084 && transfer != BufferTransfer::kHlg)
+    return {};
+
+  auto to_u16 = [](float value) {
+    return uint16_t(std::clamp(std::lround(value), 0L, long(UINT16_MAX)));
+  };
+
+  hdr_output_metadata out{};
+  memset(&out, 0, sizeof(out));
+  out.metadata_type = kStaticMetadataType1;
+  auto &info = out.hdmi_metadata_type1;
+  info.eotf = transfer == BufferTransfer::kSt2084 ? kEotfSt2084 : kEotfHlg;
+  info.metadata_type = kStaticMetadataType1;
+  for (int i = 0; i < 3; i++) {
+    info.display_primaries[i].x = to_u16(md.display_primaries[i][0] *
+                                         kChromaticityScale);
+    info.display_primaries[i].y = to_u16(md.display_primaries[i][1] *
+                                         kChromaticityScale);
+  }
+  info.white_point.x = to_u16(md.white_point[0] * kChromaticityScale);
+  info.white_point.y = to_u16(md.white_point[1] * kChromaticityScale);
+  info.max_display_mastering_luminance = to_u16(md.max_mastering_luminance);
+  info.min_display_mastering_luminance = to_u16(md.min_mastering_luminance *
+                                                kMinLuminanceScale);
+  info.max_cll = to_u16(md.max_content_light_level);
+  info.max_fall = to_u16(md.max_frame_average_light_level);
+  return out;
+}
+
+auto DrmAtomicStateManager::AtomicSetHdrOutput(drmModeAtomicReq &pset,
+                                               const AtomicCommitArgs &args,
+                                               KmsState &new_frame_state)
+    -> int {
+  if (!pipe_->connector->Get()->GetHdrOutputMetadataProperty())
+    return 0;
+
+  auto metadata = MakeHdrOutputMetadata(args.output_transfer,
+                                        args.hdr_metadata);
+  auto &prev = new_frame_state.hdr_metadata;
+  if (metadata.has_value() == prev.has_value() &&
+      (!metadata || memcmp(&*metadata, &*prev, sizeof(*metadata)) == 0)) {
+    return 0;
+  }
+
+  uint32_t blob_id = 0;
+  if (metadata) {
+    new_frame_state.hdr_metadata_blob = pipe_->device->RegisterUserPropertyBlob(
+        &*metadata, sizeof(*metadata));
+    if (!new_frame_state.hdr_metadata_blob) {
+      ALOGE("Failed to create HDR output metadata blob");
+      return -EINVAL;
+    }
+    blob_id = *new_frame_state.hdr_metadata_blob;
+  }
+
+  for (auto *tile_pipe : pipe_->GetTilePipelines()) {
+    auto *connector = tile_pipe->connector->Get();
+    const auto &caps = connector->GetHdrCapabilities();
+    auto color_space = metadata && caps && caps->bt2020_rgb
+                           ? BufferColorSpace::kItuRec2020
+                           : BufferColorSpace::kUndefined;
+    if (!connector->GetHdrOutputMetadataProperty().AtomicSet(pset, blob_id) ||
+        !connector->AtomicSetColorspace(pset, color_space)) {
+      return -EINVAL;
+    }
+  }
+
+  prev = metadata;
+  return 1;
+}
+
 // NOLINTNEXTLINE (readability-function-cognitive-complexity): Fixme
 auto DrmAtomicStateManager::CommitFrame(AtomicCommitArgs &args) -> int {
   // NOLINTNEXTLINE(misc-const-correctness)
   ATRACE_CALL();
 
-  if (args.active && *args.active == active_frame_state_.crtc_active_state) {
+  auto &last_frame_state = LastFrameState();
+  if (args.active && *args.active == last_frame_state.crtc_active_state) {
     /* Don't set the same state twice */
     args.active.reset();
   }
 
+  /* Setting the display to active before we have a composition can break
+   * some drivers, the next composition activates it then
+   */
+  if (args.active && *args.active && !args.composition &&
+      last_frame_state.used_framebuffers.empty()) {
+    args.active.reset();
+  }
+
   if (!args.HasInputs()) {
     /* nothing to do */
     return 0;
   }
 
-  if (!active_frame_state_.crtc_active_state) {
+  if (!last_frame_state.crtc_active_state) {
     /* Force activate display */
     args.active = true;
   }
@@ -69,8 +235,8 @@ auto DrmAtomicStateManager::CommitFrame(AtomicCommitArgs &args) -> int {
   auto new_frame_state = NewFrameState();
 
   auto *drm = pipe_->device;
-  auto *connector = pipe_->connector->Get();
-  auto *crtc = pipe_->crtc->Get();
+  /* Tiled displays are committed at once using every CRTC of the tiles */
+  auto tile_pipes = pipe_->GetTilePipelines();
 
   auto pset = MakeDrmModeAtomicReqUnique();
   if (!pset) {
@@ -78,19 +244,27 @@ auto DrmAtomicStateManager::CommitFrame(AtomicCommitArgs &args) -> int {
     return -ENOMEM;
   }
 
-  int out_fence = -1;
-  if (!crtc->GetOutFencePtrProperty().AtomicSet(*pset, uint64_t(&out_fence))) {
-    return -EINVAL;
+  std::vector<int> out_fences(tile_pipes.size(), -1);
+  for (size_t i = 0; i < tile_pipes.size(); i++) {
+    auto *crtc = tile_pipes[i]->crtc->Get();
+    if (!crtc->GetOutFencePtrProperty().AtomicSet(*pset,
+                                                  uint64_t(&out_fences[i]))) {
+      return -EINVAL;
+    }
   }
 
+  /* Turning the CRTC on or off doesn't block the caller either */
   bool nonblock = true;
 
   if (args.active) {
-    nonblock = false;
     new_frame_state.crtc_active_state = *args.active;
-    if (!crtc->GetActiveProperty().AtomicSet(*pset, *args.active ? 1 : 0) ||
-        !connector->GetCrtcIdProperty().AtomicSet(*pset, crtc->GetId())) {
-      return -EINVAL;
+    for (auto *tile_pipe : tile_pipes) {
+      auto *crtc = tile_pipe->crtc->Get();
+      auto *connector = tile_pipe->connector->Get();
+      if (!crtc->GetActiveProperty().AtomicSet(*pset, *args.active ? 1 : 0) ||
+          !connector->GetCrtcIdProperty().AtomicSet(*pset, crtc->GetId())) {
+        return -EINVAL;
+      }
     }
   }
 
@@ -102,12 +276,22 @@ auto DrmAtomicStateManager::CommitFrame(AtomicCommitArgs &args) -> int {
       return -EINVAL;
     }
 
-    if (!crtc->GetModeProperty().AtomicSet(*pset, *new_frame_state.mode_blob)) {
-      return -EINVAL;
+    /* Applies when the CRTC scales the whole output */
+    auto filter = drm->GetResMan().GetScalingFilterPolicy() ==
+                          ScalingFilterPolicy::kNearest
+                      ? ScalingFilter::kNearestNeighbor
+                      : ScalingFilter::kDefault;
+    for (auto *tile_pipe : tile_pipes) {
+      auto *crtc = tile_pipe->crtc->Get();
+      if (!crtc->GetModeProperty().AtomicSet(*pset,
+                                             *new_frame_state.mode_blob) ||
+          !crtc->AtomicSetScalingFilter(*pset, filter)) {
+        return -EINVAL;
+      }
     }
   }
 
-  if (args.color_matrix && crtc->GetCtmProperty()) {
+  if (args.color_matrix && pipe_->crtc->Get()->GetCtmProperty()) {
     auto blob = drm->RegisterUserPropertyBlob(args.color_matrix.get(),
                                               sizeof(drm_color_ctm));
     new_frame_state.ctm_blob = std::move(blob);
@@ -117,16 +301,22 @@ auto DrmAtomicStateManager::CommitFrame(AtomicCommitArgs &args) -> int {
       return -EINVAL;
     }
 
-    if (!crtc->GetCtmProperty().AtomicSet(*pset, *new_frame_state.ctm_blob))
-      return -EINVAL;
+    for (auto *tile_pipe : tile_pipes) {
+      auto &ctm_property = tile_pipe->crtc->Get()->GetCtmProperty();
+      if (ctm_property &&
+          !ctm_property.AtomicSet(*pset, *new_frame_state.ctm_blob))
+        return -EINVAL;
+    }
   }
 
   auto unused_planes = new_frame_state.used_planes;
 
   if (args.composition) {
     new_frame_state.used_planes.clear();
+    new_frame_state.used_framebuffers.clear();
 
-    bool most_bottom = true;
+    /* Planes are sorted by z-position within every CRTC */
+    std::vector<uint32_t> crtcs_in_use;
 
     for (auto &joining : args.composition->plan) {
       DrmPlane *plane = joining.plane->Get();
@@ -139,11 +329,17 @@ auto DrmAtomicStateManager::CommitFrame(AtomicCommitArgs &args) -> int {
       auto &v = unused_planes;
       v.erase(std::remove(v.begin(), v.end(), joining.plane), v.end());
 
-      if (plane->AtomicSetState(*pset, layer, joining.z_pos, crtc->GetId(),
+      auto crtc_id = plane->GetPipeline()->crtc->Get()->GetId();
+      auto most_bottom = std::find(crtcs_in_use.begin(), crtcs_in_use.end(),
+                                   crtc_id) == crtcs_in_use.end();
+      if (most_bottom) {
+        crtcs_in_use.emplace_back(crtc_id);
+      }
+
+      if (plane->AtomicSetState(*pset, layer, joining.z_pos, crtc_id,
                                 most_bottom) != 0) {
         return -EINVAL;
       }
-      most_bottom = false;
     }
   }
 
@@ -153,9 +349,28 @@ auto DrmAtomicStateManager::CommitFrame(AtomicCommitArgs &args) -> int {
         return -EINVAL;
       }
     }
+
+    auto ret = AtomicSetHdrOutput(*pset, args, new_frame_state);
+    if (ret < 0)
+      return ret;
+
+    /* Sinks switch the EOTF with a blank, the state must not lag behind a
+     * staged frame either
+     */
+    if (ret > 0)
+      nonblock = false;
   }
 
-  uint32_t flags = DRM_MODE_ATOMIC_ALLOW_MODESET;
+  uint32_t flags = args.seamless ? 0 : DRM_MODE_ATOMIC_ALLOW_MODESET;
+
+  /* Some drivers switch the refresh rate of an active CRTC without a
+   * modeset, skip the blank where they accept the new mode as is
+   */
+  if (args.display_mode && !args.active && !args.test_only && flags != 0 &&
+      drmModeAtomicCommit(*drm->GetFd(), pset.get(), DRM_MODE_ATOMIC_TEST_ONLY,
+                          drm) == 0) {
+    flags = 0;
+  }
 
   if (args.test_only) {
     return drmModeAtomicCommit(*drm->GetFd(), pset.get(),
@@ -180,14 +395,56 @@ auto DrmAtomicStateManager::CommitFrame(AtomicCommitArgs &args) -> int {
     flags |= DRM_MODE_ATOMIC_NONBLOCK;
   }
 
-  auto err = drmModeAtomicCommit(*drm->GetFd(), pset.get(), flags, drm);
+  if (args.active)
+    new_frame_state.power_transition_ns = ResourceManager::GetTimeMonotonicNs();
+
+  /* Flip events are delivered only for active CRTCs */
+  auto lead_crtc_id = pipe_->crtc->Get()->GetId();
+  if (new_frame_state.crtc_active_state) {
+    flags |= DRM_MODE_PAGE_FLIP_EVENT;
+
+    uint64_t sequence = 0;
+    uint64_t sequence_ns = 0;
+    if (drmCrtcGetSequence(*drm->GetFd(), lead_crtc_id, &sequence,
+                           &sequence_ns) != 0) {
+      sequence = 0;
+    } else {
+      sequence++;
+    }
+    present_timing_.OnCommit(ResourceManager::GetTimeMonotonicNs(), sequence);
+  }
+
+  /* Passed back by the kernel with the flip event */
+  // NOLINTNEXTLINE(performance-no-int-to-ptr)
+  auto *user_data = reinterpret_cast<void *>(uintptr_t(lead_crtc_id));
+  auto err = drmModeAtomicCommit(*drm->GetFd(), pset.get(), flags, user_data);
 
   if (err != 0) {
     ALOGE("Failed to commit pset ret=%d\n", err);
+    if (new_frame_state.crtc_active_state)
+      present_timing_.OnCommitFailed();
     return err;
   }
 
-  args.out_fence = MakeSharedFd(out_fence);
+  args.out_fence = MakeSharedFd(out_fences[0]);
+  for (size_t i = 1; i < out_fences.size(); i++) {
+    /* Frame is presented once every tile has been presented */
+    auto tile_fence = MakeSharedFd(out_fences[i]);
+    if (!args.out_fence || !tile_fence) {
+      if (!args.out_fence) {
+        args.out_fence = tile_fence;
+      }
+      continue;
+    }
+
+    auto merged = MakeSharedFd(
+        sync_merge("hwc-tiles", *args.out_fence, *tile_fence));
+    if (!merged) {
+      ALOGE("Failed to merge tile present fences");
+      continue;
+    }
+    args.out_fence = merged;
+  }
 
   if (nonblock) {
     {
@@ -195,64 +452,97 @@ auto DrmAtomicStateManager::CommitFrame(AtomicCommitArgs &args) -> int {
       last_present_fence_ = args.out_fence;
       staged_frame_state_ = std::move(new_frame_state);
       frames_staged_++;
+      if (last_present_fence_)
+        WatchPresentFence(last_present_fence_, frames_staged_);
     }
-    cv_.notify_all();
   } else {
+    OnFrameStateApplied(new_frame_state, args.out_fence);
     active_frame_state_ = std::move(new_frame_state);
   }
 
   return 0;
 }
 
-void DrmAtomicStateManager::ThreadFn(
-    const std::shared_ptr<DrmAtomicStateManager> &dasm) {
-  int tracking_at_the_moment = -1;
-  auto &main_mutex = pipe_->device->GetResMan().GetMainLock();
-
-  for (;;) {
-    SharedFd present_fence;
-
-    {
-      std::unique_lock lk(mutex_);
-      cv_.wait(lk);
-
-      if (exit_thread_ || dasm.use_count() == 1)
-        break;
+/* CLOCK_MONOTONIC time the fence signaled at, the latest one of merged
+ * fences. Unset while it is pending.
+ */
+static auto GetFenceSignalTime(const SharedFd &fence)
+    -> std::optional<int64_t> {
+  if (!fence)
+    return {};
+
+  auto *info = sync_file_info(*fence);
+  if (info == nullptr)
+    return {};
+
+  std::optional<int64_t> signal_ns;
+  if (info->status == 1) {
+    auto *fences = sync_get_fence_info(info);
+    for (uint32_t i = 0; i < info->num_fences; i++) {
+      // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+      auto ns = int64_t(fences[i].timestamp_ns);
+      signal_ns = std::max(signal_ns.value_or(ns), ns);
+    }
+  }
 
-      if (frames_staged_ <= tracking_at_the_moment)
-        continue;
+  sync_file_info_free(info);
+  return signal_ns;
+}
 
-      tracking_at_the_moment = frames_staged_;
+/* The commit completes when its present fence signals, which may be well
+ * before the state is released here
+ */
+void DrmAtomicStateManager::OnFrameStateApplied(const KmsState &state,
+                                                const SharedFd &present_fence) {
+  if (!state.power_transition_ns)
+    return;
+
+  auto signal_ns = GetFenceSignalTime(present_fence);
+  if (!signal_ns) {
+    ALOGW("Power transition completion time is unknown");
+    return;
+  }
 
-      present_fence = last_present_fence_;
-      if (!present_fence)
-        continue;
-    }
+  auto &stats = state.crtc_active_state ? power_on_stats_ : power_off_stats_;
+  stats.count++;
+  stats.last_ns = *signal_ns - *state.power_transition_ns;
+  stats.max_ns = std::max(stats.max_ns, stats.last_ns);
+}
 
-    {
-      // NOLINTNEXTLINE(misc-const-correctness)
-      ATRACE_NAME("AsyncWaitForBuffersSwap");
-      constexpr int kTimeoutMs = 500;
-      auto err = sync_wait(*present_fence, kTimeoutMs);
-      if (err != 0) {
-        ALOGE("sync_wait(fd=%i) returned: %i (errno: %i)", *present_fence, err,
-              errno);
-      }
+void DrmAtomicStateManager::WatchPresentFence(const SharedFd &fence,
+                                              int frame) {
+  std::weak_ptr<DrmAtomicStateManager> weak_dasm = shared_from_this();
+  std::weak_ptr<Reactor> weak_reactor = reactor_;
+  auto ret = reactor_->AddFd(*fence, [weak_dasm, weak_reactor, fence,
+                                      frame]() {
+    auto dasm = weak_dasm.lock();
+    if (dasm) {
+      dasm->OnPresentFenceSignaled(frame);
+      return;
     }
 
-    {
-      const std::unique_lock mlk(main_mutex);
-      const std::unique_lock lk(mutex_);
-      if (exit_thread_)
-        break;
-
-      /* If resources is already cleaned-up by main thread, skip */
-      if (tracking_at_the_moment > frames_tracked_)
-        CleanupPriorFrameResources();
-    }
+    /* Fence is level-triggered, make sure it won't fire again */
+    auto reactor = weak_reactor.lock();
+    if (reactor)
+      reactor->RemoveFd(*fence);
+  });
+  if (ret != 0) {
+    ALOGE("Failed to watch present fence: %d", ret);
   }
+}
+
+/* Called on the reactor thread */
+void DrmAtomicStateManager::OnPresentFenceSignaled(int frame) {
+  auto &main_mutex = pipe_->device->GetResMan().GetMainLock();
+
+  const std::unique_lock mlk(main_mutex);
+  const std::unique_lock lk(mutex_);
+  if (exit_)
+    return;
 
-  ALOGI("DrmAtomicStateManager thread exit");
+  /* If resources is already cleaned-up by main thread, skip */
+  if (frame > frames_tracked_)
+    CleanupPriorFrameResources();
 }
 
 void DrmAtomicStateManager::CleanupPriorFrameResources() {
@@ -262,7 +552,9 @@ void DrmAtomicStateManager::CleanupPriorFrameResources() {
   // NOLINTNEXTLINE(misc-const-correctness)
   ATRACE_NAME("CleanupPriorFrameResources");
   frames_tracked_++;
+  OnFrameStateApplied(staged_frame_state_, last_present_fence_);
   active_frame_state_ = std::move(staged_frame_state_);
+  reactor_->RemoveFd(*last_present_fence_);
   last_present_fence_ = {};
 }
 
@@ -288,13 +580,4 @@ auto DrmAtomicStateManager::ExecuteAtomicCommit(AtomicCommitArgs &args) -> int {
   return err;
 }  // namespace android
 
-auto DrmAtomicStateManager::ActivateDisplayUsingDPMS() -> int {
-  return drmModeConnectorSetProperty(*pipe_->device->GetFd(),
-                                     pipe_->connector->Get()->GetId(),
-                                     pipe_->connector->Get()
-                                         ->GetDpmsProperty()
-                                         .GetId(),
-                                     DRM_MODE_DPMS_ON);
-}
-
 }  // namespace android
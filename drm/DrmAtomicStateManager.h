@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <drm/drm_mode.h>
 #include <pthread.h>
 
 #include <memory>
@@ -24,6 +25,7 @@
 #include "compositor/DrmKmsPlan.h"
 #include "compositor/LayerData.h"
 #include "drm/DrmPlane.h"
+#include "drm/PresentTiming.h"
 #include "drm/ResourceManager.h"
 #include "drm/VSyncWorker.h"
 
@@ -34,8 +36,13 @@ struct AtomicCommitArgs {
   bool test_only = false;
   std::optional<DrmMode> display_mode;
   std::optional<bool> active;
+  /* Fail rather than blank the display to change the mode */
+  bool seamless = false;
   std::shared_ptr<DrmKmsPlan> composition;
   std::shared_ptr<drm_color_ctm> color_matrix;
+  /* Output encoding, sent to the sink along with the composition */
+  BufferTransfer output_transfer = BufferTransfer::kSdr;
+  HdrStaticMetadata hdr_metadata{};
 
   /* out */
   SharedFd out_fence;
@@ -46,7 +53,8 @@ struct AtomicCommitArgs {
   }
 };
 
-class DrmAtomicStateManager {
+class DrmAtomicStateManager
+    : public std::enable_shared_from_this<DrmAtomicStateManager> {
  public:
   static auto CreateInstance(DrmDisplayPipeline *pipe)
       -> std::shared_ptr<DrmAtomicStateManager>;
@@ -54,19 +62,39 @@ class DrmAtomicStateManager {
   ~DrmAtomicStateManager() = default;
 
   auto ExecuteAtomicCommit(AtomicCommitArgs &args) -> int;
-  auto ActivateDisplayUsingDPMS() -> int;
-
-  void StopThread() {
-    {
-      const std::unique_lock lock(mutex_);
-      exit_thread_ = true;
-    }
-    cv_.notify_all();
+
+  void Stop();
+
+  auto &GetPresentTiming() {
+    return present_timing_;
+  }
+
+  /* Mode the CRTC was found active in, if it was adopted */
+  auto &GetAdoptedMode() const {
+    return adopted_mode_;
+  }
+
+  /* Time from the commit turning the CRTC on or off until its present fence
+   * signals. For power on that is the first frame landing on the glass.
+   */
+  struct PowerTransitionStats {
+    uint32_t count{};
+    int64_t last_ns{};
+    int64_t max_ns{};
+  };
+
+  auto GetPowerOnStats() const {
+    return power_on_stats_;
+  }
+
+  auto GetPowerOffStats() const {
+    return power_off_stats_;
   }
 
  private:
   DrmAtomicStateManager() = default;
   auto CommitFrame(AtomicCommitArgs &args) -> int;
+  void AdoptActiveCrtc();
 
   struct KmsState {
     /* Required to cleanup unused planes */
@@ -77,34 +105,69 @@ class DrmAtomicStateManager {
 
     DrmModeUserPropertyBlobUnique mode_blob;
     DrmModeUserPropertyBlobUnique ctm_blob;
+    DrmModeUserPropertyBlobUnique hdr_metadata_blob;
+
+    /* HDR_OUTPUT_METADATA sent to the sink, unset for SDR output */
+    std::optional<hdr_output_metadata> hdr_metadata;
 
     int release_fence_pt_index{};
 
     /* To avoid setting the inactive state twice, which will fail the commit */
     bool crtc_active_state{};
+
+    /* Commit time, if the commit turned the CRTC on or off */
+    std::optional<int64_t> power_transition_ns;
   } active_frame_state_;
 
+  /* State of the last commit, possibly still staged. Both are updated under
+   * the main lock.
+   */
+  auto LastFrameState() -> KmsState & {
+    return frames_staged_ > frames_tracked_ ? staged_frame_state_
+                                            : active_frame_state_;
+  }
+
+  /* Planes keep scanning out their framebuffers until a composition replaces
+   * them, while the CRTC is off too
+   */
   auto NewFrameState() -> KmsState {
-    auto *prev_frame_state = &active_frame_state_;
+    auto *prev_frame_state = &LastFrameState();
     return (KmsState){
         .used_planes = prev_frame_state->used_planes,
+        .used_framebuffers = prev_frame_state->used_framebuffers,
+        .hdr_metadata = prev_frame_state->hdr_metadata,
         .crtc_active_state = prev_frame_state->crtc_active_state,
     };
   }
 
+  void OnFrameStateApplied(const KmsState &state,
+                           const SharedFd &present_fence);
+  PowerTransitionStats power_on_stats_;
+  PowerTransitionStats power_off_stats_;
+
   DrmDisplayPipeline *pipe_{};
 
   void CleanupPriorFrameResources();
 
+  auto AtomicSetHdrOutput(drmModeAtomicReq &pset, const AtomicCommitArgs &args,
+                          KmsState &new_frame_state) -> int;
+
   KmsState staged_frame_state_;
   SharedFd last_present_fence_;
   int frames_staged_{};
   int frames_tracked_{};
 
-  void ThreadFn(const std::shared_ptr<DrmAtomicStateManager> &dasm);
-  std::condition_variable cv_;
+  /* Present fence of the staged frame is watched by the reactor, resources of
+   * the prior frame are released once it signals.
+   */
+  void WatchPresentFence(const SharedFd &fence, int frame);
+  void OnPresentFenceSignaled(int frame);
+  std::shared_ptr<Reactor> reactor_;
+  PresentTiming present_timing_;
+  DrmDevice::HandlerToken flip_handler_token_{};
+  std::optional<DrmMode> adopted_mode_;
   std::mutex mutex_;
-  bool exit_thread_{};
+  bool exit_{};
 };
 
 }  // namespace android
@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "hwc-drm-color-pipeline"
+
+#include "DrmColorPipeline.h"
+
+#include "DrmDevice.h"
+#include "utils/log.h"
+
+namespace android {
+
+/* Guards against a malformed NEXT chain */
+constexpr size_t kMaxColorops = 32;
+/* "PQ 125" curves map 1.0 to 80 nits and 125.0 to 10000 nits */
+constexpr double kPq125UnitNits = 80.0;
+/* SDR reference white in HDR output, see ITU-R BT.2408 */
+constexpr double kSdrWhiteNits = 203.0;
+/* MULTIPLIER is S31.32 fixed point */
+constexpr double kMultiplierOne = double(1ULL << 32U);
+
+auto DrmColorPipeline::CreateInstance(DrmDevice &dev, uint32_t first_colorop_id)
+    -> std::unique_ptr<DrmColorPipeline> {
+  auto pipeline = std::unique_ptr<DrmColorPipeline>(
+      new DrmColorPipeline(first_colorop_id));
+
+  uint32_t id = first_colorop_id;
+  while (id != 0) {
+    if (pipeline->colorops_.size() == kMaxColorops) {
+      ALOGE("Color pipeline %u is too long", first_colorop_id);
+      return {};
+    }
+
+    auto op = std::make_unique<Colorop>();
+    op->id = id;
+    DrmProperty next;
+    if (dev.GetProperty(id, DRM_MODE_OBJECT_COLOROP, "NEXT", &next) != 0) {
+      ALOGE("Failed to get colorop %u", id);
+      return {};
+    }
+
+    dev.GetProperty(id, DRM_MODE_OBJECT_COLOROP, "BYPASS", &op->bypass);
+    dev.GetProperty(id, DRM_MODE_OBJECT_COLOROP, "MULTIPLIER",
+                    &op->multiplier);
+    if (dev.GetProperty(id, DRM_MODE_OBJECT_COLOROP, "CURVE_1D_TYPE",
+                        &op->curve_type) == 0) {
+      op->curve_type.AddEnumToMap("sRGB EOTF", Curve::kSrgbEotf, op->curves);
+      op->curve_type.AddEnumToMap("PQ 125 Inverse EOTF", Curve::kPqInverseEotf,
+                                  op->curves);
+    }
+
+    pipeline->colorops_.emplace_back(std::move(op));
+    id = uint32_t(next.GetValue().value_or(0));
+  }
+
+  return pipeline;
+}
+
+auto DrmColorPipeline::FindSteps(BufferTransfer from, BufferTransfer to) const
+    -> std::optional<Steps> {
+  /* Tone mapping HDR content down to SDR takes more than fixed curves */
+  if (from != BufferTransfer::kSdr || to != BufferTransfer::kSt2084)
+    return {};
+
+  Steps steps{};
+  for (const auto &op : colorops_) {
+    if (steps.decode == nullptr && op->curves.count(Curve::kSrgbEotf) != 0) {
+      steps.decode = op.get();
+    } else if (steps.decode != nullptr && steps.scale == nullptr &&
+               steps.encode == nullptr && op->multiplier) {
+      steps.scale = op.get();
+    } else if (steps.decode != nullptr && steps.encode == nullptr &&
+               op->curves.count(Curve::kPqInverseEotf) != 0) {
+      steps.encode = op.get();
+    } else if (!op->bypass) {
+      /* Can't be skipped */
+      return {};
+    }
+  }
+
+  if (steps.encode == nullptr)
+    return {};
+
+  return steps;
+}
+
+bool DrmColorPipeline::CanConvert(BufferTransfer from,
+                                  BufferTransfer to) const {
+  return FindSteps(from, to).has_value();
+}
+
+auto DrmColorPipeline::AtomicSetConversion(drmModeAtomicReq &pset,
+                                           BufferTransfer from,
+                                           BufferTransfer to) const -> bool {
+  auto steps = FindSteps(from, to);
+  if (!steps)
+    return false;
+
+  for (const auto &op : colorops_) {
+    const auto *o = op.get();
+    const bool used = o == steps->decode || o == steps->scale ||
+                      o == steps->encode;
+    if (o->bypass && !o->bypass.AtomicSet(pset, used ? 0 : 1))
+      return false;
+  }
+
+  const auto multiplier = uint64_t(kSdrWhiteNits / kPq125UnitNits *
+                                   kMultiplierOne);
+  return steps->decode->curve_type
+             .AtomicSet(pset, steps->decode->curves.at(Curve::kSrgbEotf)) &&
+         (steps->scale == nullptr ||
+          steps->scale->multiplier.AtomicSet(pset, multiplier)) &&
+         steps->encode->curve_type
+             .AtomicSet(pset, steps->encode->curves.at(Curve::kPqInverseEotf));
+}
+
+}  // namespace android
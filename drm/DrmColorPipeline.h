@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <xf86drmMode.h>
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "DrmProperty.h"
+#include "bufferinfo/BufferInfo.h"
+
+#ifndef DRM_MODE_OBJECT_COLOROP
+// NOLINTNEXTLINE(cppcoreguidelines-macro-usage)
+#define DRM_MODE_OBJECT_COLOROP 0xfafafafa
+#endif
+
+namespace android {
+
+class DrmDevice;
+
+/* Chain of color operations a plane applies before blending, one of the
+ * values of the COLOR_PIPELINE plane property. Only the named 1D curves and
+ * the multiplier are used, to bring SDR content to the PQ output encoding.
+ * The other operations are bypassed.
+ */
+class DrmColorPipeline {
+ public:
+  /* |first_colorop_id| is the COLOR_PIPELINE value selecting the pipeline */
+  static auto CreateInstance(DrmDevice &dev, uint32_t first_colorop_id)
+      -> std::unique_ptr<DrmColorPipeline>;
+
+  DrmColorPipeline(const DrmColorPipeline &) = delete;
+  DrmColorPipeline &operator=(const DrmColorPipeline &) = delete;
+
+  auto GetId() const {
+    return id_;
+  }
+
+  /* True if the pipeline converts |from| content to the |to| encoding */
+  bool CanConvert(BufferTransfer from, BufferTransfer to) const;
+
+  /* Sets up the conversion, the pipeline itself is selected by the caller */
+  auto AtomicSetConversion(drmModeAtomicReq &pset, BufferTransfer from,
+                           BufferTransfer to) const -> bool;
+
+ private:
+  explicit DrmColorPipeline(uint32_t id) : id_(id){};
+
+  enum class Curve {
+    kSrgbEotf,
+    kPqInverseEotf,
+  };
+
+  struct Colorop {
+    uint32_t id{};
+    DrmProperty bypass;
+    /* Set for the 1D curve operations */
+    DrmProperty curve_type;
+    std::map<Curve, uint64_t> curves;
+    /* Set for the multiplier operations */
+    DrmProperty multiplier;
+  };
+
+  /* Operations decoding, scaling and encoding the content, in order */
+  struct Steps {
+    const Colorop *decode{};
+    const Colorop *scale{};
+    const Colorop *encode{};
+  };
+
+  auto FindSteps(BufferTransfer from, BufferTransfer to) const
+      -> std::optional<Steps>;
+
+  const uint32_t id_;
+  std::vector<std::unique_ptr<Colorop>> colorops_;
+};
+
+}  // namespace android
@@ -18,16 +18,19 @@
 
 #include "DrmConnector.h"
 
-#include <cutils/properties.h>
 #include <xf86drmMode.h>
 
+#include <algorithm>
 #include <array>
 #include <cerrno>
+#include <cmath>
 #include <cstdint>
+#include <cstring>
 #include <sstream>
 
 #include "DrmDevice.h"
 #include "utils/log.h"
+#include "utils/properties.h"
 
 #ifndef DRM_MODE_CONNECTOR_SPI
 // NOLINTNEXTLINE(cppcoreguidelines-macro-usage)
@@ -79,6 +82,20 @@ auto DrmConnector::CreateInstance(DrmDevice &dev, uint32_t connector_id,
   }
 
   c->UpdateEdidProperty();
+  c->UpdateTile();
+
+  if (GetOptionalConnectorProperty(dev, *c, "Colorspace",
+                                   &c->colorspace_property_)) {
+    c->colorspace_property_.AddEnumToMap("Default",
+                                         BufferColorSpace::kUndefined,
+                                         c->colorspace_enum_map_);
+    c->colorspace_property_.AddEnumToMap("BT2020_RGB",
+                                         BufferColorSpace::kItuRec2020,
+                                         c->colorspace_enum_map_);
+  }
+  GetOptionalConnectorProperty(dev, *c, "HDR_OUTPUT_METADATA",
+                               &c->hdr_output_metadata_property_);
+  c->UpdateHdrCapabilities();
 
   if (c->IsWriteback() &&
       (!GetConnectorProperty(dev, *c, "WRITEBACK_PIXEL_FORMATS",
@@ -113,6 +130,147 @@ auto DrmConnector::GetEdidBlob() -> DrmModePropertyBlobUnique {
   return MakeDrmModePropertyBlobUnique(*drm_->GetFd(), *blob_id);
 }
 
+void DrmConnector::UpdateTile() {
+  tile_.reset();
+
+  DrmProperty tile_property;
+  if (!GetOptionalConnectorProperty(*drm_, *this, "TILE", &tile_property)) {
+    return;
+  }
+
+  auto blob_id = tile_property.GetValue();
+  if (!blob_id || *blob_id == 0) {
+    return;
+  }
+
+  auto blob = MakeDrmModePropertyBlobUnique(*drm_->GetFd(), *blob_id);
+  if (!blob || blob->length == 0) {
+    return;
+  }
+
+  /* Blob holds a string: "group:flags:h_tiles:v_tiles:h_loc:v_loc:w:h" */
+  const std::string tile_str(static_cast<const char *>(blob->data),
+                             strnlen(static_cast<const char *>(blob->data),
+                                     blob->length));
+  Tile tile{};
+  constexpr int kTileFieldsCount = 8;
+  // NOLINTNEXTLINE(cert-err34-c)
+  if (sscanf(tile_str.c_str(), "%u:%u:%u:%u:%u:%u:%u:%u", &tile.group_id,
+             &tile.flags, &tile.num_h_tile, &tile.num_v_tile, &tile.h_loc,
+             &tile.v_loc, &tile.h_size, &tile.v_size) != kTileFieldsCount ||
+      tile.num_h_tile == 0 || tile.num_v_tile == 0 || tile.h_size == 0 ||
+      tile.v_size == 0) {
+    ALOGE("Invalid TILE property for connector %s: %s", GetName().c_str(),
+          tile_str.c_str());
+    return;
+  }
+
+  tile_ = tile;
+}
+
+/* Parses the HDR Static Metadata and Colorimetry data blocks of the CTA-861
+ * extensions, see CTA-861-G 7.5.13 and 7.5.5.
+ */
+static auto ParseEdidHdrCapabilities(const uint8_t *edid, size_t size)
+    -> std::optional<DrmConnector::HdrCapabilities> {
+  constexpr size_t kBlockSize = 128;
+  constexpr size_t kExtensionCountOffset = 126;
+  constexpr uint8_t kCtaExtensionTag = 0x02;
+  constexpr size_t kDataBlocksOffset = 4;
+  constexpr uint8_t kExtendedTag = 7;
+  constexpr uint8_t kColorimetryTag = 5;
+  constexpr uint8_t kHdrStaticMetadataTag = 6;
+  constexpr uint8_t kBt2020RgbBit = 1U << 7U;
+  constexpr uint8_t kSt2084Bit = 1U << 2U;
+  constexpr uint8_t kHlgBit = 1U << 3U;
+
+  if (size < kBlockSize)
+    return {};
+
+  DrmConnector::HdrCapabilities caps{};
+  auto has_hdr_block = false;
+  // NOLINTBEGIN(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  const size_t blocks = std::min(size_t(edid[kExtensionCountOffset]) + 1,
+                                 size / kBlockSize);
+  for (size_t b = 1; b < blocks; b++) {
+    const uint8_t *ext = edid + b * kBlockSize;
+    /* Data blocks end where the detailed timing descriptors start */
+    const size_t dtd_offset = ext[2];
+    if (ext[0] != kCtaExtensionTag || dtd_offset > kBlockSize)
+      continue;
+
+    size_t i = kDataBlocksOffset;
+    while (i < dtd_offset) {
+      const uint8_t tag = ext[i] >> 5U;
+      const size_t len = ext[i] & 0x1FU;
+      const uint8_t *payload = ext + i + 1;
+      i += len + 1;
+      if (i > dtd_offset || tag != kExtendedTag || len < 2)
+        continue;
+
+      if (payload[0] == kColorimetryTag) {
+        caps.bt2020_rgb = (payload[1] & kBt2020RgbBit) != 0;
+      } else if (payload[0] == kHdrStaticMetadataTag && len >= 3) {
+        has_hdr_block = true;
+        caps.st2084 = (payload[1] & kSt2084Bit) != 0;
+        caps.hlg = (payload[1] & kHlgBit) != 0;
+        /* Coded as 50 * 2^(CV / 32) nits, minimum relative to maximum */
+        constexpr float kLuminanceBase = 50.0F;
+        constexpr float kLuminanceStep = 32.0F;
+        constexpr float kMinLuminanceScale = 255.0F;
+        constexpr float kMinLuminanceDiv = 100.0F;
+        if (len >= 4)
+          caps.max_luminance = kLuminanceBase *
+                               std::exp2(float(payload[3]) / kLuminanceStep);
+        if (len >= 5)
+          caps.max_average_luminance = kLuminanceBase *
+                                       std::exp2(float(payload[4]) /
+                                                 kLuminanceStep);
+        if (len >= 6) {
+          const float cv = float(payload[5]) / kMinLuminanceScale;
+          caps.min_luminance = caps.max_luminance * cv * cv / kMinLuminanceDiv;
+        }
+      }
+    }
+  }
+  // NOLINTEND(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+
+  if (!has_hdr_block || (!caps.st2084 && !caps.hlg))
+    return {};
+
+  return caps;
+}
+
+void DrmConnector::UpdateHdrCapabilities() {
+  hdr_caps_.reset();
+  if (!hdr_output_metadata_property_)
+    return;
+
+  auto blob = GetEdidBlob();
+  if (!blob || blob->data == nullptr)
+    return;
+
+  hdr_caps_ = ParseEdidHdrCapabilities(static_cast<const uint8_t *>(
+                                           blob->data),
+                                       blob->length);
+  if (hdr_caps_) {
+    ALOGI("Connector %s: HDR%s%s, %.0f/%.0f/%.4f nits", GetName().c_str(),
+          hdr_caps_->st2084 ? " PQ" : "", hdr_caps_->hlg ? " HLG" : "",
+          hdr_caps_->max_luminance, hdr_caps_->max_average_luminance,
+          hdr_caps_->min_luminance);
+  }
+}
+
+auto DrmConnector::AtomicSetColorspace(drmModeAtomicReq &pset,
+                                       BufferColorSpace color_space) const
+    -> bool {
+  auto it = colorspace_enum_map_.find(color_space);
+  if (it == colorspace_enum_map_.end())
+    return true;
+
+  return colorspace_property_.AtomicSet(pset, it->second);
+}
+
 bool DrmConnector::IsInternal() const {
   auto type = connector_->connector_type;
   return type == DRM_MODE_CONNECTOR_LVDS || type == DRM_MODE_CONNECTOR_eDP ||
@@ -179,6 +337,9 @@ int DrmConnector::UpdateModes() {
   }
   connector_ = std::move(conn);
 
+  UpdateTile();
+  UpdateHdrCapabilities();
+
   modes_.clear();
   for (int i = 0; i < connector_->count_modes; ++i) {
     bool exists = false;
@@ -19,6 +19,8 @@
 #include <xf86drmMode.h>
 
 #include <cstdint>
+#include <map>
+#include <optional>
 #include <string>
 #include <vector>
 
@@ -26,6 +28,7 @@
 #include "DrmMode.h"
 #include "DrmProperty.h"
 #include "DrmUnique.h"
+#include "bufferinfo/BufferInfo.h"
 
 namespace android {
 
@@ -33,6 +36,37 @@ class DrmDevice;
 
 class DrmConnector : public PipelineBindable<DrmConnector> {
  public:
+  /* Contents of the TILE property, see drm_connector_set_tile_property() */
+  struct Tile {
+    uint32_t group_id;
+    uint32_t flags;
+    uint32_t num_h_tile;
+    uint32_t num_v_tile;
+    uint32_t h_loc;
+    uint32_t v_loc;
+    uint32_t h_size;
+    uint32_t v_size;
+
+    auto IsLeading() const {
+      return h_loc == 0 && v_loc == 0;
+    }
+
+    auto GetTilesCount() const {
+      return num_h_tile * num_v_tile;
+    }
+  };
+
+  /* HDR support of the sink, from the CTA-861 extension of the EDID */
+  struct HdrCapabilities {
+    bool st2084{};
+    bool hlg{};
+    bool bt2020_rgb{};
+    /* Desired content luminance in nits, 0 if not given by the sink */
+    float max_luminance{};
+    float max_average_luminance{};
+    float min_luminance{};
+  };
+
   static auto CreateInstance(DrmDevice &dev, uint32_t connector_id,
                              uint32_t index) -> std::unique_ptr<DrmConnector>;
 
@@ -106,6 +140,26 @@ class DrmConnector : public PipelineBindable<DrmConnector> {
     return connector_->mmHeight;
   };
 
+  /* Set when the connector drives a single tile of a larger display */
+  auto &GetTile() const {
+    return tile_;
+  }
+
+  /* Set if both the sink and the connector support HDR output */
+  auto &GetHdrCapabilities() const {
+    return hdr_caps_;
+  }
+
+  auto &GetHdrOutputMetadataProperty() const {
+    return hdr_output_metadata_property_;
+  }
+
+  /* Signals BT.2020 or the default colorimetry to the sink. No-op if the
+   * connector has no Colorspace property.
+   */
+  auto AtomicSetColorspace(drmModeAtomicReq &pset,
+                           BufferColorSpace color_space) const -> bool;
+
  private:
   DrmConnector(DrmModeConnectorUnique connector, DrmDevice *drm, uint32_t index)
       : connector_(std::move(connector)),
@@ -119,11 +173,20 @@ class DrmConnector : public PipelineBindable<DrmConnector> {
 
   std::vector<DrmMode> modes_;
 
+  void UpdateTile();
+  std::optional<Tile> tile_;
+
+  void UpdateHdrCapabilities();
+  std::optional<HdrCapabilities> hdr_caps_;
+
   DrmProperty dpms_property_;
   DrmProperty crtc_id_property_;
   DrmProperty edid_property_;
   DrmProperty writeback_pixel_formats_;
   DrmProperty writeback_fb_id_;
   DrmProperty writeback_out_fence_;
+  DrmProperty hdr_output_metadata_property_;
+  DrmProperty colorspace_property_;
+  std::map<BufferColorSpace, uint64_t> colorspace_enum_map_;
 };
 }  // namespace android
@@ -66,7 +66,29 @@ auto DrmCrtc::CreateInstance(DrmDevice &dev, uint32_t crtc_id, uint32_t index)
     ALOGV("Missing optional CTM property");
   }
 
+  ret = GetCrtcProperty(dev, *c, "SCALING_FILTER",
+                        &c->scaling_filter_property_);
+  if (ret == 0) {
+    c->scaling_filter_property_.AddEnumToMap("Default",
+                                             ScalingFilter::kDefault,
+                                             c->scaling_filter_enum_map_);
+    c->scaling_filter_property_.AddEnumToMap("Nearest Neighbor",
+                                             ScalingFilter::kNearestNeighbor,
+                                             c->scaling_filter_enum_map_);
+  } else {
+    ALOGV("Missing optional SCALING_FILTER property");
+  }
+
   return c;
 }
 
+auto DrmCrtc::AtomicSetScalingFilter(drmModeAtomicReq &pset,
+                                     ScalingFilter filter) const -> bool {
+  auto it = scaling_filter_enum_map_.find(filter);
+  if (it == scaling_filter_enum_map_.end())
+    return true;
+
+  return scaling_filter_property_.AtomicSet(pset, it->second);
+}
+
 }  // namespace android
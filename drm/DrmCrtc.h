@@ -62,6 +62,10 @@ class DrmCrtc : public PipelineBindable<DrmCrtc> {
     return ctm_property_;
   }
 
+  /* No-op if the CRTC can't select the |filter| of its own scaler */
+  auto AtomicSetScalingFilter(drmModeAtomicReq &pset,
+                              ScalingFilter filter) const -> bool;
+
  private:
   DrmCrtc(DrmModeCrtcUnique crtc, uint32_t index)
       : crtc_(std::move(crtc)), index_in_res_array_(index){};
@@ -71,6 +75,8 @@ class DrmCrtc : public PipelineBindable<DrmCrtc> {
   const uint32_t index_in_res_array_;
 
   DrmProperty ctm_property_;
+  DrmProperty scaling_filter_property_;
+  std::map<ScalingFilter, uint64_t> scaling_filter_enum_map_;
 
   DrmProperty active_property_;
   DrmProperty mode_property_;
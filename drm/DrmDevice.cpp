@@ -21,8 +21,11 @@
 #include <xf86drm.h>
 #include <xf86drmMode.h>
 
+#include <algorithm>
+#include <array>
 #include <cinttypes>
 #include <cstdint>
+#include <cstring>
 #include <string>
 
 #include "drm/DrmAtomicStateManager.h"
@@ -31,6 +34,11 @@
 #include "utils/log.h"
 #include "utils/properties.h"
 
+#ifndef DRM_CLIENT_CAP_PLANE_COLOR_PIPELINE
+// NOLINTNEXTLINE(cppcoreguidelines-macro-usage)
+#define DRM_CLIENT_CAP_PLANE_COLOR_PIPELINE 7
+#endif
+
 namespace android {
 
 auto DrmDevice::CreateInstance(std::string const &path,
@@ -53,6 +61,12 @@ DrmDevice::DrmDevice(ResourceManager *res_man) : res_man_(res_man) {
   drm_fb_importer_ = std::make_unique<DrmFbImporter>(*this);
 }
 
+DrmDevice::~DrmDevice() {
+  /* HandleEvents() may be running on the reactor thread at the moment */
+  if (fd_ && res_man_->GetVSyncReactor())
+    res_man_->GetVSyncReactor()->RemoveFdSync(*fd_);
+}
+
 auto DrmDevice::Init(const char *path) -> int {
   /* TODO: Use drmOpenControl here instead */
   fd_ = MakeSharedFd(open(path, O_RDWR | O_CLOEXEC));
@@ -81,6 +95,12 @@ auto DrmDevice::Init(const char *path) -> int {
   }
 #endif
 
+  /* Exposes the COLOR_PIPELINE property of planes */
+  ret = drmSetClientCap(*GetFd(), DRM_CLIENT_CAP_PLANE_COLOR_PIPELINE, 1);
+  if (ret != 0) {
+    ALOGI("Failed to set plane color pipeline cap %d", ret);
+  }
+
   uint64_t cap_value = 0;
   if (drmGetCap(*GetFd(), DRM_CAP_ADDFB2_MODIFIERS, &cap_value) != 0) {
     ALOGW("drmGetCap failed. Fallback to no modifier support.");
@@ -151,9 +171,100 @@ auto DrmDevice::Init(const char *path) -> int {
     }
   }
 
+  auto &reactor = res_man_->GetVSyncReactor();
+  if (!reactor) {
+    ALOGE("No reactor to serve DRM events");
+    return -ENODEV;
+  }
+
+  ret = reactor->AddFd(*GetFd(), [this]() { HandleEvents(); });
+  if (ret != 0) {
+    ALOGE("Failed to register DRM fd for events %d", ret);
+    return ret;
+  }
+
   return 0;
 }
 
+auto DrmDevice::SetVBlankHandler(uint32_t crtc_id, VBlankHandler handler)
+    -> HandlerToken {
+  const std::lock_guard<std::mutex> lock(event_handlers_mutex_);
+  auto token = ++last_handler_token_;
+  vblank_handlers_[crtc_id] = {.token = token, .handler = std::move(handler)};
+  return token;
+}
+
+void DrmDevice::ResetVBlankHandler(uint32_t crtc_id, HandlerToken token) {
+  const std::lock_guard<std::mutex> lock(event_handlers_mutex_);
+  auto it = vblank_handlers_.find(crtc_id);
+  if (it != vblank_handlers_.end() && it->second.token == token)
+    vblank_handlers_.erase(it);
+}
+
+auto DrmDevice::SetFlipHandler(uint32_t crtc_id, VBlankHandler handler)
+    -> HandlerToken {
+  const std::lock_guard<std::mutex> lock(event_handlers_mutex_);
+  auto token = ++last_handler_token_;
+  flip_handlers_[crtc_id] = {.token = token, .handler = std::move(handler)};
+  return token;
+}
+
+void DrmDevice::ResetFlipHandler(uint32_t crtc_id, HandlerToken token) {
+  const std::lock_guard<std::mutex> lock(event_handlers_mutex_);
+  auto it = flip_handlers_.find(crtc_id);
+  if (it != flip_handlers_.end() && it->second.token == token)
+    flip_handlers_.erase(it);
+}
+
+/* Called on the vsync reactor thread once DRM fd becomes readable */
+void DrmDevice::HandleEvents() {
+  constexpr size_t kEventBufferSize = 1024;
+  std::array<char, kEventBufferSize> buffer{};
+  auto len = read(*GetFd(), buffer.data(), buffer.size());
+  if (len <= 0)
+    return;
+
+  size_t offset = 0;
+  while (offset + sizeof(struct drm_event) <= size_t(len)) {
+    struct drm_event event {};
+    memcpy(&event, &buffer[offset], sizeof(event));
+    if (event.length < sizeof(event) || offset + event.length > size_t(len))
+      break;
+
+    auto vblank_event = event.type == DRM_EVENT_VBLANK ||
+                        event.type == DRM_EVENT_FLIP_COMPLETE;
+    if (vblank_event && event.length >= sizeof(struct drm_event_vblank)) {
+      struct drm_event_vblank vblank {};
+      memcpy(&vblank, &buffer[offset], sizeof(vblank));
+
+      /* crtc_id is reported by kernels 4.12+, fallback to the id passed as
+       * request signal by the vblank requester
+       */
+      auto crtc_id = vblank.crtc_id != 0 ? vblank.crtc_id
+                                         : uint32_t(vblank.user_data);
+      constexpr int64_t kOneSecondNs = 1000LL * 1000 * 1000;
+      constexpr int64_t kUsToNsMul = 1000;
+      auto timestamp = int64_t(vblank.tv_sec) * kOneSecondNs +
+                       int64_t(vblank.tv_usec) * kUsToNsMul;
+
+      VBlankHandler handler;
+      {
+        const std::lock_guard<std::mutex> lock(event_handlers_mutex_);
+        auto &handlers = event.type == DRM_EVENT_VBLANK ? vblank_handlers_
+                                                        : flip_handlers_;
+        auto it = handlers.find(crtc_id);
+        if (it != handlers.end())
+          handler = it->second.handler;
+      }
+
+      if (handler)
+        handler(vblank.sequence, timestamp);
+    }
+
+    offset += event.length;
+  }
+}
+
 auto DrmDevice::RegisterUserPropertyBlob(void *data, size_t length) const
     -> DrmModeUserPropertyBlobUnique {
   struct drm_mode_create_blob create_blob {};
@@ -255,4 +366,34 @@ auto DrmDevice::GetEncoders()
   return encoders_;
 }
 
+auto DrmDevice::GetConnectedTileGroup(uint32_t group_id) const
+    -> std::vector<DrmConnector *> {
+  std::vector<DrmConnector *> group;
+  uint32_t tiles_count = 0;
+
+  for (const auto &conn : connectors_) {
+    auto &tile = conn->GetTile();
+    if (tile && tile->group_id == group_id && conn->IsConnected()) {
+      tiles_count = tile->GetTilesCount();
+      group.emplace_back(conn.get());
+    }
+  }
+
+  if (group.empty() || group.size() != tiles_count) {
+    return {};
+  }
+
+  std::sort(group.begin(), group.end(), [](auto *a, auto *b) {
+    auto &ta = *a->GetTile();
+    auto &tb = *b->GetTile();
+    return ta.v_loc != tb.v_loc ? ta.v_loc < tb.v_loc : ta.h_loc < tb.h_loc;
+  });
+
+  if (!group.front()->GetTile()->IsLeading()) {
+    return {};
+  }
+
+  return group;
+}
+
 }  // namespace android
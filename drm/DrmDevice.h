@@ -17,7 +17,9 @@
 #pragma once
 
 #include <cstdint>
+#include <functional>
 #include <map>
+#include <mutex>
 #include <tuple>
 
 #include "DrmConnector.h"
@@ -33,7 +35,7 @@ class ResourceManager;
 
 class DrmDevice {
  public:
-  ~DrmDevice() = default;
+  ~DrmDevice();
 
   static auto CreateInstance(std::string const &path, ResourceManager *res_man)
       -> std::unique_ptr<DrmDevice>;
@@ -51,6 +53,12 @@ class DrmDevice {
   auto GetCrtcs() -> const std::vector<std::unique_ptr<DrmCrtc>> &;
   auto GetEncoders() -> const std::vector<std::unique_ptr<DrmEncoder>> &;
 
+  /* Returns connected connectors of the tile group, leading tile first.
+   * Empty if some tiles of the group aren't connected yet.
+   */
+  auto GetConnectedTileGroup(uint32_t group_id) const
+      -> std::vector<DrmConnector *>;
+
   auto GetMinResolution() const {
     return min_resolution_;
   }
@@ -72,6 +80,18 @@ class DrmDevice {
     return *drm_fb_importer_;
   }
 
+  /* Only the pipelines of the first probe find the CRTCs as the firmware has
+   * left them. Later ones find a state of this session, which is stale once
+   * the display was unplugged.
+   */
+  auto IsFirmwareStateAdoptable() const {
+    return firmware_state_adoptable_;
+  }
+
+  void EndFirmwareStateAdoption() {
+    firmware_state_adoptable_ = false;
+  }
+
   auto FindCrtcById(uint32_t id) const -> DrmCrtc * {
     for (const auto &crtc : crtcs_) {
       if (crtc->GetId() == id) {
@@ -95,12 +115,31 @@ class DrmDevice {
   int GetProperty(uint32_t obj_id, uint32_t obj_type, const char *prop_name,
                   DrmProperty *property) const;
 
+  /* DRM events are read and dispatched on the vsync reactor thread.
+   * Requesters of vblank and flip events should pass crtc id as the request
+   * user data.
+   */
+  using VBlankHandler =
+      std::function<void(uint32_t /*sequence*/, int64_t /*timestamp_ns*/)>;
+  /* A new handler replaces the one of the CRTC. The returned token removes
+   * the handler only while it is still the registered one, so a pipeline
+   * going away doesn't remove the handler of its replacement.
+   */
+  using HandlerToken = uint64_t;
+  auto SetVBlankHandler(uint32_t crtc_id, VBlankHandler handler)
+      -> HandlerToken;
+  void ResetVBlankHandler(uint32_t crtc_id, HandlerToken token);
+  auto SetFlipHandler(uint32_t crtc_id, VBlankHandler handler) -> HandlerToken;
+  void ResetFlipHandler(uint32_t crtc_id, HandlerToken token);
+
  private:
   explicit DrmDevice(ResourceManager *res_man);
   auto Init(const char *path) -> int;
 
   static auto IsKMSDev(const char *path) -> bool;
 
+  void HandleEvents();
+
   SharedFd fd_;
 
   std::vector<std::unique_ptr<DrmConnector>> connectors_;
@@ -113,9 +152,19 @@ class DrmDevice {
   std::pair<uint32_t, uint32_t> max_resolution_;
 
   bool HasAddFb2ModifiersSupport_{};
+  bool firmware_state_adoptable_ = true;
 
   std::unique_ptr<DrmFbImporter> drm_fb_importer_;
 
+  struct EventHandler {
+    HandlerToken token{};
+    VBlankHandler handler;
+  };
+  std::map<uint32_t /*crtc_id*/, EventHandler> vblank_handlers_;
+  std::map<uint32_t /*crtc_id*/, EventHandler> flip_handlers_;
+  HandlerToken last_handler_token_{};
+  std::mutex event_handlers_mutex_;
+
   ResourceManager *const res_man_;
 };
 }  // namespace android
@@ -18,6 +18,8 @@
 
 #include "DrmDisplayPipeline.h"
 
+#include <algorithm>
+
 #include "DrmAtomicStateManager.h"
 #include "DrmConnector.h"
 #include "DrmCrtc.h"
@@ -98,9 +100,6 @@ static auto TryCreatePipeline(DrmDevice &dev, DrmConnector &connector,
     return {};
   }
 
-  pipe->atomic_state_manager = DrmAtomicStateManager::CreateInstance(
-      pipe.get());
-
   return pipe;
 }
 
@@ -130,7 +129,7 @@ static auto TryCreatePipelineUsingEncoder(DrmDevice &dev, DrmConnector &conn,
   return {};
 }
 
-auto DrmDisplayPipeline::CreatePipeline(DrmConnector &connector)
+static auto CreateConnectorPipeline(DrmConnector &connector)
     -> std::unique_ptr<DrmDisplayPipeline> {
   auto &dev = connector.GetDev();
   /* Try to use current setup first */
@@ -158,6 +157,58 @@ auto DrmDisplayPipeline::CreatePipeline(DrmConnector &connector)
   return {};
 }
 
+static void AttachSecondaryTiles(DrmDisplayPipeline &pipe) {
+  auto &connector = *pipe.connector->Get();
+  auto &tile = connector.GetTile();
+  if (!tile || !tile->IsLeading()) {
+    return;
+  }
+
+  auto group = pipe.device->GetConnectedTileGroup(tile->group_id);
+  if (group.empty()) {
+    ALOGW("Tile group %u of connector %s is incomplete, using single tile",
+          tile->group_id, connector.GetName().c_str());
+    return;
+  }
+
+  for (auto *tile_conn : group) {
+    if (tile_conn == &connector) {
+      continue;
+    }
+
+    auto tile_pipe = CreateConnectorPipeline(*tile_conn);
+    if (!tile_pipe) {
+      ALOGE("Failed to create pipeline for tile %s, using single tile",
+            tile_conn->GetName().c_str());
+      pipe.tiles.clear();
+      return;
+    }
+
+    pipe.tiles.emplace_back(std::move(tile_pipe));
+  }
+
+  ALOGI("Connector %s drives tiled display (%ux%u tiles)",
+        connector.GetName().c_str(), tile->num_h_tile, tile->num_v_tile);
+}
+
+auto DrmDisplayPipeline::CreatePipeline(DrmConnector &connector)
+    -> std::unique_ptr<DrmDisplayPipeline> {
+  auto pipe = CreateConnectorPipeline(connector);
+  if (!pipe) {
+    return {};
+  }
+
+  AttachSecondaryTiles(*pipe);
+
+  pipe->atomic_state_manager = DrmAtomicStateManager::CreateInstance(
+      pipe.get());
+  if (!pipe->atomic_state_manager) {
+    return {};
+  }
+
+  return pipe;
+}
+
 static bool ReadUseOverlayProperty() {
   char use_overlay_planes_prop[PROPERTY_VALUE_MAX];
   property_get("vendor.hwc.drm.use_overlay_planes", use_overlay_planes_prop,
@@ -189,9 +240,59 @@ auto DrmDisplayPipeline::GetUsablePlanes()
   return planes;
 }
 
+auto DrmDisplayPipeline::GetLitPlanes()
+    -> std::vector<std::shared_ptr<BindingOwner<DrmPlane>>> {
+  std::vector<std::shared_ptr<BindingOwner<DrmPlane>>> planes;
+  for (const auto &plane : device->GetPlanes()) {
+    DrmProperty crtc_id;
+    if (device->GetProperty(plane->GetId(), DRM_MODE_OBJECT_PLANE, "CRTC_ID",
+                            &crtc_id) != 0 ||
+        crtc_id.GetValue().value_or(0) != crtc->Get()->GetId())
+      continue;
+
+    auto owner = plane->BindPipeline(this, true);
+    if (owner)
+      planes.emplace_back(owner);
+  }
+
+  return planes;
+}
+
+void DrmDisplayPipeline::ProbePlaneScaling(uint32_t mode_width,
+                                           uint32_t mode_height) {
+  auto planes = GetUsablePlanes();
+  std::vector<DrmPlane *> siblings;
+  for (auto &plane : planes)
+    siblings.emplace_back(plane->Get());
+
+  if (std::all_of(siblings.begin(), siblings.end(), [](DrmPlane *plane) {
+        return plane->GetScalingCaps().probed;
+      }))
+    return;
+
+  auto primary_fb = primary_plane->Get()->CreateProbeFb(mode_width,
+                                                        mode_height);
+  for (auto *plane : siblings) {
+    if (!plane->GetScalingCaps().probed)
+      plane->ProbeScaling(*crtc->Get(), mode_width, mode_height, siblings,
+                          primary_fb.get());
+  }
+}
+
+auto DrmDisplayPipeline::GetTilePipelines()
+    -> std::vector<DrmDisplayPipeline *> {
+  std::vector<DrmDisplayPipeline *> pipelines;
+  pipelines.emplace_back(this);
+  for (auto &tile : tiles) {
+    pipelines.emplace_back(tile.get());
+  }
+
+  return pipelines;
+}
+
 DrmDisplayPipeline::~DrmDisplayPipeline() {
   if (atomic_state_manager)
-    atomic_state_manager->StopThread();
+    atomic_state_manager->Stop();
 }
 
 }  // namespace android
@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <cstdint>
 #include <memory>
 #include <vector>
 
@@ -74,6 +75,20 @@ struct DrmDisplayPipeline {
   auto GetUsablePlanes()
       -> std::vector<std::shared_ptr<BindingOwner<DrmPlane>>>;
 
+  /* Planes scanning out on the CRTC, as left by the firmware. Cursor planes
+   * included.
+   */
+  auto GetLitPlanes() -> std::vector<std::shared_ptr<BindingOwner<DrmPlane>>>;
+
+  /* Finds the scaling limits of the usable planes, one by one with the rest
+   * of them disabled, except for the primary plane showing a full-screen
+   * buffer. Needs the CRTC to be active in |mode_width|x|mode_height| mode.
+   */
+  void ProbePlaneScaling(uint32_t mode_width, uint32_t mode_height);
+
+  /* Returns this pipeline followed by the secondary tiles */
+  auto GetTilePipelines() -> std::vector<DrmDisplayPipeline *>;
+
   ~DrmDisplayPipeline();
 
   DrmDevice *device;
@@ -84,6 +99,13 @@ struct DrmDisplayPipeline {
   std::shared_ptr<BindingOwner<DrmPlane>> primary_plane;
 
   std::shared_ptr<DrmAtomicStateManager> atomic_state_manager;
+
+  /* Tiled displays (e.g. 8K monitors driven over 2 links) expose a connector
+   * per tile. The leading tile owns the pipeline, the rest of the tiles are
+   * kept here. Each one uses its own CRTC and planes, but has no state manager
+   * since the whole display is committed at once by the leading tile.
+   */
+  std::vector<std::unique_ptr<DrmDisplayPipeline>> tiles;
 };
 
 }  // namespace android
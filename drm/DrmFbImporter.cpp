@@ -26,6 +26,7 @@
 #include <xf86drm.h>
 #include <xf86drmMode.h>
 
+#include <array>
 #include <cinttypes>
 #include <system_error>
 
@@ -85,18 +86,33 @@ auto DrmFbIdHandle::CreateFb(uint32_t fourcc, uint32_t *out_fb_id) -> int {
   bool has_modifiers = bo_.modifiers[0] != DRM_FORMAT_MOD_NONE &&
                        bo_.modifiers[0] != DRM_FORMAT_MOD_INVALID;
 
+  /* The kernel rejects pitches and offsets of the planes the buffer does not
+   * have. The getter's planes end at the first one without a GEM handle;
+   * modifiers may add auxiliary planes the format itself does not have.
+   * Modifier must be the same for every plane.
+   */
+  std::array<GemHandle, kBufferMaxPlanes> handles{};
+  std::array<uint32_t, kBufferMaxPlanes> pitches{};
+  std::array<uint32_t, kBufferMaxPlanes> offsets{};
+  std::array<uint64_t, kBufferMaxPlanes> modifiers{};
+  for (size_t i = 0; i < handles.size() && gem_handles_[i] != 0; i++) {
+    handles[i] = gem_handles_[i];
+    pitches[i] = bo_.pitches[i];
+    offsets[i] = bo_.offsets[i];
+    modifiers[i] = bo_.modifiers[0];
+  }
+
   /* Create framebuffer object */
   if (!has_modifiers) {
     return drmModeAddFB2(*drm_->GetFd(), bo_.width, bo_.height, fourcc,
-                         gem_handles_.data(), &bo_.pitches[0], &bo_.offsets[0],
+                         handles.data(), pitches.data(), offsets.data(),
                          out_fb_id, 0);
   }
 
   return drmModeAddFB2WithModifiers(*drm_->GetFd(), bo_.width, bo_.height,
-                                    fourcc, gem_handles_.data(),
-                                    &bo_.pitches[0], &bo_.offsets[0],
-                                    &bo_.modifiers[0], out_fb_id,
-                                    DRM_MODE_FB_MODIFIERS);
+                                    fourcc, handles.data(), pitches.data(),
+                                    offsets.data(), modifiers.data(),
+                                    out_fb_id, DRM_MODE_FB_MODIFIERS);
 }
 
 DrmFbIdHandle::~DrmFbIdHandle() {
@@ -28,6 +28,10 @@ bool DrmMode::operator==(const drmModeModeInfo &m) const {
   return memcmp(&m, &mode_, offsetof(drmModeModeInfo, name)) == 0;
 }
 
+auto DrmMode::HasSameTimings(const DrmMode &m) const -> bool {
+  return memcmp(&m.mode_, &mode_, offsetof(drmModeModeInfo, type)) == 0;
+}
+
 auto DrmMode::CreateModeBlob(const DrmDevice &drm)
     -> DrmModeUserPropertyBlobUnique {
   struct drm_mode_modeinfo drm_mode = {};
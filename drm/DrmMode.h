@@ -35,6 +35,9 @@ class DrmMode {
 
   bool operator==(const drmModeModeInfo &m) const;
 
+  /* Same signal, regardless of the type and name of the modes */
+  auto HasSameTimings(const DrmMode &m) const -> bool;
+
   auto &GetRawMode() const {
     return mode_;
   }
@@ -18,12 +18,17 @@
 
 #include "DrmPlane.h"
 
+#include <xf86drm.h>
+
 #include <algorithm>
+#include <array>
 #include <cerrno>
 #include <cinttypes>
+#include <cmath>
 #include <cstdint>
 
 #include "DrmDevice.h"
+#include "ResourceManager.h"
 #include "bufferinfo/BufferInfoGetter.h"
 #include "utils/log.h"
 
@@ -117,6 +122,15 @@ int DrmPlane::Init() {
 
   GetPlaneProperty("IN_FENCE_FD", in_fence_fd_property_, Presence::kOptional);
 
+  if (GetPlaneProperty("SCALING_FILTER", scaling_filter_property_,
+                       Presence::kOptional)) {
+    scaling_filter_property_.AddEnumToMap("Default", ScalingFilter::kDefault,
+                                          scaling_filter_enum_map_);
+    scaling_filter_property_.AddEnumToMap("Nearest Neighbor",
+                                          ScalingFilter::kNearestNeighbor,
+                                          scaling_filter_enum_map_);
+  }
+
   if (HasNonRgbFormat()) {
     if (GetPlaneProperty("COLOR_ENCODING", color_encoding_propery_,
                          Presence::kOptional)) {
@@ -142,6 +156,18 @@ int DrmPlane::Init() {
     }
   }
 
+  if (GetPlaneProperty("COLOR_PIPELINE", color_pipeline_property_,
+                       Presence::kOptional)) {
+    for (auto id : color_pipeline_property_.GetEnumValues()) {
+      /* 0 is "Bypass" */
+      auto pipeline = id != 0 ? DrmColorPipeline::CreateInstance(*drm_,
+                                                                 uint32_t(id))
+                              : nullptr;
+      if (pipeline)
+        color_pipelines_.emplace_back(std::move(pipeline));
+    }
+  }
+
   /* Feature: docs/features/drmhwc-feature-001.md */
   AddToFormatResolutionTable(DRM_FORMAT_ABGR8888, DRM_FORMAT_XBGR8888);
   AddToFormatResolutionTable(DRM_FORMAT_ARGB8888, DRM_FORMAT_XRGB8888);
@@ -195,15 +221,18 @@ bool DrmPlane::IsValidForLayer(LayerData *layer, bool most_bottom) {
     return false;
   }
 
-  if (blending_enum_map_.count(layer->bi->blend_mode) == 0 && !most_bottom) {
+  /* Nothing to blend with: the bottom layer and the opaque ones */
+  auto relaxed = most_bottom || layer->IsOpaque();
+
+  if (blending_enum_map_.count(layer->bi->blend_mode) == 0 && !relaxed) {
     ALOGV("Blending is not supported on plane %d", GetId());
     return false;
   }
 
   /* Feature: docs/features/drmhwc-feature-001.md */
   auto format = layer->bi->format;
-  if (most_bottom && BottomLayerFormatResolutionTable_.count(format) != 0) {
-    format = BottomLayerFormatResolutionTable_[format];
+  if (relaxed && FormatResolutionTable_.count(format) != 0) {
+    format = FormatResolutionTable_[format];
   }
 
   if (!IsFormatSupported(format)) {
@@ -212,6 +241,85 @@ bool DrmPlane::IsValidForLayer(LayerData *layer, bool most_bottom) {
     return false;
   }
 
+  /* BT.2020 video decoded with the default matrix has visibly wrong colors,
+   * the GPU converts it properly
+   */
+  if (BufferInfoGetter::IsDrmFormatYuv(format) &&
+      layer->bi->color_space == BufferColorSpace::kItuRec2020 &&
+      color_encoding_enum_map_.count(BufferColorSpace::kItuRec2020) == 0) {
+    ALOGV("Plane %d has no BT.2020 YCbCr encoding", GetId());
+    return false;
+  }
+
+  if (!IsScalingSupported(layer->pi)) {
+    ALOGV("Scaling is out of the limits of plane %d", GetId());
+    return false;
+  }
+
+  if (!IsTransferSupported(layer->bi->transfer, layer->pi.output_transfer)) {
+    ALOGV("Plane %d can't convert the layer to the output encoding", GetId());
+    return false;
+  }
+
+  return true;
+}
+
+/* Content of unknown transfer is treated as SDR */
+static auto ToKnownTransfer(BufferTransfer transfer) -> BufferTransfer {
+  return transfer == BufferTransfer::kUndefined ? BufferTransfer::kSdr
+                                                : transfer;
+}
+
+auto DrmPlane::FindColorPipeline(BufferTransfer from, BufferTransfer to) const
+    -> const DrmColorPipeline * {
+  from = ToKnownTransfer(from);
+  to = ToKnownTransfer(to);
+  if (from == to)
+    return nullptr;
+
+  for (const auto &pipeline : color_pipelines_) {
+    if (pipeline->CanConvert(from, to))
+      return pipeline.get();
+  }
+
+  return nullptr;
+}
+
+bool DrmPlane::IsTransferSupported(BufferTransfer from,
+                                   BufferTransfer to) const {
+  /* HDR content on an SDR output needs a pipeline to tone map it */
+  return ToKnownTransfer(from) == ToKnownTransfer(to) ||
+         FindColorPipeline(from, to) != nullptr;
+}
+
+bool DrmPlane::IsScalingSupported(const PresentInfo &pi) const {
+  if (!scaling_caps_.probed)
+    return true;
+
+  const auto &src = pi.source_crop;
+  auto src_width = src.right - src.left;
+  auto src_height = src.bottom - src.top;
+  if ((pi.transform & (LayerTransform::kRotate90 |
+                       LayerTransform::kRotate270)) != 0)
+    std::swap(src_width, src_height);
+
+  if (src_width <= 0 || src_height <= 0)
+    return true;
+
+  const auto &df = pi.display_frame;
+  auto scale_x = float(df.right - df.left) / src_width;
+  auto scale_y = float(df.bottom - df.top) / src_height;
+
+  /* Ratios of the probe are exact, leave room for the float crops */
+  constexpr float kEpsilon = 1e-3F;
+  if (std::min(scale_x, scale_y) < scaling_caps_.min_scale - kEpsilon ||
+      std::max(scale_x, scale_y) > scaling_caps_.max_scale + kEpsilon)
+    return false;
+
+  if (!scaling_caps_.subpixel_src &&
+      (src.left != std::floor(src.left) || src.top != std::floor(src.top)))
+    return false;
+
   return true;
 }
 
@@ -224,7 +332,7 @@ bool DrmPlane::IsFormatSupported(uint32_t format) const {
 void DrmPlane::AddToFormatResolutionTable(uint32_t original_fourcc,
                                           uint32_t resolved_fourcc) {
   if (!IsFormatSupported(original_fourcc)) {
-    BottomLayerFormatResolutionTable_[original_fourcc] = resolved_fourcc;
+    FormatResolutionTable_[original_fourcc] = resolved_fourcc;
   }
 }
 
@@ -259,6 +367,26 @@ static int To1616FixPt(float in) {
   return int(in * (1 << kBitShift));
 }
 
+static auto SelectScalingFilter(ScalingFilterPolicy policy,
+                                const LayerData &layer) -> ScalingFilter {
+  /* Text of a client target rendered at a reduced UI size gets blocky */
+  if (layer.client_target)
+    return ScalingFilter::kDefault;
+
+  switch (policy) {
+    case ScalingFilterPolicy::kNearest:
+      return ScalingFilter::kNearestNeighbor;
+    case ScalingFilterPolicy::kIntegerNearest:
+      /* Low resolution rendering of games, video still wants smoothing */
+      return layer.pi.IsIntegerUpscale() &&
+                     BufferInfoGetter::IsDrmFormatRgb(layer.bi->format)
+                 ? ScalingFilter::kNearestNeighbor
+                 : ScalingFilter::kDefault;
+    default:
+      return ScalingFilter::kDefault;
+  }
+}
+
 auto DrmPlane::AtomicSetState(drmModeAtomicReq &pset, LayerData &layer,
                               uint32_t zpos, uint32_t crtc_id, bool most_bottom)
     -> int {
@@ -285,11 +413,13 @@ auto DrmPlane::AtomicSetState(drmModeAtomicReq &pset, LayerData &layer,
 
   uint32_t fb_id = layer.fb->GetFbId();
 
+  auto relaxed = most_bottom || layer.IsOpaque();
+
   /* Feature: docs/features/drmhwc-feature-001.md */
-  if (most_bottom &&
-      BottomLayerFormatResolutionTable_.count(layer.bi->format) != 0) {
+  if (relaxed &&
+      FormatResolutionTable_.count(layer.bi->format) != 0) {
     fb_id = layer.fb->GetFbIdForFormat(
-        BottomLayerFormatResolutionTable_[layer.bi->format]);
+        FormatResolutionTable_[layer.bi->format]);
   }
 
   auto &disp = layer.pi.display_frame;
@@ -316,9 +446,22 @@ auto DrmPlane::AtomicSetState(drmModeAtomicReq &pset, LayerData &layer,
     return -EINVAL;
   }
 
-  if (blending_enum_map_.count(layer.bi->blend_mode) != 0 &&
-      !blend_property_.AtomicSet(pset,
-                                 blending_enum_map_[layer.bi->blend_mode])) {
+  /* Opaque layers need no blending, save the destination read */
+  auto blend_mode = layer.bi->blend_mode;
+  if (layer.IsOpaque() &&
+      blending_enum_map_.count(BufferBlendMode::kNone) != 0)
+    blend_mode = BufferBlendMode::kNone;
+
+  if (blending_enum_map_.count(blend_mode) != 0 &&
+      !blend_property_.AtomicSet(pset, blending_enum_map_[blend_mode])) {
+    return -EINVAL;
+  }
+
+  auto filter = SelectScalingFilter(drm_->GetResMan().GetScalingFilterPolicy(),
+                                    layer);
+  if (scaling_filter_enum_map_.count(filter) != 0 &&
+      !scaling_filter_property_.AtomicSet(pset,
+                                          scaling_filter_enum_map_[filter])) {
     return -EINVAL;
   }
 
@@ -334,6 +477,187 @@ auto DrmPlane::AtomicSetState(drmModeAtomicReq &pset, LayerData &layer,
     return -EINVAL;
   }
 
+  if (color_pipeline_property_) {
+    const auto from = ToKnownTransfer(layer.bi->transfer);
+    const auto to = ToKnownTransfer(layer.pi.output_transfer);
+    const auto *pipeline = FindColorPipeline(from, to);
+    if (pipeline != nullptr && !pipeline->AtomicSetConversion(pset, from, to))
+      return -EINVAL;
+
+    /* 0 is "Bypass" */
+    if (!color_pipeline_property_
+             .AtomicSet(pset, pipeline != nullptr ? pipeline->GetId() : 0))
+      return -EINVAL;
+  }
+
+  return 0;
+}
+
+/* Probe formats, any of them will do */
+constexpr std::array<uint32_t, 4> kProbeFormats = {DRM_FORMAT_XRGB8888,
+                                                   DRM_FORMAT_ARGB8888,
+                                                   DRM_FORMAT_XBGR8888,
+                                                   DRM_FORMAT_ABGR8888};
+
+auto DrmProbeFb::CreateInstance(DrmDevice &dev, uint32_t width,
+                                uint32_t height, uint32_t format)
+    -> std::unique_ptr<DrmProbeFb> {
+  constexpr uint32_t kBitsPerPixel = 32;
+
+  auto fb = std::unique_ptr<DrmProbeFb>(new DrmProbeFb(dev));
+  auto fd = *dev.GetFd();
+  drm_mode_create_dumb create = {.height = height,
+                                 .width = width,
+                                 .bpp = kBitsPerPixel};
+  if (drmIoctl(fd, DRM_IOCTL_MODE_CREATE_DUMB, &create) != 0) {
+    ALOGE("Failed to create %ux%u probe buffer", width, height);
+    return {};
+  }
+  fb->handle_ = create.handle;
+  fb->width_ = width;
+  fb->height_ = height;
+
+  const std::array<uint32_t, 4> handles = {create.handle};
+  const std::array<uint32_t, 4> pitches = {create.pitch};
+  const std::array<uint32_t, 4> offsets = {};
+  if (drmModeAddFB2(fd, width, height, format, handles.data(), pitches.data(),
+                    offsets.data(), &fb->fb_id_, 0) != 0) {
+    ALOGE("Failed to add %ux%u probe framebuffer", width, height);
+    return {};
+  }
+
+  return fb;
+}
+
+DrmProbeFb::~DrmProbeFb() {
+  auto fd = *drm_->GetFd();
+  if (fb_id_ != 0)
+    drmModeRmFB(fd, fb_id_);
+
+  if (handle_ != 0) {
+    drm_mode_destroy_dumb destroy = {.handle = handle_};
+    drmIoctl(fd, DRM_IOCTL_MODE_DESTROY_DUMB, &destroy);
+  }
+}
+
+auto DrmPlane::CreateProbeFb(uint32_t width, uint32_t height) const
+    -> std::unique_ptr<DrmProbeFb> {
+  const auto *format = std::find_if(kProbeFormats.begin(), kProbeFormats.end(),
+                                    [this](uint32_t f) {
+                                      return IsFormatSupported(f);
+                                    });
+  if (format == kProbeFormats.end())
+    return {};
+
+  return DrmProbeFb::CreateInstance(*drm_, width, height, *format);
+}
+
+auto DrmPlane::AtomicSetProbeState(drmModeAtomicReq &pset, const DrmCrtc &crtc,
+                                   uint32_t fb_id, const hwc_frect_t &src,
+                                   uint32_t dst_width,
+                                   uint32_t dst_height) const -> bool {
+  return crtc_property_.AtomicSet(pset, crtc.GetId()) &&
+         fb_property_.AtomicSet(pset, fb_id) &&
+         crtc_x_property_.AtomicSet(pset, 0) &&
+         crtc_y_property_.AtomicSet(pset, 0) &&
+         crtc_w_property_.AtomicSet(pset, dst_width) &&
+         crtc_h_property_.AtomicSet(pset, dst_height) &&
+         src_x_property_.AtomicSet(pset, To1616FixPt(src.left)) &&
+         src_y_property_.AtomicSet(pset, To1616FixPt(src.top)) &&
+         src_w_property_.AtomicSet(pset, To1616FixPt(src.right - src.left)) &&
+         src_h_property_.AtomicSet(pset, To1616FixPt(src.bottom - src.top));
+}
+
+auto DrmPlane::TestScaling(const DrmCrtc &crtc, uint32_t fb_id,
+                           const hwc_frect_t &src, uint32_t dst_width,
+                           uint32_t dst_height,
+                           const std::vector<DrmPlane *> &siblings,
+                           const DrmProbeFb *primary_fb) -> bool {
+  auto pset = MakeDrmModeAtomicReqUnique();
+  if (!pset)
+    return false;
+
+  for (auto *sibling : siblings) {
+    if (sibling == this)
+      continue;
+
+    if (primary_fb != nullptr && sibling->GetType() == DRM_PLANE_TYPE_PRIMARY) {
+      const hwc_frect_t full = {0.0F, 0.0F, float(primary_fb->GetWidth()),
+                                float(primary_fb->GetHeight())};
+      if (!sibling->AtomicSetProbeState(*pset, crtc, primary_fb->GetId(), full,
+                                        primary_fb->GetWidth(),
+                                        primary_fb->GetHeight()))
+        return false;
+      continue;
+    }
+
+    if (sibling->AtomicDisablePlane(*pset) != 0)
+      return false;
+  }
+
+  if (!AtomicSetProbeState(*pset, crtc, fb_id, src, dst_width, dst_height))
+    return false;
+
+  return drmModeAtomicCommit(*drm_->GetFd(), pset.get(),
+                             DRM_MODE_ATOMIC_TEST_ONLY, nullptr) == 0;
+}
+
+auto DrmPlane::ProbeScaling(const DrmCrtc &crtc, uint32_t mode_width,
+                            uint32_t mode_height,
+                            const std::vector<DrmPlane *> &siblings,
+                            const DrmProbeFb *primary_fb) -> int {
+  if (scaling_caps_.probed)
+    return 0;
+
+  /* Sources up to 4x of the destination for downscaling */
+  constexpr uint32_t kProbeFbSize = 256;
+  constexpr uint32_t kProbeDstSize = 64;
+
+  auto fb = CreateProbeFb(kProbeFbSize, kProbeFbSize);
+  if (!fb)
+    return -ENOTSUP;
+
+  auto test = [&](float scale, float src_pos) {
+    auto src_size = kProbeDstSize;
+    auto dst_size = kProbeDstSize;
+    if (scale < 1.0F)
+      src_size = uint32_t(std::lround(float(kProbeDstSize) / scale));
+    else
+      dst_size = uint32_t(std::lround(float(kProbeDstSize) * scale));
+
+    if (dst_size > mode_width || dst_size > mode_height)
+      return false;
+
+    const hwc_frect_t src = {src_pos, src_pos, src_pos + float(src_size),
+                             src_pos + float(src_size)};
+    return TestScaling(crtc, fb->GetId(), src, dst_size, dst_size, siblings,
+                       primary_fb);
+  };
+
+  if (!test(1.0F, 0.0F)) {
+    /* Unknown limits, the plane keeps accepting any scaling */
+    ALOGW("Failed to probe scaling of plane %d", GetId());
+    return -EINVAL;
+  }
+
+  /* Highest first, drivers limit the ratio and not a set of steps */
+  constexpr std::array<float, 5> kUpscales = {8.0F, 4.0F, 3.0F, 2.0F, 1.5F};
+  constexpr std::array<float, 4> kDownscales = {1.0F / 4, 1.0F / 3, 1.0F / 2,
+                                                2.0F / 3};
+  auto up = std::find_if(kUpscales.begin(), kUpscales.end(),
+                         [&](float scale) { return test(scale, 0.0F); });
+  auto down = std::find_if(kDownscales.begin(), kDownscales.end(),
+                           [&](float scale) { return test(scale, 0.0F); });
+
+  scaling_caps_.max_scale = up != kUpscales.end() ? *up : 1.0F;
+  scaling_caps_.min_scale = down != kDownscales.end() ? *down : 1.0F;
+  scaling_caps_.subpixel_src = test(1.0F, 0.5F);
+  scaling_caps_.probed = true;
+
+  ALOGI("Plane %d scales %.2f..%.2f, subpixel source %d", GetId(),
+        scaling_caps_.min_scale, scaling_caps_.max_scale,
+        scaling_caps_.subpixel_src);
+
   return 0;
 }
 
@@ -21,6 +21,7 @@
 #include <cstdint>
 #include <vector>
 
+#include "DrmColorPipeline.h"
 #include "DrmCrtc.h"
 #include "DrmProperty.h"
 #include "compositor/LayerData.h"
@@ -30,6 +31,37 @@ namespace android {
 class DrmDevice;
 struct LayerData;
 
+/* Dumb buffer framebuffer for the TEST_ONLY commits probing the planes */
+class DrmProbeFb {
+ public:
+  static auto CreateInstance(DrmDevice &dev, uint32_t width, uint32_t height,
+                             uint32_t format) -> std::unique_ptr<DrmProbeFb>;
+
+  DrmProbeFb(const DrmProbeFb &) = delete;
+  DrmProbeFb &operator=(const DrmProbeFb &) = delete;
+  ~DrmProbeFb();
+
+  auto GetId() const {
+    return fb_id_;
+  }
+
+  auto GetWidth() const {
+    return width_;
+  }
+
+  auto GetHeight() const {
+    return height_;
+  }
+
+ private:
+  explicit DrmProbeFb(DrmDevice &dev) : drm_(&dev){};
+  DrmDevice *const drm_;
+  uint32_t handle_{};
+  uint32_t fb_id_{};
+  uint32_t width_{};
+  uint32_t height_{};
+};
+
 class DrmPlane : public PipelineBindable<DrmPlane> {
  public:
   static auto CreateInstance(DrmDevice &dev, uint32_t plane_id)
@@ -47,6 +79,44 @@ class DrmPlane : public PipelineBindable<DrmPlane> {
 
   bool HasNonRgbFormat() const;
 
+  /* Scaling limits found by ProbeScaling(), as display frame / source size */
+  struct ScalingCaps {
+    bool probed{};
+    float min_scale = 1.0F;
+    float max_scale = 1.0F;
+    /* Source crop may start in the middle of a pixel */
+    bool subpixel_src{};
+  };
+
+  auto &GetScalingCaps() const {
+    return scaling_caps_;
+  }
+
+  /* Finds the scaling limits with TEST_ONLY commits of a dumb buffer on the
+   * active |crtc| of |mode_width|x|mode_height| size, with the |siblings|
+   * planes disabled. Some drivers require an enabled primary plane on an
+   * active CRTC, so the primary sibling scans out |primary_fb| unscaled over
+   * the whole CRTC instead, if given. Runs once, later calls return the
+   * stored result.
+   */
+  auto ProbeScaling(const DrmCrtc &crtc, uint32_t mode_width,
+                    uint32_t mode_height,
+                    const std::vector<DrmPlane *> &siblings,
+                    const DrmProbeFb *primary_fb) -> int;
+
+  /* Of the first RGB format the plane supports, null if there is none */
+  auto CreateProbeFb(uint32_t width, uint32_t height) const
+      -> std::unique_ptr<DrmProbeFb>;
+
+  /* True if the plane was not probed yet */
+  bool IsScalingSupported(const PresentInfo &pi) const;
+
+  /* True if the plane presents |from| content in the |to| output encoding,
+   * either as is or converted by one of its color pipelines. HDR content
+   * is never scanned out to SDR outputs as is.
+   */
+  bool IsTransferSupported(BufferTransfer from, BufferTransfer to) const;
+
   auto AtomicSetState(drmModeAtomicReq &pset, LayerData &layer, uint32_t zpos,
                       uint32_t crtc_id, bool most_bottom) -> int;
   auto AtomicDisablePlane(drmModeAtomicReq &pset) -> int;
@@ -72,11 +142,25 @@ class DrmPlane : public PipelineBindable<DrmPlane> {
 
   bool IsFormatSupported(uint32_t format) const;
 
+  auto TestScaling(const DrmCrtc &crtc, uint32_t fb_id, const hwc_frect_t &src,
+                   uint32_t dst_width, uint32_t dst_height,
+                   const std::vector<DrmPlane *> &siblings,
+                   const DrmProbeFb *primary_fb) -> bool;
+  auto AtomicSetProbeState(drmModeAtomicReq &pset, const DrmCrtc &crtc,
+                           uint32_t fb_id, const hwc_frect_t &src,
+                           uint32_t dst_width, uint32_t dst_height) const
+      -> bool;
+
+  /* nullptr if no conversion is needed or possible */
+  auto FindColorPipeline(BufferTransfer from, BufferTransfer to) const
+      -> const DrmColorPipeline *;
+
   uint32_t type_{};
+  ScalingCaps scaling_caps_;
 
   /* Feature: docs/features/drmhwc-feature-001.md */
   std::map<uint32_t /*ReqDrmFormat*/, uint32_t /*ResolvedDrmFormat*/>
-      BottomLayerFormatResolutionTable_;
+      FormatResolutionTable_;
   void AddToFormatResolutionTable(uint32_t original_fourcc,
                                   uint32_t resolved_fourcc);
 
@@ -99,10 +183,14 @@ class DrmPlane : public PipelineBindable<DrmPlane> {
   DrmProperty in_fence_fd_property_;
   DrmProperty color_encoding_propery_;
   DrmProperty color_range_property_;
+  DrmProperty color_pipeline_property_;
+  std::vector<std::unique_ptr<DrmColorPipeline>> color_pipelines_;
+  DrmProperty scaling_filter_property_;
 
   std::map<BufferBlendMode, uint64_t> blending_enum_map_;
   std::map<BufferColorSpace, uint64_t> color_encoding_enum_map_;
   std::map<BufferSampleRange, uint64_t> color_range_enum_map_;
   std::map<LayerTransform, uint64_t> transform_enum_map_;
+  std::map<ScalingFilter, uint64_t> scaling_filter_enum_map_;
 };
 }  // namespace android
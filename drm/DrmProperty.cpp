@@ -111,6 +111,14 @@ std::tuple<uint64_t, int> DrmProperty::GetEnumValueWithName(
   return std::make_tuple(UINT64_MAX, -EINVAL);
 }
 
+auto DrmProperty::GetEnumValues() const -> std::vector<uint64_t> {
+  std::vector<uint64_t> values;
+  for (const auto &it : enums_)
+    values.emplace_back(it.value);
+
+  return values;
+}
+
 auto DrmProperty::AtomicSet(drmModeAtomicReq &pset, uint64_t value) const
     -> bool {
   if (id_ == 0) {
@@ -26,6 +26,12 @@
 
 namespace android {
 
+/* Values of the "SCALING_FILTER" property of planes and CRTCs */
+enum class ScalingFilter {
+  kDefault,
+  kNearestNeighbor,
+};
+
 class DrmProperty {
  public:
   DrmProperty() = default;
@@ -35,6 +41,7 @@ class DrmProperty {
 
   auto Init(uint32_t obj_id, drmModePropertyPtr p, uint64_t value) -> void;
   std::tuple<uint64_t, int> GetEnumValueWithName(const std::string &name) const;
+  auto GetEnumValues() const -> std::vector<uint64_t>;
 
   auto GetId() const {
     return id_;
@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "hwc-present-timing"
+
+#include "PresentTiming.h"
+
+#include <algorithm>
+#include <sstream>
+
+#include "utils/log.h"
+
+namespace android {
+
+/* Commits without flip event (e.g. display off) never complete */
+constexpr size_t kMaxPendingFrames = 4;
+constexpr size_t kDumpFrames = 8;
+
+void PresentTiming::OnCommit(int64_t commit_ns, uint64_t target_sequence) {
+  const std::lock_guard<std::mutex> lock(mutex_);
+  stats_.frames_committed++;
+
+  if (pending_.size() == kMaxPendingFrames)
+    pending_.pop_front();
+
+  pending_.emplace_back((Record){
+      .frame = stats_.frames_committed,
+      .commit_ns = commit_ns,
+      .target_sequence = target_sequence,
+  });
+}
+
+void PresentTiming::OnCommitFailed() {
+  const std::lock_guard<std::mutex> lock(mutex_);
+  if (!pending_.empty())
+    pending_.pop_back();
+}
+
+/* Called on the vsync reactor thread */
+void PresentTiming::OnFlipComplete(uint32_t sequence, int64_t timestamp_ns) {
+  const std::lock_guard<std::mutex> lock(mutex_);
+  if (pending_.empty()) {
+    ALOGV("Flip event without a pending frame");
+    return;
+  }
+
+  auto record = pending_.front();
+  pending_.pop_front();
+
+  record.flip_sequence = sequence;
+  record.flip_ns = timestamp_ns;
+  if (record.target_sequence != 0) {
+    /* Event carries only 32 bits of the vblank counter */
+    auto late = int32_t(sequence - uint32_t(record.target_sequence));
+    record.vblanks_late = uint32_t(std::max(late, 0));
+  }
+
+  stats_.frames_presented++;
+  if (record.vblanks_late > 0) {
+    stats_.frames_late++;
+    stats_.vblanks_missed += record.vblanks_late;
+    stats_.max_vblanks_late = std::max(stats_.max_vblanks_late,
+                                       record.vblanks_late);
+  }
+
+  history_[history_head_] = record;
+  history_head_ = (history_head_ + 1) % kHistorySize;
+  history_count_ = std::min(history_count_ + 1, kHistorySize);
+}
+
+auto PresentTiming::GetStats() -> Stats {
+  const std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+auto PresentTiming::GetLastPresented() -> Record {
+  const std::lock_guard<std::mutex> lock(mutex_);
+  if (history_count_ == 0)
+    return {};
+
+  return history_[(history_head_ + kHistorySize - 1) % kHistorySize];
+}
+
+auto PresentTiming::Dump() -> std::string {
+  const std::lock_guard<std::mutex> lock(mutex_);
+  constexpr int64_t kNsInUs = 1000;
+
+  std::stringstream ss;
+  ss << "Present timing:\n"
+     << " Frames committed: " << stats_.frames_committed
+     << " / presented: " << stats_.frames_presented << "\n"
+     << " Late frames: " << stats_.frames_late
+     << " (missed vblanks: " << stats_.vblanks_missed
+     << ", worst: " << stats_.max_vblanks_late << ")\n";
+
+  auto count = std::min(history_count_, kDumpFrames);
+  if (count > 0)
+    ss << " Last frames [frame: commit->flip us, vblank seq, late]:\n";
+
+  for (size_t i = count; i > 0; i--) {
+    auto &r = history_[(history_head_ + kHistorySize - i) % kHistorySize];
+    ss << "  " << r.frame << ": " << (r.flip_ns - r.commit_ns) / kNsInUs
+       << "us, " << r.flip_sequence << ", " << r.vblanks_late << "\n";
+  }
+
+  return ss.str();
+}
+
+}  // namespace android
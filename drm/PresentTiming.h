@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+
+namespace android {
+
+/* On-glass timing of the committed frames, taken from DRM flip-complete
+ * events. Frame is late if it landed after the first vblank following the
+ * commit.
+ */
+class PresentTiming {
+ public:
+  /* |target_sequence| is the first vblank the frame can land on, 0 if
+   * unknown.
+   */
+  void OnCommit(int64_t commit_ns, uint64_t target_sequence);
+  void OnCommitFailed();
+  void OnFlipComplete(uint32_t sequence, int64_t timestamp_ns);
+
+  struct Record {
+    uint64_t frame{};
+    int64_t commit_ns{};
+    uint64_t target_sequence{};
+    uint32_t flip_sequence{};
+    int64_t flip_ns{};
+    uint32_t vblanks_late{};
+  };
+
+  struct Stats {
+    uint64_t frames_committed{};
+    uint64_t frames_presented{};
+    uint64_t frames_late{};
+    uint64_t vblanks_missed{};
+    uint32_t max_vblanks_late{};
+  };
+
+  auto GetStats() -> Stats;
+
+  /* Last presented frame, frame == 0 if nothing was presented yet */
+  auto GetLastPresented() -> Record;
+
+  auto Dump() -> std::string;
+
+ private:
+  static constexpr size_t kHistorySize = 64;
+  std::array<Record, kHistorySize> history_{};
+  size_t history_count_{};
+  size_t history_head_{}; /* Slot of the next record */
+
+  std::deque<Record> pending_;
+
+  Stats stats_;
+  std::mutex mutex_;
+};
+
+}  // namespace android
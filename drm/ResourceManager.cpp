@@ -20,6 +20,7 @@
 
 #include <sys/stat.h>
 
+#include <cstdlib>
 #include <ctime>
 #include <sstream>
 
@@ -36,9 +37,38 @@ namespace android {
 ResourceManager::ResourceManager(
     PipelineToFrontendBindingInterface *p2f_bind_interface)
     : frontend_interface_(p2f_bind_interface) {
+  /* Fence cleanup waits for the main lock, keep it away from vsync delivery */
+  reactor_ = Reactor::CreateInstance("hwc-cleanup",
+                                     ThreadPolicy::ForRole("cleanup"));
+  vsync_reactor_ = Reactor::CreateInstance("hwc-vsync",
+                                           ThreadPolicy::ForRole("vsync"));
+  commit_thread_policy_ = ThreadPolicy::ForRole("commit");
   uevent_listener_ = UEventListener::CreateInstance();
 }
 
+ResourceManager::~ResourceManager() {
+  if (reactor_)
+    reactor_->Stop();
+  if (vsync_reactor_)
+    vsync_reactor_->Stop();
+}
+
+auto ResourceManager::DumpThreads() -> std::string {
+  std::stringstream ss;
+  ss << "Thread wakeup latency:\n";
+  std::vector<std::shared_ptr<Reactor>> reactors = {vsync_reactor_, reactor_};
+  if (uevent_listener_)
+    reactors.emplace_back(uevent_listener_->GetReactor());
+
+  for (auto &reactor : reactors) {
+    if (reactor)
+      ss << reactor->Dump() << "\n";
+  }
+  ss << " commit (" << commit_thread_policy_.ToString() << ")\n";
+
+  return ss.str();
+}
+
 void ResourceManager::Init() {
   if (initialized_) {
     ALOGE("Already initialized");
@@ -73,6 +103,7 @@ void ResourceManager::Init() {
   }
 
   char proptext[PROPERTY_VALUE_MAX];
+  /* Scaling limits of the planes are probed, this only forces the GPU */
   property_get("vendor.hwc.drm.scale_with_gpu", proptext, "0");
   scale_with_gpu_ = bool(strncmp(proptext, "0", 1));
 
@@ -88,6 +119,31 @@ void ResourceManager::Init() {
     ctm_handling_ = CtmHandling::kDrmOrGpu;
   }
 
+  constexpr char kDefault[] = "DEFAULT";
+  constexpr char kIntegerNearest[] = "INTEGER_NEAREST";
+  constexpr char kNearest[] = "NEAREST";
+  property_get("vendor.hwc.drm.scaling_filter", proptext, kDefault);
+  if (strncmp(proptext, kDefault, sizeof(kDefault)) == 0) {
+    scaling_filter_policy_ = ScalingFilterPolicy::kDefault;
+  } else if (strncmp(proptext, kIntegerNearest, sizeof(kIntegerNearest)) ==
+             0) {
+    scaling_filter_policy_ = ScalingFilterPolicy::kIntegerNearest;
+  } else if (strncmp(proptext, kNearest, sizeof(kNearest)) == 0) {
+    scaling_filter_policy_ = ScalingFilterPolicy::kNearest;
+  } else {
+    ALOGE("Invalid value for vendor.hwc.drm.scaling_filter: %s", proptext);
+    scaling_filter_policy_ = ScalingFilterPolicy::kDefault;
+  }
+
+  property_get("vendor.hwc.drm.budget.bandwidth_mbps", proptext, "0");
+  plane_budget_.bandwidth_mbps = strtoull(proptext, nullptr, 10);
+  property_get("vendor.hwc.drm.budget.scalers", proptext, "-1");
+  plane_budget_.scalers = int32_t(strtol(proptext, nullptr, 10));
+
+  property_get("vendor.hwc.drm.idle_refresh_ms", proptext, "0");
+  idle_refresh_period_ = std::chrono::milliseconds(
+      strtoull(proptext, nullptr, 10));
+
   if (BufferInfoGetter::GetInstance() == nullptr) {
     ALOGE("Failed to initialize BufferInfoGetter");
     return;
@@ -100,6 +156,10 @@ void ResourceManager::Init() {
 
   UpdateFrontendDisplays();
 
+  /* Hotplugged and reattached pipelines start with a modeset */
+  for (auto &drm : drms_)
+    drm->EndFirmwareStateAdoption();
+
   initialized_ = true;
 }
 
@@ -129,19 +189,42 @@ void ResourceManager::UpdateFrontendDisplays() {
 
   for (auto *conn : ordered_connectors) {
     conn->UpdateModes();
+  }
+
+  /* Detach first, so resources of the removed pipelines (or the pipelines of
+   * the tiles joining a tiled display) can be reused below */
+  std::vector<DrmConnector *> connectors_to_attach;
+  for (auto *conn : ordered_connectors) {
     auto connected = conn->IsConnected();
     auto attached = attached_pipelines_.count(conn) != 0;
 
+    size_t secondary_tiles = 0;
+    auto &tile = conn->GetTile();
+    if (connected && tile) {
+      auto group = conn->GetDev().GetConnectedTileGroup(tile->group_id);
+      if (!group.empty()) {
+        /* Secondary tiles are driven by the pipeline of the leading one */
+        connected = group.front() == conn;
+        secondary_tiles = group.size() - 1;
+      }
+    }
+
+    if (connected && attached &&
+        attached_pipelines_[conn]->tiles.size() != secondary_tiles) {
+      ALOGI("Tile group of connector %s has changed, reattaching",
+            conn->GetName().c_str());
+      auto &pipeline = attached_pipelines_[conn];
+      frontend_interface_->UnbindDisplay(pipeline.get());
+      attached_pipelines_.erase(conn);
+      attached = false;
+    }
+
     if (connected != attached) {
       ALOGI("%s connector %s", connected ? "Attaching" : "Detaching",
             conn->GetName().c_str());
 
       if (connected) {
-        auto pipeline = DrmDisplayPipeline::CreatePipeline(*conn);
-        if (pipeline) {
-          frontend_interface_->BindDisplay(pipeline.get());
-          attached_pipelines_[conn] = std::move(pipeline);
-        }
+        connectors_to_attach.emplace_back(conn);
       } else {
         auto &pipeline = attached_pipelines_[conn];
         frontend_interface_->UnbindDisplay(pipeline.get());
@@ -149,6 +232,15 @@ void ResourceManager::UpdateFrontendDisplays() {
       }
     }
   }
+
+  for (auto *conn : connectors_to_attach) {
+    auto pipeline = DrmDisplayPipeline::CreatePipeline(*conn);
+    if (pipeline) {
+      frontend_interface_->BindDisplay(pipeline.get());
+      attached_pipelines_[conn] = std::move(pipeline);
+    }
+  }
+
   frontend_interface_->FinalizeDisplayBinding();
 }
 
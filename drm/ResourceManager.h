@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <chrono>
 #include <cstring>
 #include <mutex>
 
@@ -23,6 +24,7 @@
 #include "DrmDisplayPipeline.h"
 #include "DrmFbImporter.h"
 #include "UEventListener.h"
+#include "utils/Reactor.h"
 
 namespace android {
 
@@ -31,6 +33,20 @@ enum class CtmHandling {
   kDrmOrIgnore, /* Handled by DRM is possible, otherwise displayed as is */
 };
 
+enum class ScalingFilterPolicy {
+  kDefault,        /* Driver default filter, usually bilinear */
+  kIntegerNearest, /* Nearest neighbour for integer upscaling of RGB layers */
+  kNearest,        /* Nearest neighbour for everything */
+};
+
+/* Per-CRTC limits of the display controller */
+struct PlaneBudget {
+  /* Scanout fetch of all active planes in MB/s, 0 for unlimited */
+  uint64_t bandwidth_mbps{};
+  /* Planes allowed to scale at once, -1 for unlimited */
+  int32_t scalers = -1;
+};
+
 class PipelineToFrontendBindingInterface {
  public:
   virtual ~PipelineToFrontendBindingInterface() = default;
@@ -47,7 +63,7 @@ class ResourceManager {
   ResourceManager &operator=(const ResourceManager &) = delete;
   ResourceManager(const ResourceManager &&) = delete;
   ResourceManager &&operator=(const ResourceManager &&) = delete;
-  ~ResourceManager() = default;
+  ~ResourceManager();
 
   void Init();
 
@@ -61,10 +77,42 @@ class ResourceManager {
     return ctm_handling_;
   }
 
+  auto &GetPlaneBudget() const {
+    return plane_budget_;
+  }
+
+  auto GetScalingFilterPolicy() const {
+    return scaling_filter_policy_;
+  }
+
+  /* Zero if the refresh rate is kept on static content */
+  auto GetIdleRefreshPeriod() const {
+    return idle_refresh_period_;
+  }
+
   auto &GetMainLock() {
     return main_lock_;
   }
 
+  /* Serves flattening timers and present fences */
+  auto &GetReactor() {
+    return reactor_;
+  }
+
+  /* Serves DRM events and vsync timers */
+  auto &GetVSyncReactor() {
+    return vsync_reactor_;
+  }
+
+  /* Applied to binder threads for the time of a commit, see
+   * ScopedThreadPolicy
+   */
+  auto &GetCommitThreadPolicy() const {
+    return commit_thread_policy_;
+  }
+
+  auto DumpThreads() -> std::string;
+
   static auto GetTimeMonotonicNs() -> int64_t;
 
  private:
@@ -72,11 +120,17 @@ class ResourceManager {
   void UpdateFrontendDisplays();
   void DetachAllFrontendDisplays();
 
+  std::shared_ptr<Reactor> reactor_;
+  std::shared_ptr<Reactor> vsync_reactor_;
+
   std::vector<std::unique_ptr<DrmDevice>> drms_;
 
   // Android properties:
   bool scale_with_gpu_{};
   CtmHandling ctm_handling_{};
+  PlaneBudget plane_budget_;
+  ScalingFilterPolicy scaling_filter_policy_{};
+  std::chrono::milliseconds idle_refresh_period_{};
 
   std::shared_ptr<UEventListener> uevent_listener_;
 
@@ -87,6 +141,8 @@ class ResourceManager {
 
   PipelineToFrontendBindingInterface *const frontend_interface_;
 
+  ThreadPolicy commit_thread_policy_;
+
   bool initialized_{};
 };
 }  // namespace android
@@ -18,8 +18,7 @@
 
 #include "UEventListener.h"
 
-#include <thread>
-
+#include "drm/ResourceManager.h"
 #include "utils/log.h"
 
 namespace android {
@@ -31,34 +30,65 @@ auto UEventListener::CreateInstance() -> std::shared_ptr<UEventListener> {
   if (!uel->uevent_)
     return {};
 
-  std::thread(&UEventListener::ThreadFn, uel.get(), uel).detach();
+  uel->reactor_ = Reactor::CreateInstance("hwc-uevent",
+                                         ThreadPolicy::ForRole("uevent"));
+  if (!uel->reactor_)
+    return {};
+
+  std::weak_ptr<UEventListener> weak_uel = uel;
+  uel->hotplug_timer_ = uel->reactor_->CreateTimer([weak_uel]() {
+    auto listener = weak_uel.lock();
+    if (listener)
+      listener->OnHotplugTimeout();
+  });
+  if (!uel->hotplug_timer_)
+    return {};
+
+  auto ret = uel->reactor_->AddFd(uel->uevent_->GetFd(), [weak_uel]() {
+    auto listener = weak_uel.lock();
+    if (listener)
+      listener->OnUEvent();
+  });
+  if (ret != 0)
+    return {};
 
   return uel;
 }
 
-void UEventListener::ThreadFn(const std::shared_ptr<UEventListener> &uel) {
-  // TODO(nobody): Rework code to allow stopping the thread (low priority)
-  while (true) {
-    if (uel.use_count() == 1)
-      break;
+UEventListener::~UEventListener() {
+  if (reactor_) {
+    hotplug_timer_.reset();
+    reactor_->Stop();
+  }
+}
 
-    auto uevent_str = uel->uevent_->ReadNext();
+void UEventListener::OnUEvent() {
+  auto uevent_str = uevent_->ReadNext();
+  if (!uevent_str)
+    return;
 
-    if (!hotplug_handler_ || !uevent_str)
-      continue;
+  auto drm_event = uevent_str->find("DEVTYPE=drm_minor") != std::string::npos;
+  auto hotplug_event = uevent_str->find("HOTPLUG=1") != std::string::npos;
 
-    auto drm_event = uevent_str->find("DEVTYPE=drm_minor") != std::string::npos;
-    auto hotplug_event = uevent_str->find("HOTPLUG=1") != std::string::npos;
+  if (drm_event && hotplug_event) {
+    constexpr int64_t kDelayAfterUeventNs = 200LL * 1000 * 1000;
+    /* We need some delay to ensure DrmConnector::UpdateModes() will query
+     * correct modes list, otherwise at least RPI4 board may report 0 modes.
+     * Burst of uevents is collapsed into a single hotplug_handler_ call.
+     */
+    hotplug_timer_->ArmAt(ResourceManager::GetTimeMonotonicNs() +
+                          kDelayAfterUeventNs);
+  }
+}
 
-    if (drm_event && hotplug_event) {
-      constexpr useconds_t kDelayAfterUeventUs = 200000;
-      /* We need some delay to ensure DrmConnector::UpdateModes() will query
-       * correct modes list, otherwise at least RPI4 board may report 0 modes */
-      usleep(kDelayAfterUeventUs);
-      hotplug_handler_();
-    }
+void UEventListener::OnHotplugTimeout() {
+  std::function<void()> hotplug_handler;
+  {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    hotplug_handler = hotplug_handler_;
   }
 
-  ALOGI("UEvent thread exit");
+  if (hotplug_handler)
+    hotplug_handler();
 }
 }  // namespace android
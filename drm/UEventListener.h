@@ -17,28 +17,41 @@
 #pragma once
 
 #include <functional>
+#include <mutex>
 
+#include "utils/Reactor.h"
 #include "utils/UEvent.h"
 
 namespace android {
 
 class UEventListener {
  public:
-  ~UEventListener() = default;
+  ~UEventListener();
 
   static auto CreateInstance() -> std::shared_ptr<UEventListener>;
 
   void RegisterHotplugHandler(std::function<void()> hotplug_handler) {
+    const std::lock_guard<std::mutex> lock(mutex_);
     hotplug_handler_ = std::move(hotplug_handler);
   }
 
+  auto &GetReactor() const {
+    return reactor_;
+  }
+
  private:
   UEventListener() = default;
 
-  void ThreadFn(const std::shared_ptr<UEventListener> &uel);
+  void OnUEvent();
+  void OnHotplugTimeout();
 
   std::unique_ptr<UEvent> uevent_;
 
+  /* Own reactor, hotplug handling may block for a long time */
+  std::shared_ptr<Reactor> reactor_;
+  std::unique_ptr<ReactorTimer> hotplug_timer_;
+
   std::function<void()> hotplug_handler_;
+  std::mutex mutex_;
 };
 }  // namespace android
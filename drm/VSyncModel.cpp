@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "hwc-vsync-model"
+
+#include "VSyncModel.h"
+
+#include <cmath>
+#include <cstdlib>
+
+#include "utils/log.h"
+
+namespace android {
+
+/* Sample further than this from the prediction is an outlier */
+constexpr double kOutlierPeriodFraction = 0.1;
+/* That many outliers in a row mean the model is wrong, start over */
+constexpr int kMaxConsecutiveOutliers = 3;
+
+constexpr size_t kMinStableSamples = 6;
+constexpr double kStableRmsPeriodFraction = 0.01;
+constexpr double kStablePeriodDeviation = 0.05;
+
+void VSyncModel::SetNominalPeriod(int64_t period_ns) {
+  if (period_ns == nominal_period_ns_)
+    return;
+
+  nominal_period_ns_ = period_ns;
+  Reset();
+}
+
+void VSyncModel::Reset() {
+  count_ = 0;
+  head_ = 0;
+  period_ns_ = nominal_period_ns_;
+  phase_ns_ = 0;
+  residual_rms_ns_ = 0;
+  consecutive_outliers_ = 0;
+}
+
+auto VSyncModel::AddSample(int64_t timestamp_ns) -> bool {
+  if (period_ns_ <= 0)
+    return false;
+
+  if (count_ > 0) {
+    auto error = double(timestamp_ns - Snap(timestamp_ns));
+    auto last = samples_[(head_ + count_ - 1) % kWindowSize];
+    /* Same vsync reported twice, or clock went backwards */
+    auto stale = timestamp_ns - last < period_ns_ / 2;
+    auto far = std::abs(error) > double(period_ns_) * kOutlierPeriodFraction;
+    if (stale || far) {
+      if (++consecutive_outliers_ <= kMaxConsecutiveOutliers)
+        return false;
+
+      ALOGV("Too many vsync outliers, resetting the model");
+      Reset();
+    }
+  }
+
+  consecutive_outliers_ = 0;
+  if (count_ == kWindowSize) {
+    head_ = (head_ + 1) % kWindowSize;
+    count_--;
+  }
+  samples_[(head_ + count_) % kWindowSize] = timestamp_ns;
+  count_++;
+
+  Fit();
+  return true;
+}
+
+void VSyncModel::Fit() {
+  auto reference = samples_[head_];
+  if (count_ < 2) {
+    period_ns_ = nominal_period_ns_;
+    phase_ns_ = reference;
+    residual_rms_ns_ = 0;
+    return;
+  }
+
+  /* Least squares over (vsync index, timestamp) pairs. Indices are derived
+   * from the current period estimate, so missed vblanks don't skew the fit.
+   */
+  double sum_x = 0;
+  double sum_y = 0;
+  double sum_xx = 0;
+  double sum_xy = 0;
+  for (size_t i = 0; i < count_; i++) {
+    auto y = double(samples_[(head_ + i) % kWindowSize] - reference);
+    auto x = std::round(y / double(period_ns_));
+    sum_x += x;
+    sum_y += y;
+    sum_xx += x * x;
+    sum_xy += x * y;
+  }
+
+  auto n = double(count_);
+  auto denominator = n * sum_xx - sum_x * sum_x;
+  if (denominator == 0)
+    return;
+
+  auto slope = (n * sum_xy - sum_x * sum_y) / denominator;
+  auto intercept = (sum_y - slope * sum_x) / n;
+
+  double sum_residual_sq = 0;
+  for (size_t i = 0; i < count_; i++) {
+    auto y = double(samples_[(head_ + i) % kWindowSize] - reference);
+    auto x = std::round(y / double(period_ns_));
+    auto residual = y - (intercept + slope * x);
+    sum_residual_sq += residual * residual;
+  }
+
+  period_ns_ = int64_t(std::llround(slope));
+  phase_ns_ = reference + int64_t(std::llround(intercept));
+  residual_rms_ns_ = std::sqrt(sum_residual_sq / n);
+}
+
+auto VSyncModel::IsStable() const -> bool {
+  if (count_ < kMinStableSamples || nominal_period_ns_ <= 0)
+    return false;
+
+  auto deviation = std::abs(double(period_ns_ - nominal_period_ns_)) /
+                   double(nominal_period_ns_);
+
+  return deviation < kStablePeriodDeviation &&
+         residual_rms_ns_ < double(period_ns_) * kStableRmsPeriodFraction;
+}
+
+auto VSyncModel::Snap(int64_t timestamp_ns) const -> int64_t {
+  if (period_ns_ <= 0)
+    return timestamp_ns;
+
+  auto n = std::llround(double(timestamp_ns - phase_ns_) / double(period_ns_));
+  return phase_ns_ + n * period_ns_;
+}
+
+auto VSyncModel::PredictNext(int64_t time_ns) const -> int64_t {
+  if (period_ns_ <= 0)
+    return time_ns;
+
+  if (count_ == 0)
+    return time_ns + period_ns_;
+
+  /* Floor division, |time_ns| may precede the phase */
+  auto elapsed = time_ns - phase_ns_;
+  auto n = elapsed / period_ns_;
+  if (elapsed < 0 && elapsed % period_ns_ != 0)
+    n--;
+
+  return phase_ns_ + (n + 1) * period_ns_;
+}
+
+}  // namespace android
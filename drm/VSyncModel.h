@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace android {
+
+/* Linear model of the display vsync: timestamp = phase + n * period.
+ * Period and phase are fitted (least squares) over a window of hardware
+ * vblank timestamps. Samples too far from the prediction are rejected.
+ */
+class VSyncModel {
+ public:
+  /* Mode change invalidates the model */
+  void SetNominalPeriod(int64_t period_ns);
+
+  /* Returns false if the sample was rejected as an outlier */
+  auto AddSample(int64_t timestamp_ns) -> bool;
+
+  void Reset();
+
+  auto IsEmpty() const {
+    return count_ == 0;
+  }
+
+  /* Enough consistent samples to predict vsync without hardware */
+  auto IsStable() const -> bool;
+
+  auto GetPeriodNs() const {
+    return period_ns_;
+  }
+
+  /* Fitted timestamp of the vsync nearest to |timestamp_ns| */
+  auto Snap(int64_t timestamp_ns) const -> int64_t;
+
+  /* First vsync strictly after |time_ns| */
+  auto PredictNext(int64_t time_ns) const -> int64_t;
+
+ private:
+  void Fit();
+
+  static constexpr size_t kWindowSize = 32;
+  std::array<int64_t, kWindowSize> samples_{};
+  size_t count_{};
+  size_t head_{}; /* Oldest sample */
+
+  int64_t nominal_period_ns_{};
+  int64_t period_ns_{};
+  int64_t phase_ns_{};
+  double residual_rms_ns_{};
+  int consecutive_outliers_{};
+};
+
+}  // namespace android
@@ -21,6 +21,7 @@
 #include <xf86drm.h>
 #include <xf86drmMode.h>
 
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
 #include <ctime>
@@ -31,42 +32,96 @@
 namespace android {
 
 auto VSyncWorker::CreateInstance(DrmDisplayPipeline *pipe,
+                                 std::shared_ptr<Reactor> reactor,
                                  VSyncWorkerCallbacks &callbacks)
     -> std::shared_ptr<VSyncWorker> {
+  if (!reactor)
+    return {};
+
   auto vsw = std::shared_ptr<VSyncWorker>(new VSyncWorker());
 
   vsw->callbacks_ = callbacks;
+  vsw->reactor_ = std::move(reactor);
+
+  std::weak_ptr<VSyncWorker> weak_vsw = vsw;
+  vsw->timer_ = vsw->reactor_->CreateTimer([weak_vsw]() {
+    auto worker = weak_vsw.lock();
+    if (worker)
+      worker->OnTimerEvent();
+  });
+  if (!vsw->timer_)
+    return {};
 
   if (pipe != nullptr) {
     vsw->high_crtc_ = pipe->crtc->Get()->GetIndexInResArray()
                       << DRM_VBLANK_HIGH_CRTC_SHIFT;
-    vsw->drm_fd_ = pipe->device->GetFd();
+    vsw->crtc_id_ = pipe->crtc->Get()->GetId();
+    vsw->drm_ = pipe->device;
+    vsw->vblank_handler_token_ = vsw->drm_->SetVBlankHandler(
+        vsw->crtc_id_, [weak_vsw](uint32_t /*sequence*/, int64_t timestamp) {
+          auto worker = weak_vsw.lock();
+          if (worker)
+            worker->OnVBlankEvent(timestamp);
+        });
   }
 
-  std::thread(&VSyncWorker::ThreadFn, vsw.get(), vsw).detach();
-
   return vsw;
 }
 
-void VSyncWorker::VSyncControl(bool enabled) {
-  {
-    const std::lock_guard<std::mutex> lock(mutex_);
-    enabled_ = enabled;
-    last_timestamp_ = -1;
+/* Hardware vblank is checked at least every 2 seconds at 60Hz */
+constexpr int kMaxPredictedVSyncs = 120;
+
+void VSyncWorker::AddConsumer(VSyncConsumer consumer) {
+  const std::lock_guard<std::mutex> lock(mutex_);
+  consumer_refs_[size_t(consumer)]++;
+
+  if (!enabled_) {
+    /* Stable model serves the first vsync without waiting for the vblank
+     * interrupt to be re-enabled, so the latency is bounded by one period.
+     * The phase may be outdated after idle, revalidate right after that.
+     */
+    predicted_vsyncs_ = std::max(predicted_vsyncs_, kMaxPredictedVSyncs - 1);
+    enabled_ = true;
   }
 
-  cv_.notify_all();
+  if (!vblank_pending_ && !timer_pending_)
+    RequestNextVSync();
 }
 
-void VSyncWorker::StopThread() {
+void VSyncWorker::RemoveConsumer(VSyncConsumer consumer) {
+  const std::lock_guard<std::mutex> lock(mutex_);
+  auto &refs = consumer_refs_[size_t(consumer)];
+  if (refs == 0) {
+    ALOGE("Unbalanced vsync consumer %d removal", int(consumer));
+    return;
+  }
+
+  refs--;
+  enabled_ = false;
+  for (auto count : consumer_refs_)
+    enabled_ |= count > 0;
+
+  /* Pending vblank event is dropped on arrival, no new request is issued so
+   * the kernel turns the vblank interrupt off.
+   */
+  if (!enabled_ && timer_pending_ && timer_) {
+    timer_->Disarm();
+    timer_pending_ = false;
+  }
+}
+
+void VSyncWorker::Stop() {
+  std::unique_ptr<ReactorTimer> timer;
   {
     const std::lock_guard<std::mutex> lock(mutex_);
-    thread_exit_ = true;
     enabled_ = false;
+    consumer_refs_ = {};
     callbacks_ = {};
+    timer = std::move(timer_);
   }
 
-  cv_.notify_all();
+  if (drm_ != nullptr)
+    drm_->ResetVBlankHandler(crtc_id_, vblank_handler_token_);
 }
 
 /*
@@ -90,89 +145,121 @@ int64_t VSyncWorker::GetPhasedVSync(int64_t frame_ns, int64_t current) const {
          last_timestamp_;
 }
 
-static const int64_t kOneSecondNs = 1LL * 1000 * 1000 * 1000;
+auto VSyncWorker::IsVSyncModelStable() -> bool {
+  const std::lock_guard<std::mutex> lock(mutex_);
+  return model_.IsStable();
+}
 
-int VSyncWorker::SyntheticWaitVBlank(int64_t *timestamp) {
-  auto time_now = ResourceManager::GetTimeMonotonicNs();
+auto VSyncWorker::PredictNextVSync(int64_t time_ns) -> int64_t {
+  const std::lock_guard<std::mutex> lock(mutex_);
+  model_.SetNominalPeriod(GetNominalPeriodNs());
+  if (model_.IsEmpty())
+    return GetPhasedVSync(GetNominalPeriodNs(), time_ns);
+
+  return model_.PredictNext(time_ns);
+}
 
+auto VSyncWorker::GetNominalPeriodNs() const -> int64_t {
   // Default to 60Hz refresh rate
   constexpr uint32_t kDefaultVSPeriodNs = 16666666;
   auto period_ns = kDefaultVSPeriodNs;
   if (callbacks_.get_vperiod_ns && callbacks_.get_vperiod_ns() != 0)
     period_ns = callbacks_.get_vperiod_ns();
 
-  auto phased_timestamp = GetPhasedVSync(period_ns, time_now);
-  struct timespec vsync {};
-  vsync.tv_sec = int(phased_timestamp / kOneSecondNs);
-  vsync.tv_nsec = int(phased_timestamp - (vsync.tv_sec * kOneSecondNs));
+  return period_ns;
+}
 
-  int ret = 0;
-  do {
-    ret = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &vsync, nullptr);
-  } while (ret == EINTR);
-  if (ret != 0)
-    return ret;
+void VSyncWorker::RequestNextVSync() {
+  auto period_ns = GetNominalPeriodNs();
+  model_.SetNominalPeriod(period_ns);
 
-  *timestamp = phased_timestamp;
-  return 0;
-}
+  auto predict = model_.IsStable() && predicted_vsyncs_ < kMaxPredictedVSyncs;
+  if (drm_ != nullptr && !predict) {
+    drmVBlank vblank{};
+    vblank.request.type = (drmVBlankSeqType)(DRM_VBLANK_RELATIVE |
+                                             DRM_VBLANK_EVENT |
+                                             (high_crtc_ &
+                                              DRM_VBLANK_HIGH_CRTC_MASK));
+    vblank.request.sequence = 1;
+    vblank.request.signal = crtc_id_;
+
+    if (drmWaitVBlank(*drm_->GetFd(), &vblank) == 0) {
+      predicted_vsyncs_ = 0;
+      vblank_pending_ = true;
+      return;
+    }
+  }
 
-void VSyncWorker::ThreadFn(const std::shared_ptr<VSyncWorker> &vsw) {
-  int ret = 0;
+  /* Model is stable, CRTC is off or there is no CRTC at all: emulate vsync
+   * using timer
+   */
+  if (!timer_)
+    return;
+
+  auto now = ResourceManager::GetTimeMonotonicNs();
+  if (model_.IsEmpty()) {
+    timer_timestamp_ = GetPhasedVSync(period_ns, now);
+  } else {
+    timer_timestamp_ = model_.PredictNext(now);
+  }
 
-  for (;;) {
-    {
-      std::unique_lock<std::mutex> lock(vsw->mutex_);
-      if (thread_exit_)
-        break;
+  if (predict)
+    predicted_vsyncs_++;
 
-      if (!enabled_)
-        vsw->cv_.wait(lock);
+  timer_->ArmAt(timer_timestamp_);
+  timer_pending_ = true;
+}
 
-      if (!enabled_)
-        continue;
-    }
+void VSyncWorker::OnVBlankEvent(int64_t timestamp) {
+  {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    /* Event requested by the previous worker of the same CRTC */
+    if (!vblank_pending_)
+      return;
 
-    ret = -EAGAIN;
-    int64_t timestamp = 0;
-    drmVBlank vblank{};
+    vblank_pending_ = false;
 
-    if (drm_fd_) {
-      vblank.request.type = (drmVBlankSeqType)(DRM_VBLANK_RELATIVE |
-                                               (high_crtc_ &
-                                                DRM_VBLANK_HIGH_CRTC_MASK));
-      vblank.request.sequence = 1;
+    /* Serve the fitted timestamp, it doesn't carry interrupt jitter */
+    if (model_.AddSample(timestamp) && model_.IsStable())
+      timestamp = model_.Snap(timestamp);
+  }
 
-      ret = drmWaitVBlank(*drm_fd_, &vblank);
-      if (ret == -EINTR)
-        continue;
-    }
+  reactor_->ReportWakeupLatency(ResourceManager::GetTimeMonotonicNs() -
+                                timestamp);
+  OnVSync(timestamp);
+}
 
-    if (ret != 0) {
-      ret = SyntheticWaitVBlank(&timestamp);
-      if (ret != 0)
-        continue;
-    } else {
-      constexpr int kUsToNsMul = 1000;
-      timestamp = (int64_t)vblank.reply.tval_sec * kOneSecondNs +
-                  (int64_t)vblank.reply.tval_usec * kUsToNsMul;
-    }
+void VSyncWorker::OnTimerEvent() {
+  int64_t timestamp = 0;
+  {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    if (!timer_pending_)
+      return;
 
-    decltype(callbacks_.out_event) callback;
+    timer_pending_ = false;
+    timestamp = timer_timestamp_;
+  }
 
-    {
-      const std::lock_guard<std::mutex> lock(mutex_);
-      if (!enabled_)
-        continue;
-      callback = callbacks_.out_event;
-    }
+  OnVSync(timestamp);
+}
 
-    if (callback)
-      callback(timestamp);
+/* Called on the reactor thread */
+void VSyncWorker::OnVSync(int64_t timestamp) {
+  decltype(callbacks_.out_event) callback;
 
-    last_timestamp_ = timestamp;
+  {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    if (!enabled_)
+      return;
+    callback = callbacks_.out_event;
   }
 
-  ALOGI("VSyncWorker thread exit");
+  if (callback)
+    callback(timestamp);
+
+  const std::lock_guard<std::mutex> lock(mutex_);
+  last_timestamp_ = timestamp;
+  if (enabled_ && !vblank_pending_ && !timer_pending_)
+    RequestNextVSync();
 }
 }  // namespace android
@@ -16,13 +16,14 @@
 
 #pragma once
 
-#include <condition_variable>
+#include <array>
 #include <functional>
 #include <map>
 #include <mutex>
-#include <thread>
 
 #include "DrmDevice.h"
+#include "VSyncModel.h"
+#include "utils/Reactor.h"
 
 namespace android {
 
@@ -31,36 +32,67 @@ struct VSyncWorkerCallbacks {
   std::function<uint32_t()> get_vperiod_ns;
 };
 
+/* Vblank is delivered only while at least one consumer holds a reference */
+enum class VSyncConsumer {
+  kClient,           /* SurfaceFlinger vsync events */
+  kPeriodTracking,   /* Vsync period change timeline */
+  kCommitScheduling, /* Commit deferred to a vsync-aligned deadline */
+  kCount,
+};
+
 class VSyncWorker {
  public:
   ~VSyncWorker() = default;
 
   auto static CreateInstance(DrmDisplayPipeline *pipe,
+                             std::shared_ptr<Reactor> reactor,
                              VSyncWorkerCallbacks &callbacks)
       -> std::shared_ptr<VSyncWorker>;
 
-  void VSyncControl(bool enabled);
-  void StopThread();
+  void AddConsumer(VSyncConsumer consumer);
+  void RemoveConsumer(VSyncConsumer consumer);
+  void Stop();
+
+  /* Once the model is stable, vsync timestamps are predicted and hardware
+   * vblank is only waited for now and then to revalidate the model.
+   */
+  auto IsVSyncModelStable() -> bool;
+  auto PredictNextVSync(int64_t time_ns) -> int64_t;
 
  private:
   VSyncWorker() = default;
 
-  void ThreadFn(const std::shared_ptr<VSyncWorker> &vsw);
-
   int64_t GetPhasedVSync(int64_t frame_ns, int64_t current) const;
-  int SyntheticWaitVBlank(int64_t *timestamp);
+  auto GetNominalPeriodNs() const -> int64_t;
+
+  /* Must be called with mutex_ held */
+  void RequestNextVSync();
+
+  void OnVSync(int64_t timestamp);
+  void OnVBlankEvent(int64_t timestamp);
+  void OnTimerEvent();
 
   VSyncWorkerCallbacks callbacks_;
 
-  SharedFd drm_fd_;
+  std::shared_ptr<Reactor> reactor_;
+  std::unique_ptr<ReactorTimer> timer_;
+
+  DrmDevice *drm_{};
+  uint32_t crtc_id_{};
+  DrmDevice::HandlerToken vblank_handler_token_{};
   uint32_t high_crtc_ = 0;
 
+  std::array<int, size_t(VSyncConsumer::kCount)> consumer_refs_{};
   bool enabled_ = false;
-  bool thread_exit_ = false;
+  bool vblank_pending_ = false;
+  bool timer_pending_ = false;
+  int64_t timer_timestamp_{};
   int64_t last_timestamp_ = -1;
 
-  std::condition_variable cv_;
-  std::thread vswt_;
+  VSyncModel model_;
+  /* Vsyncs predicted since the last hardware vblank */
+  int predicted_vsyncs_{};
+
   std::mutex mutex_;
 };
 }  // namespace android
@@ -151,6 +151,8 @@ void DrmHwcTwo::Dump(uint32_t *outSize, char *outBuffer) {
   for (auto &disp : displays_)
     output << disp.second->Dump();
 
+  output << GetResMan().DumpThreads();
+
   mDumpString = output.str();
   *outSize = static_cast<uint32_t>(mDumpString.size());
 }
@@ -183,11 +185,13 @@ HWC2::Error DrmHwcTwo::RegisterCallback(int32_t descriptor,
       break;
     }
     case HWC2::Callback::Vsync: {
+      const std::lock_guard<std::mutex> lock(vsync_callback_mutex_);
       vsync_callback_ = std::make_pair(HWC2_PFN_VSYNC(function), data);
       break;
     }
 #if __ANDROID_API__ > 29
     case HWC2::Callback::Vsync_2_4: {
+      const std::lock_guard<std::mutex> lock(vsync_callback_mutex_);
       vsync_2_4_callback_ = std::make_pair(HWC2_PFN_VSYNC_2_4(function), data);
       break;
     }
@@ -218,18 +222,27 @@ void DrmHwcTwo::SendHotplugEventToClient(hwc2_display_t displayid,
 
 void DrmHwcTwo::SendVsyncEventToClient(
     hwc2_display_t displayid, int64_t timestamp,
-    [[maybe_unused]] uint32_t vsync_period) const {
+    [[maybe_unused]] uint32_t vsync_period) {
+  decltype(vsync_callback_) vc;
+#if __ANDROID_API__ > 29
+  decltype(vsync_2_4_callback_) vc_2_4;
+#endif
+  {
+    const std::lock_guard<std::mutex> lock(vsync_callback_mutex_);
+    vc = vsync_callback_;
+#if __ANDROID_API__ > 29
+    vc_2_4 = vsync_2_4_callback_;
+#endif
+  }
+
   /* vsync callback */
 #if __ANDROID_API__ > 29
-  if (vsync_2_4_callback_.first != nullptr &&
-      vsync_2_4_callback_.second != nullptr) {
-    vsync_2_4_callback_.first(vsync_2_4_callback_.second, displayid, timestamp,
-                              vsync_period);
+  if (vc_2_4.first != nullptr && vc_2_4.second != nullptr) {
+    vc_2_4.first(vc_2_4.second, displayid, timestamp, vsync_period);
   } else
 #endif
-      if (vsync_callback_.first != nullptr &&
-          vsync_callback_.second != nullptr) {
-    vsync_callback_.first(vsync_callback_.second, displayid, timestamp);
+      if (vc.first != nullptr && vc.second != nullptr) {
+    vc.first(vc.second, displayid, timestamp);
   }
 }
 
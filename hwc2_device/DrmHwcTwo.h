@@ -18,6 +18,8 @@
 
 #include <hardware/hwcomposer2.h>
 
+#include <mutex>
+
 #include "drm/ResourceManager.h"
 #include "hwc2_device/HwcDisplay.h"
 
@@ -29,6 +31,8 @@ class DrmHwcTwo : public PipelineToFrontendBindingInterface {
   ~DrmHwcTwo() override = default;
 
   std::pair<HWC2_PFN_HOTPLUG, hwc2_callback_data_t> hotplug_callback_{};
+  /* Vsync callbacks are invoked without the main lock */
+  std::mutex vsync_callback_mutex_;
   std::pair<HWC2_PFN_VSYNC, hwc2_callback_data_t> vsync_callback_{};
 #if __ANDROID_API__ > 29
   std::pair<HWC2_PFN_VSYNC_2_4, hwc2_callback_data_t> vsync_2_4_callback_{};
@@ -66,7 +70,7 @@ class DrmHwcTwo : public PipelineToFrontendBindingInterface {
   void FinalizeDisplayBinding() override;
 
   void SendVsyncEventToClient(hwc2_display_t displayid, int64_t timestamp,
-                              uint32_t vsync_period) const;
+                              uint32_t vsync_period);
   void SendVsyncPeriodTimingChangedEventToClient(hwc2_display_t displayid,
                                                  int64_t timestamp) const;
 
@@ -19,6 +19,10 @@
 
 #include "HwcDisplay.h"
 
+#include <climits>
+#include <cmath>
+#include <utility>
+
 #include "DrmHwcTwo.h"
 #include "backend/Backend.h"
 #include "backend/BackendManager.h"
@@ -41,6 +45,8 @@ std::string HwcDisplay::DumpDelta(HwcDisplay::Stats delta) {
              ? " !!! Internal failure, FIX it please\n"
              : "")
      << " Flattened frames: " << delta.frames_flattened_ << "\n"
+     << " Frames over plane budget: " << delta.frames_budget_limited_ << "\n"
+     << " Idle refresh rate drops: " << delta.idle_refresh_drops_ << "\n"
      << " Pixel operations (free units)"
      << " : [TOTAL: " << delta.total_pixops_ << " / GPU: " << delta.gpu_pixops_
      << "]\n"
@@ -49,6 +55,19 @@ std::string HwcDisplay::DumpDelta(HwcDisplay::Stats delta) {
   return ss.str();
 }
 
+static auto DumpPowerTransitions(DrmAtomicStateManager &dasm) -> std::string {
+  constexpr int64_t kNsInUs = 1000;
+  auto dump = [](const DrmAtomicStateManager::PowerTransitionStats &stats) {
+    std::stringstream ss;
+    ss << stats.count << " (latency last: " << stats.last_ns / kNsInUs
+       << "us, worst: " << stats.max_ns / kNsInUs << "us)\n";
+    return ss.str();
+  };
+
+  return "Power transitions:\n On: " + dump(dasm.GetPowerOnStats()) +
+         " Off: " + dump(dasm.GetPowerOffStats());
+}
+
 std::string HwcDisplay::Dump() {
   auto connector_name = IsInHeadlessMode()
                             ? std::string("NULL-DISPLAY")
@@ -61,13 +80,25 @@ std::string HwcDisplay::Dump() {
      << "Statistics since last dumpsys request:\n"
      << DumpDelta(total_stats_.minus(prev_stats_)) << "\n\n";
 
+  if (!IsInHeadlessMode()) {
+    auto &dasm = *GetPipe().atomic_state_manager;
+    ss << dasm.GetPresentTiming().Dump() << "\n"
+       << DumpPowerTransitions(dasm) << "\n";
+  }
+
+  ss << bandwidth_.Dump() << "\n";
+
   memcpy(&prev_stats_, &total_stats_, sizeof(Stats));
   return ss.str();
 }
 
 HwcDisplay::HwcDisplay(hwc2_display_t handle, HWC2::DisplayType type,
                        DrmHwcTwo *hwc2)
-    : hwc2_(hwc2), handle_(handle), type_(type), client_layer_(this){};
+    : hwc2_(hwc2),
+      handle_(handle),
+      type_(type),
+      client_layer_(this),
+      bandwidth_("display" + std::to_string(handle)){};
 
 void HwcDisplay::SetColorMarixToIdentity() {
   color_matrix_ = std::make_shared<drm_color_ctm>();
@@ -121,13 +152,17 @@ void HwcDisplay::Deinit() {
     current_plan_.reset();
     backend_.reset();
     if (flatcon_) {
-      flatcon_->StopThread();
+      flatcon_->Stop();
       flatcon_.reset();
     }
+    if (idlecon_) {
+      idlecon_->Stop();
+      idlecon_.reset();
+    }
   }
 
   if (vsync_worker_) {
-    vsync_worker_->StopThread();
+    vsync_worker_->Stop();
     vsync_worker_ = {};
   }
 
@@ -136,36 +171,37 @@ void HwcDisplay::Deinit() {
 
 HWC2::Error HwcDisplay::Init() {
   ChosePreferredConfig();
+  PublishVSyncState();
 
   auto vsw_callbacks = (VSyncWorkerCallbacks){
       .out_event =
           [this](int64_t timestamp) {
-            const std::unique_lock lock(hwc2_->GetResMan().GetMainLock());
-            if (vsync_event_en_) {
-              uint32_t period_ns{};
-              GetDisplayVsyncPeriod(&period_ns);
-              hwc2_->SendVsyncEventToClient(handle_, timestamp, period_ns);
+            if (client_vsync_en_) {
+              hwc2_->SendVsyncEventToClient(handle_, timestamp,
+                                            vsync_period_ns_);
             }
             if (vsync_tracking_en_) {
               last_vsync_ts_ = timestamp;
             }
-            if (!vsync_event_en_ && !vsync_tracking_en_) {
-              vsync_worker_->VSyncControl(false);
-            }
           },
-      .get_vperiod_ns = [this]() -> uint32_t {
-        uint32_t outVsyncPeriod = 0;
-        GetDisplayVsyncPeriod(&outVsyncPeriod);
-        return outVsyncPeriod;
-      },
+      .get_vperiod_ns = [this]() -> uint32_t { return vsync_period_ns_; },
   };
 
-  vsync_worker_ = VSyncWorker::CreateInstance(pipeline_, vsw_callbacks);
+  vsync_worker_ = VSyncWorker::CreateInstance(
+      pipeline_, hwc2_->GetResMan().GetVSyncReactor(), vsw_callbacks);
   if (!vsync_worker_) {
     ALOGE("Failed to create event worker for d=%d\n", int(handle_));
     return HWC2::Error::BadDisplay;
   }
 
+  /* Consumers survive pipeline changes */
+  if (IsClientVSyncWanted())
+    vsync_worker_->AddConsumer(VSyncConsumer::kClient);
+  if (vsync_tracking_en_)
+    vsync_worker_->AddConsumer(VSyncConsumer::kPeriodTracking);
+  if (staged_mode_)
+    vsync_worker_->AddConsumer(VSyncConsumer::kCommitScheduling);
+
   if (!IsInHeadlessMode()) {
     auto ret = BackendManager::GetInstance().SetBackendForDisplay(this);
     if (ret) {
@@ -178,7 +214,27 @@ HWC2::Error HwcDisplay::Init() {
         hwc2_->refresh_callback_.first(hwc2_->refresh_callback_.second,
                                        handle_);
     }};
-    flatcon_ = FlatteningController::CreateInstance(flatcbk);
+    flatcon_ = FlatteningController::CreateInstance(
+        hwc2_->GetResMan().GetReactor(), flatcbk);
+    if (!flatcon_) {
+      ALOGE("Failed to create flattening controller for d=%d\n", int(handle_));
+      return HWC2::Error::BadDisplay;
+    }
+
+    auto idle_period = hwc2_->GetResMan().GetIdleRefreshPeriod();
+    if (idle_period.count() != 0) {
+      auto idlecbk = (struct IdleRefreshCallbacks){.idle = [this]() {
+        const std::unique_lock lock(hwc2_->GetResMan().GetMainLock());
+        EnterIdleRefresh();
+      }};
+      idlecon_ = IdleRefreshController::CreateInstance(
+          hwc2_->GetResMan().GetReactor(), idle_period, idlecbk);
+      if (!idlecon_) {
+        ALOGE("Failed to create idle refresh controller for d=%d\n",
+              int(handle_));
+        return HWC2::Error::BadDisplay;
+      }
+    }
   }
 
   client_layer_.SetLayerBlendMode(HWC2_BLEND_MODE_PREMULTIPLIED);
@@ -191,7 +247,7 @@ HWC2::Error HwcDisplay::Init() {
 HWC2::Error HwcDisplay::ChosePreferredConfig() {
   HWC2::Error err{};
   if (!IsInHeadlessMode()) {
-    err = configs_.Update(*pipeline_->connector->Get());
+    err = configs_.Update(*pipeline_);
   } else {
     configs_.FillHeadless();
   }
@@ -199,9 +255,62 @@ HWC2::Error HwcDisplay::ChosePreferredConfig() {
     return HWC2::Error::BadDisplay;
   }
 
+  /* Config ids are reassigned */
+  frame_config_id_.reset();
+  rejected_config_ids_.clear();
+  content_rate_config_.reset();
+
+  if (!IsInHeadlessMode() && !boot_mode_checked_) {
+    boot_mode_checked_ = true;
+    auto boot_config_id = GetBootConfig();
+    if (boot_config_id) {
+      AdoptBootConfig(*boot_config_id);
+      return HWC2::Error::None;
+    }
+  }
+
   return SetActiveConfig(configs_.preferred_config_id);
 }
 
+/* Config of the mode the firmware has lit the display in, if it's one of the
+ * connector modes
+ */
+auto HwcDisplay::GetBootConfig() -> std::optional<uint32_t> {
+  auto &mode = GetPipe().atomic_state_manager->GetAdoptedMode();
+  if (!mode)
+    return {};
+
+  for (auto &[id, config] : configs_.hwc_configs) {
+    if (!config.disabled && config.mode.HasSameTimings(*mode))
+      return id;
+  }
+
+  ALOGI("Firmware mode %s is not a known config", mode->GetName().c_str());
+  return {};
+}
+
+/* The CRTC runs the mode already, so no mode is staged and the first frame
+ * is a plain flip keeping the splash on screen until then
+ */
+void HwcDisplay::AdoptBootConfig(uint32_t config_id) {
+  auto &config = configs_.hwc_configs[config_id];
+  ALOGI("Keeping the firmware mode %s", config.mode.GetName().c_str());
+
+  staged_mode_.reset();
+  staged_mode_config_id_ = config_id;
+  configs_.active_config_id = config_id;
+  PublishVSyncState();
+
+  client_layer_.SetLayerDisplayFrame(
+      (hwc_rect_t){.left = 0,
+                   .top = 0,
+                   .right = int(configs_.GetUiWidth(config)),
+                   .bottom = int(configs_.GetUiHeight(config))});
+
+  const auto &mode = config.mode.GetRawMode();
+  GetPipe().ProbePlaneScaling(mode.hdisplay, mode.vdisplay);
+}
+
 HWC2::Error HwcDisplay::AcceptDisplayChanges() {
   for (std::pair<const hwc2_layer_t, HwcLayer> &l : layers_)
     l.second.AcceptTypeChange();
@@ -306,10 +415,10 @@ HWC2::Error HwcDisplay::GetDisplayAttribute(hwc2_config_t config,
   auto attribute = static_cast<HWC2::Attribute>(attribute_in);
   switch (attribute) {
     case HWC2::Attribute::Width:
-      *value = static_cast<int>(hwc_config.mode.GetRawMode().hdisplay);
+      *value = static_cast<int>(configs_.GetUiWidth(hwc_config));
       break;
     case HWC2::Attribute::Height:
-      *value = static_cast<int>(hwc_config.mode.GetRawMode().vdisplay);
+      *value = static_cast<int>(configs_.GetUiHeight(hwc_config));
       break;
     case HWC2::Attribute::VsyncPeriod:
       // in nanoseconds
@@ -317,13 +426,13 @@ HWC2::Error HwcDisplay::GetDisplayAttribute(hwc2_config_t config,
       break;
     case HWC2::Attribute::DpiX:
       // Dots per 1000 inches
-      *value = mm_width ? int(hwc_config.mode.GetRawMode().hdisplay *
-                              kUmPerInch / mm_width)
+      *value = mm_width ? int(configs_.GetUiWidth(hwc_config) * kUmPerInch /
+                              mm_width)
                         : -1;
       break;
     case HWC2::Attribute::DpiY:
       // Dots per 1000 inches
-      *value = mm_height ? int(hwc_config.mode.GetRawMode().vdisplay *
+      *value = mm_height ? int(configs_.GetUiHeight(hwc_config) *
                                kUmPerInch / mm_height)
                          : -1;
       break;
@@ -397,19 +506,51 @@ HWC2::Error HwcDisplay::GetDisplayType(int32_t *type) {
 }
 
 HWC2::Error HwcDisplay::GetDozeSupport(int32_t *support) {
-  *support = 0;
+  /* Always-on display is a panel feature */
+  *support = !IsInHeadlessMode() && GetPipe().connector->Get()->IsInternal()
+                 ? 1
+                 : 0;
   return HWC2::Error::None;
 }
 
 HWC2::Error HwcDisplay::GetHdrCapabilities(uint32_t *num_types,
-                                           int32_t * /*types*/,
-                                           float * /*max_luminance*/,
-                                           float * /*max_average_luminance*/,
-                                           float * /*min_luminance*/) {
-  *num_types = 0;
+                                           int32_t *types,
+                                           float *max_luminance,
+                                           float *max_average_luminance,
+                                           float *min_luminance) {
+  std::vector<int32_t> hdr_types;
+  const auto *caps = GetConnectorHdrCapabilities();
+  if (caps != nullptr) {
+    if (caps->st2084)
+      hdr_types.emplace_back(HAL_HDR_HDR10);
+    if (caps->hlg)
+      hdr_types.emplace_back(HAL_HDR_HLG);
+  }
+
+  if (types == nullptr) {
+    *num_types = hdr_types.size();
+    return HWC2::Error::None;
+  }
+
+  *num_types = std::min(*num_types, uint32_t(hdr_types.size()));
+  std::copy_n(hdr_types.begin(), *num_types, types);
+  if (caps != nullptr) {
+    *max_luminance = caps->max_luminance;
+    *max_average_luminance = caps->max_average_luminance;
+    *min_luminance = caps->min_luminance;
+  }
   return HWC2::Error::None;
 }
 
+auto HwcDisplay::GetConnectorHdrCapabilities()
+    -> const DrmConnector::HdrCapabilities * {
+  if (IsInHeadlessMode())
+    return nullptr;
+
+  const auto &caps = GetPipe().connector->Get()->GetHdrCapabilities();
+  return caps ? &*caps : nullptr;
+}
+
 /* Find API details at:
  * https://cs.android.com/android/platform/superproject/+/android-11.0.0_r3:hardware/libhardware/include/hardware/hwcomposer2.h;l=1767
  *
@@ -463,13 +604,16 @@ HWC2::Error HwcDisplay::CreateComposition(AtomicCommitArgs &a_args) {
   auto mode_update_commited_ = false;
   if (staged_mode_ &&
       staged_mode_change_time_ <= ResourceManager::GetTimeMonotonicNs()) {
+    auto &staged_config = configs_.hwc_configs[staged_mode_config_id_];
+    configs_.active_config_id = staged_mode_config_id_;
+    PublishVSyncState();
+
+    /* Scaled up to the mode size if the framework renders at a lower one */
     client_layer_.SetLayerDisplayFrame(
         (hwc_rect_t){.left = 0,
                      .top = 0,
-                     .right = int(staged_mode_->GetRawMode().hdisplay),
-                     .bottom = int(staged_mode_->GetRawMode().vdisplay)});
-
-    configs_.active_config_id = staged_mode_config_id_;
+                     .right = int(configs_.GetUiWidth(staged_config)),
+                     .bottom = int(configs_.GetUiHeight(staged_config))});
 
     a_args.display_mode = *staged_mode_;
     if (!a_args.test_only) {
@@ -477,20 +621,37 @@ HWC2::Error HwcDisplay::CreateComposition(AtomicCommitArgs &a_args) {
     }
   }
 
+  /* A config staged by the client goes first */
+  if (!staged_mode_ && frame_config_id_ &&
+      *frame_config_id_ != configs_.active_config_id)
+    a_args.display_mode = configs_.hwc_configs[*frame_config_id_].mode;
+
+  MapUiFrames();
+
   // order the layers by z-order
   bool use_client_layer = false;
   uint32_t client_z_order = UINT32_MAX;
+  /* Bounding box of the client layers, the rest of the client target is
+   * transparent and needs no scanout */
+  hwc_rect_t client_region = {INT_MAX, INT_MAX, INT_MIN, INT_MIN};
   std::map<uint32_t, HwcLayer *> z_map;
   for (std::pair<const hwc2_layer_t, HwcLayer> &l : layers_) {
     switch (l.second.GetValidatedType()) {
       case HWC2::Composition::Device:
-        z_map.emplace(l.second.GetZOrder(), &l.second);
+        if (!l.second.IsCulled())
+          z_map.emplace(l.second.GetZOrder(), &l.second);
         break;
-      case HWC2::Composition::Client:
+      case HWC2::Composition::Client: {
         // Place it at the z_order of the lowest client layer
         use_client_layer = true;
         client_z_order = std::min(client_z_order, l.second.GetZOrder());
+        auto &df = l.second.GetLayerData().pi.display_frame;
+        client_region.left = std::min(client_region.left, df.left);
+        client_region.top = std::min(client_region.top, df.top);
+        client_region.right = std::max(client_region.right, df.right);
+        client_region.bottom = std::max(client_region.bottom, df.bottom);
         break;
+      }
       default:
         continue;
     }
@@ -521,6 +682,20 @@ HWC2::Error HwcDisplay::CreateComposition(AtomicCommitArgs &a_args) {
       return HWC2::Error::BadLayer;
     }
     composition_layers.emplace_back(l.second->GetLayerData());
+    composition_layers.back().pi.output_transfer = output_transfer_;
+    composition_layers.back().client_target = l.second == &client_layer_;
+    if (l.second->GetPlaneClip()) {
+      composition_layers.back().pi.ClipDisplayFrame(*l.second->GetPlaneClip());
+    }
+    /* The bottom-most layer goes to the primary plane, which some drivers
+     * require to cover the whole CRTC
+     */
+    if (l.second == &client_layer_ && l.first != z_map.begin()->first) {
+      /* Keeps the whole target if the client layers are off-screen */
+      auto pi = composition_layers.back().pi;
+      if (pi.ClipDisplayFrame(client_region))
+        composition_layers.back().pi = pi;
+    }
   }
 
   /* Store plan to ensure shared planes won't be stolen by other display
@@ -536,6 +711,14 @@ HWC2::Error HwcDisplay::CreateComposition(AtomicCommitArgs &a_args) {
   }
 
   a_args.composition = current_plan_;
+  a_args.output_transfer = output_transfer_;
+  for (const auto &joining : current_plan_->plan) {
+    const auto &bi = joining.layer.bi;
+    if (bi && bi->transfer == output_transfer_) {
+      a_args.hdr_metadata = bi->hdr_metadata;
+      break;
+    }
+  }
 
   auto ret = GetPipe().atomic_state_manager->ExecuteAtomicCommit(a_args);
 
@@ -546,8 +729,16 @@ HWC2::Error HwcDisplay::CreateComposition(AtomicCommitArgs &a_args) {
   }
 
   if (mode_update_commited_) {
+    /* Planes can be tested only on an active CRTC */
+    const auto &mode = a_args.display_mode->GetRawMode();
+    GetPipe().ProbePlaneScaling(mode.hdisplay, mode.vdisplay);
+
     staged_mode_.reset();
-    vsync_tracking_en_ = false;
+    vsync_worker_->RemoveConsumer(VSyncConsumer::kCommitScheduling);
+    if (vsync_tracking_en_) {
+      vsync_tracking_en_ = false;
+      vsync_worker_->RemoveConsumer(VSyncConsumer::kPeriodTracking);
+    }
     if (last_vsync_ts_ != 0) {
       hwc2_->SendVsyncPeriodTimingChangedEventToClient(handle_,
                                                        last_vsync_ts_ +
@@ -568,11 +759,31 @@ HWC2::Error HwcDisplay::PresentDisplay(int32_t *out_present_fence) {
   }
   HWC2::Error ret{};
 
+  const ScopedThreadPolicy commit_policy(
+      hwc2_->GetResMan().GetCommitThreadPolicy());
+
   ++total_stats_.total_frames_;
 
+  if (idlecon_)
+    idlecon_->NewFrame();
+
   AtomicCommitArgs a_args{};
   ret = CreateComposition(a_args);
 
+  /* Tested alone when selected, the config may still fail with the planes */
+  if (ret != HWC2::Error::None && ret != HWC2::Error::BadLayer &&
+      !staged_mode_ && frame_config_id_ &&
+      *frame_config_id_ != configs_.active_config_id &&
+      *frame_config_id_ != staged_mode_config_id_) {
+    ALOGW("Config %u failed, presenting at the client's one",
+          *frame_config_id_);
+    rejected_config_ids_.insert(*frame_config_id_);
+    content_rate_config_.reset();
+    frame_config_id_ = staged_mode_config_id_;
+    a_args = {};
+    ret = CreateComposition(a_args);
+  }
+
   if (ret != HWC2::Error::None)
     ++total_stats_.failed_kms_present_;
 
@@ -584,9 +795,20 @@ HWC2::Error HwcDisplay::PresentDisplay(int32_t *out_present_fence) {
   if (ret != HWC2::Error::None)
     return ret;
 
+  if (!staged_mode_ && frame_config_id_ &&
+      *frame_config_id_ != configs_.active_config_id) {
+    configs_.active_config_id = *frame_config_id_;
+    PublishVSyncState();
+    /* Not requested by the client, still changes its vsync period */
+    hwc2_->SendVsyncPeriodTimingChangedEventToClient(
+        handle_, ResourceManager::GetTimeMonotonicNs());
+  }
+
   this->present_fence_ = a_args.out_fence;
   *out_present_fence = DupFd(a_args.out_fence);
 
+  UpdateBandwidth();
+
   // Reset the color matrix so we don't apply it over and over again.
   color_matrix_ = {};
 
@@ -594,6 +816,75 @@ HWC2::Error HwcDisplay::PresentDisplay(int32_t *out_present_fence) {
   return HWC2::Error::None;
 }
 
+auto HwcDisplay::UiToModeFrame(const hwc_rect_t &frame) -> hwc_rect_t {
+  const auto config_id = GetCommitConfigId();
+  if (configs_.hwc_configs.count(config_id) == 0)
+    return frame;
+
+  auto &config = configs_.hwc_configs[config_id];
+  if (config.ui_scale_percent == kFullUiScalePercent)
+    return frame;
+
+  const int64_t ui_w = configs_.GetUiWidth(config);
+  const int64_t ui_h = configs_.GetUiHeight(config);
+  if (ui_w == 0 || ui_h == 0)
+    return frame;
+
+  const int64_t w = configs_.GetWidth(config);
+  const int64_t h = configs_.GetHeight(config);
+  return (hwc_rect_t){.left = int(frame.left * w / ui_w),
+                      .top = int(frame.top * h / ui_h),
+                      .right = int(frame.right * w / ui_w),
+                      .bottom = int(frame.bottom * h / ui_h)};
+}
+
+void HwcDisplay::MapUiFrames() {
+  for (auto &[id, layer] : layers_)
+    layer.MapUiFrames();
+  client_layer_.MapUiFrames();
+}
+
+auto HwcDisplay::GetCommitConfigId() -> uint32_t {
+  /* The staged mode is applied by the next composition */
+  if (staged_mode_)
+    return staged_mode_change_time_ <= ResourceManager::GetTimeMonotonicNs()
+               ? staged_mode_config_id_
+               : configs_.active_config_id;
+
+  return frame_config_id_.value_or(configs_.active_config_id);
+}
+
+auto HwcDisplay::GetScreenRect() -> hwc_rect_t {
+  auto config_id = GetCommitConfigId();
+  if (configs_.hwc_configs.count(config_id) == 0)
+    return {0, 0, INT_MAX, INT_MAX};
+
+  auto &config = configs_.hwc_configs[config_id];
+  return {0, 0, int(configs_.GetWidth(config)),
+          int(configs_.GetHeight(config))};
+}
+
+void HwcDisplay::UpdateBandwidth() {
+  if (!current_plan_)
+    return;
+
+  std::vector<LayerData *> client_layers;
+  for (auto &l : layers_) {
+    if (l.second.GetValidatedType() == HWC2::Composition::Client)
+      client_layers.emplace_back(&l.second.GetLayerData());
+  }
+
+  uint32_t vperiod_ns = 0;
+  GetDisplayVsyncPeriod(&vperiod_ns);
+
+  auto *client_target = client_layers.empty() ? nullptr
+                                              : &client_layer_.GetLayerData();
+  bandwidth_.OnFrame(BandwidthEstimator::EstimateFrame(*current_plan_,
+                                                       client_layers,
+                                                       client_target),
+                     vperiod_ns);
+}
+
 HWC2::Error HwcDisplay::SetActiveConfigInternal(uint32_t config,
                                                 int64_t change_time) {
   if (configs_.hwc_configs.count(config) == 0) {
@@ -601,6 +892,16 @@ HWC2::Error HwcDisplay::SetActiveConfigInternal(uint32_t config,
     return HWC2::Error::BadConfig;
   }
 
+  /* Scaling limits may have been probed after the config was reported */
+  if (!IsInHeadlessMode() &&
+      !configs_.IsUiScaleSupported(GetPipe(), configs_.hwc_configs[config])) {
+    ALOGE("Planes can't scale the client target of config %u up", config);
+    return HWC2::Error::BadConfig;
+  }
+
+  if (!staged_mode_ && vsync_worker_)
+    vsync_worker_->AddConsumer(VSyncConsumer::kCommitScheduling);
+
   staged_mode_ = configs_.hwc_configs[config].mode;
   staged_mode_change_time_ = change_time;
   staged_mode_config_id_ = config;
@@ -629,6 +930,9 @@ HWC2::Error HwcDisplay::SetClientTarget(buffer_handle_t target,
    */
   if (target == nullptr) {
     client_layer_.SwChainClearCache();
+    /* Drop the last FB as well, the DRM device may go away with the pipeline */
+    client_layer_.GetLayerData().fb = {};
+    client_layer_.GetLayerData().bi = {};
     return HWC2::Error::None;
   }
 
@@ -738,32 +1042,50 @@ HWC2::Error HwcDisplay::SetPowerMode(int32_t mode_in) {
       a_args.active = false;
       break;
     case HWC2::PowerMode::On:
-      a_args.active = true;
-      break;
     case HWC2::PowerMode::Doze:
     case HWC2::PowerMode::DozeSuspend:
-      return HWC2::Error::Unsupported;
+      a_args.active = true;
+      break;
     default:
       ALOGE("Incorrect power mode value (%d)\n", mode);
       return HWC2::Error::BadParameter;
   }
 
+  if (mode == HWC2::PowerMode::Doze || mode == HWC2::PowerMode::DozeSuspend) {
+    int32_t doze_support = 0;
+    GetDozeSupport(&doze_support);
+    if (doze_support == 0)
+      return HWC2::Error::Unsupported;
+  }
+
   if (IsInHeadlessMode()) {
     return HWC2::Error::None;
   }
 
-  if (a_args.active && *a_args.active) {
-    /*
-     * Setting the display to active before we have a composition
-     * can break some drivers, so skip setting a_args.active to
-     * true, as the next composition frame will implicitly activate
-     * the display
-     */
-    return GetPipe().atomic_state_manager->ActivateDisplayUsingDPMS() == 0
-               ? HWC2::Error::None
-               : HWC2::Error::BadParameter;
-  };
+  const auto prev_mode = power_mode_;
+  const auto client_vsync = IsClientVSyncWanted();
+  power_mode_ = mode;
+  PublishVSyncState();
+  if (client_vsync != IsClientVSyncWanted()) {
+    if (IsClientVSyncWanted())
+      vsync_worker_->AddConsumer(VSyncConsumer::kClient);
+    else
+      vsync_worker_->RemoveConsumer(VSyncConsumer::kClient);
+  }
+
+  /* Always-on content is static, don't wake the client up to flatten it */
+  if (IsDozing() && flatcon_)
+    flatcon_->Disable();
 
+  /* The CRTC stays active between On and the doze modes, the refresh rate
+   * switch is committed with the next frame
+   */
+  if (*a_args.active && prev_mode != HWC2::PowerMode::Off)
+    return HWC2::Error::None;
+
+  /* Planes keep the last frame while the display is off, so it lights up
+   * with that frame without waiting for a new one
+   */
   auto err = GetPipe().atomic_state_manager->ExecuteAtomicCommit(a_args);
   if (err) {
     ALOGE("Failed to apply the dpms composition err=%d", err);
@@ -772,10 +1094,193 @@ HWC2::Error HwcDisplay::SetPowerMode(int32_t mode_in) {
   return HWC2::Error::None;
 }
 
+auto HwcDisplay::GetLowestRefreshConfig(uint32_t config_id) -> uint32_t {
+  const auto &base = configs_.hwc_configs[config_id];
+  auto lowest = config_id;
+  for (auto &[id, config] : configs_.hwc_configs) {
+    if (config.group_id == base.group_id &&
+        config.ui_scale_percent == base.ui_scale_percent && !config.disabled &&
+        config.mode.GetVRefresh() <
+            configs_.hwc_configs[lowest].mode.GetVRefresh())
+      lowest = id;
+  }
+
+  return lowest;
+}
+
+/* Static content is refreshed at the lowest rate of the active config group.
+ * Switched without a frame from the client, so the commit carries the mode
+ * alone and the planes keep scanning out the last frame. The next frame goes
+ * back to GetFrameConfig().
+ */
+void HwcDisplay::EnterIdleRefresh() {
+  if (IsInHeadlessMode() || power_mode_ != HWC2::PowerMode::On ||
+      staged_mode_ ||
+      configs_.hwc_configs.count(configs_.active_config_id) == 0)
+    return;
+
+  const auto active_config_id = configs_.active_config_id;
+  const auto idle_config_id = GetLowestRefreshConfig(active_config_id);
+  if (idle_config_id == active_config_id)
+    return;
+
+  /* A failed commit would take the planes down */
+  AtomicCommitArgs a_args{
+      .test_only = true,
+      .display_mode = configs_.hwc_configs[idle_config_id].mode,
+      .seamless = true,
+  };
+  if (GetPipe().atomic_state_manager->ExecuteAtomicCommit(a_args) != 0)
+    return;
+
+  a_args.test_only = false;
+  if (GetPipe().atomic_state_manager->ExecuteAtomicCommit(a_args) != 0)
+    return;
+
+  ALOGI("Idle, refreshing at %s",
+        configs_.hwc_configs[idle_config_id].mode.GetName().c_str());
+  configs_.active_config_id = idle_config_id;
+  PublishVSyncState();
+  total_stats_.idle_refresh_drops_++;
+  hwc2_->SendVsyncPeriodTimingChangedEventToClient(
+      handle_, ResourceManager::GetTimeMonotonicNs());
+}
+
+/* Config the frame is presented at: the client's one, or one of its group
+ * refreshing at a multiple of the video rate. Playing films at 60 Hz repeats
+ * frames unevenly, 3:2 pulldown judder. Dozing panels refresh at the lowest
+ * rate of the group. The client's config stays as it is either way.
+ */
+auto HwcDisplay::GetFrameConfig() -> uint32_t {
+  const auto client_config_id = staged_mode_config_id_;
+  if (configs_.hwc_configs.count(client_config_id) == 0)
+    return client_config_id;
+
+  if (IsDozing()) {
+    const auto doze_config_id = GetLowestRefreshConfig(client_config_id);
+    if (rejected_config_ids_.count(doze_config_id) != 0)
+      return client_config_id;
+
+    if (doze_config_id != configs_.active_config_id)
+      ALOGI("Dozing at %s",
+            configs_.hwc_configs[doze_config_id].mode.GetName().c_str());
+    return doze_config_id;
+  }
+
+  const auto rate = content_type_ == HWC2::ContentType::Cinema
+                        ? content_rate_.GetRate()
+                        : 0;
+  if (rate == 0)
+    return client_config_id;
+
+  if (!content_rate_config_ || content_rate_config_->rate != rate ||
+      content_rate_config_->client_config_id != client_config_id) {
+    content_rate_config_ = {
+        .rate = rate,
+        .client_config_id = client_config_id,
+        .config_id = SelectContentRateConfig(client_config_id, rate),
+    };
+  }
+
+  return content_rate_config_->config_id;
+}
+
+/* Lowest refresh rate config switched to without a modeset, the active one
+ * included. A modeset blanks the display in the middle of the playback.
+ */
+auto HwcDisplay::SelectContentRateConfig(uint32_t client_config_id,
+                                         uint32_t rate) -> uint32_t {
+  /* Covers the 1000/1001 rates */
+  constexpr float kTolerance = 0.005F;
+
+  const auto &client_config = configs_.hwc_configs[client_config_id];
+  std::optional<float> best_refresh;
+  auto best = client_config_id;
+  for (auto &[id, config] : configs_.hwc_configs) {
+    if (config.group_id != client_config.group_id ||
+        config.ui_scale_percent != client_config.ui_scale_percent ||
+        config.disabled || rejected_config_ids_.count(id) != 0)
+      continue;
+
+    const auto refresh = config.mode.GetVRefresh();
+    const auto multiple = std::round(refresh / float(rate));
+    if (multiple < 1.0F ||
+        std::abs(refresh / float(rate) - multiple) > kTolerance * multiple)
+      continue;
+
+    AtomicCommitArgs a_args{
+        .test_only = true,
+        .display_mode = config.mode,
+        .seamless = true,
+    };
+    if (id != configs_.active_config_id &&
+        GetPipe().atomic_state_manager->ExecuteAtomicCommit(a_args) != 0)
+      continue;
+
+    if (!best_refresh || refresh < *best_refresh) {
+      best_refresh = refresh;
+      best = id;
+    }
+  }
+
+  if (best != client_config_id)
+    ALOGI("Playing %u fps video at %s", rate,
+          configs_.hwc_configs[best].mode.GetName().c_str());
+
+  return best;
+}
+
+/* Feeds the frame rate estimator with the biggest video layer */
+void HwcDisplay::UpdateContentRate() {
+  if (content_type_ != HWC2::ContentType::Cinema)
+    return;
+
+  std::optional<hwc2_layer_t> video_layer_id;
+  int64_t video_area = 0;
+  for (auto &[id, layer] : layers_) {
+    const auto &bi = layer.GetLayerData().bi;
+    if (!bi || !BufferInfoGetter::IsDrmFormatYuv(bi->format))
+      continue;
+
+    const auto &df = layer.GetLayerData().pi.display_frame;
+    const auto area = int64_t(df.right - df.left) * (df.bottom - df.top);
+    if (area > video_area) {
+      video_area = area;
+      video_layer_id = id;
+    }
+  }
+
+  if (video_layer_id != video_layer_id_) {
+    video_layer_id_ = video_layer_id;
+    video_buffer_ = {};
+    content_rate_.Reset();
+  }
+
+  if (!video_layer_id)
+    return;
+
+  auto *buffer = layers_.at(*video_layer_id).GetBufferHandle();
+  if (buffer != video_buffer_) {
+    video_buffer_ = buffer;
+    content_rate_.OnNewBuffer(ResourceManager::GetTimeMonotonicNs());
+  }
+}
+
 HWC2::Error HwcDisplay::SetVsyncEnabled(int32_t enabled) {
-  vsync_event_en_ = HWC2_VSYNC_ENABLE == enabled;
-  if (vsync_event_en_) {
-    vsync_worker_->VSyncControl(true);
+  auto enable = HWC2_VSYNC_ENABLE == enabled;
+  if (enable == vsync_event_en_)
+    return HWC2::Error::None;
+
+  const auto client_vsync = IsClientVSyncWanted();
+  vsync_event_en_ = enable;
+  PublishVSyncState();
+  if (client_vsync == IsClientVSyncWanted())
+    return HWC2::Error::None;
+
+  if (IsClientVSyncWanted()) {
+    vsync_worker_->AddConsumer(VSyncConsumer::kClient);
+  } else {
+    vsync_worker_->RemoveConsumer(VSyncConsumer::kClient);
   }
   return HWC2::Error::None;
 }
@@ -796,6 +1301,15 @@ HWC2::Error HwcDisplay::ValidateDisplay(uint32_t *num_types,
                                        HWC2::Composition::Client);
   }
 
+  /* Before the test commit of the backend, so it tests the frame's mode */
+  UpdateContentRate();
+  frame_config_id_.reset();
+  if (!staged_mode_ && power_mode_ != HWC2::PowerMode::Off)
+    frame_config_id_ = GetFrameConfig();
+
+  /* Before culling, which works in the mode coordinates */
+  MapUiFrames();
+
   return backend_->ValidateDisplay(this, num_types, num_requests);
 }
 
@@ -815,6 +1329,16 @@ std::vector<HwcLayer *> HwcDisplay::GetOrderLayersByZPos() {
   return ordered_layers;
 }
 
+void HwcDisplay::PublishVSyncState() {
+  client_vsync_en_ = IsClientVSyncWanted();
+
+  /* Zero falls back to the default period */
+  uint32_t period_ns = 0;
+  if (configs_.hwc_configs.count(configs_.active_config_id) != 0)
+    GetDisplayVsyncPeriod(&period_ns);
+  vsync_period_ns_ = period_ns;
+}
+
 HWC2::Error HwcDisplay::GetDisplayVsyncPeriod(
     uint32_t *outVsyncPeriod /* ns */) {
   return GetDisplayAttribute(configs_.active_config_id,
@@ -869,8 +1393,10 @@ HWC2::Error HwcDisplay::SetActiveConfigWithConstraints(
                                               ->desiredTimeNanos;
 
   last_vsync_ts_ = 0;
-  vsync_tracking_en_ = true;
-  vsync_worker_->VSyncControl(true);
+  if (!vsync_tracking_en_) {
+    vsync_tracking_en_ = true;
+    vsync_worker_->AddConsumer(VSyncConsumer::kPeriodTracking);
+  }
 
   return HWC2::Error::None;
 }
@@ -881,17 +1407,25 @@ HWC2::Error HwcDisplay::SetAutoLowLatencyMode(bool /*on*/) {
 
 HWC2::Error HwcDisplay::GetSupportedContentTypes(
     uint32_t *outNumSupportedContentTypes,
-    const uint32_t *outSupportedContentTypes) {
-  if (outSupportedContentTypes == nullptr)
-    *outNumSupportedContentTypes = 0;
+    uint32_t *outSupportedContentTypes) {
+  /* Refresh rate follows the video */
+  if (outSupportedContentTypes != nullptr && *outNumSupportedContentTypes > 0)
+    outSupportedContentTypes[0] = HWC2_CONTENT_TYPE_CINEMA;
 
+  *outNumSupportedContentTypes = 1;
   return HWC2::Error::None;
 }
 
 HWC2::Error HwcDisplay::SetContentType(int32_t contentType) {
-  if (contentType != HWC2_CONTENT_TYPE_NONE)
+  if (contentType != HWC2_CONTENT_TYPE_NONE &&
+      contentType != HWC2_CONTENT_TYPE_CINEMA)
     return HWC2::Error::Unsupported;
 
+  /* The next frame goes back to the client's config for other content */
+  content_type_ = static_cast<HWC2::ContentType>(contentType);
+  video_layer_id_.reset();
+  content_rate_.Reset();
+
   /* TODO: Map to the DRM Connector property:
    * https://elixir.bootlin.com/linux/v5.4-rc5/source/drivers/gpu/drm/drm_connector.c#L809
    */
@@ -984,6 +1518,28 @@ HWC2::Error HwcDisplay::GetRenderIntents(
   return HWC2::Error::None;
 }
 
+HWC2::Error HwcDisplay::GetPerFrameMetadataKeys(uint32_t *num_keys,
+                                                int32_t *keys) {
+  /* HDR static metadata, HWC2_DISPLAY_RED_PRIMARY_X ..
+   * HWC2_MAX_FRAME_AVERAGE_LIGHT_LEVEL
+   */
+  constexpr uint32_t kNumStaticKeys = HWC2_MAX_FRAME_AVERAGE_LIGHT_LEVEL + 1;
+  const uint32_t count = GetConnectorHdrCapabilities() != nullptr
+                             ? kNumStaticKeys
+                             : 0;
+
+  if (keys == nullptr) {
+    *num_keys = count;
+    return HWC2::Error::None;
+  }
+
+  *num_keys = std::min(*num_keys, count);
+  for (uint32_t i = 0; i < *num_keys; i++)
+    keys[i] = int32_t(i);
+
+  return HWC2::Error::None;
+}
+
 HWC2::Error HwcDisplay::SetColorModeWithIntent(int32_t mode, int32_t intent) {
   if (intent < HAL_RENDER_INTENT_COLORIMETRIC ||
       intent > HAL_RENDER_INTENT_TONE_MAP_ENHANCE)
@@ -20,10 +20,14 @@
 
 #include <atomic>
 #include <optional>
+#include <set>
 #include <sstream>
 
 #include "HwcDisplayConfigs.h"
+#include "compositor/BandwidthEstimator.h"
 #include "compositor/FlatteningController.h"
+#include "compositor/FrameRateEstimator.h"
+#include "compositor/IdleRefreshController.h"
 #include "compositor/LayerData.h"
 #include "drm/DrmAtomicStateManager.h"
 #include "drm/ResourceManager.h"
@@ -75,6 +79,7 @@ class HwcDisplay {
   HWC2::Error GetRenderIntents(int32_t mode, uint32_t *outNumIntents,
                                int32_t *outIntents);
   HWC2::Error SetColorModeWithIntent(int32_t mode, int32_t intent);
+  HWC2::Error GetPerFrameMetadataKeys(uint32_t *num_keys, int32_t *keys);
 #endif
 #if __ANDROID_API__ > 28
   HWC2::Error GetDisplayIdentificationData(uint8_t *outPort,
@@ -95,7 +100,7 @@ class HwcDisplay {
   HWC2::Error SetAutoLowLatencyMode(bool on);
   HWC2::Error GetSupportedContentTypes(
       uint32_t *outNumSupportedContentTypes,
-      const uint32_t *outSupportedContentTypes);
+      uint32_t *outSupportedContentTypes);
 
   HWC2::Error SetContentType(int32_t contentType);
 #endif
@@ -134,7 +139,9 @@ class HwcDisplay {
               gpu_pixops_ - b.gpu_pixops_,
               failed_kms_validate_ - b.failed_kms_validate_,
               failed_kms_present_ - b.failed_kms_present_,
-              frames_flattened_ - b.frames_flattened_};
+              frames_flattened_ - b.frames_flattened_,
+              frames_budget_limited_ - b.frames_budget_limited_,
+              idle_refresh_drops_ - b.idle_refresh_drops_};
     }
 
     uint32_t total_frames_ = 0;
@@ -143,6 +150,8 @@ class HwcDisplay {
     uint32_t failed_kms_validate_ = 0;
     uint32_t failed_kms_present_ = 0;
     uint32_t frames_flattened_ = 0;
+    uint32_t frames_budget_limited_ = 0;
+    uint32_t idle_refresh_drops_ = 0;
   };
 
   const Backend *backend() const;
@@ -162,10 +171,46 @@ class HwcDisplay {
 
   bool CtmByGpu();
 
+  /* Maps a display frame from the size reported to the framework to the
+   * mode size of the config the next frame is committed with
+   */
+  auto UiToModeFrame(const hwc_rect_t &frame) -> hwc_rect_t;
+
+  /* Mode area of the next frame, in the coordinates of the layer display
+   * frames
+   */
+  auto GetScreenRect() -> hwc_rect_t;
+
   Stats &total_stats() {
     return total_stats_;
   }
 
+  auto &GetClientLayer() {
+    return client_layer_;
+  }
+
+  auto &GetBandwidth() {
+    return bandwidth_;
+  }
+
+  /* Encoding of the display output, selected by the backend on validation */
+  auto GetOutputTransfer() const {
+    return output_transfer_;
+  }
+
+  void SetOutputTransfer(BufferTransfer transfer) {
+    output_transfer_ = transfer;
+  }
+
+  /* Doze and DozeSuspend, the display shows always-on content */
+  auto IsDozing() const {
+    return power_mode_ == HWC2::PowerMode::Doze ||
+           power_mode_ == HWC2::PowerMode::DozeSuspend;
+  }
+
+  /* Null if the sink reports no HDR support */
+  auto GetConnectorHdrCapabilities() -> const DrmConnector::HdrCapabilities *;
+
   /* Headless mode required to keep SurfaceFlinger alive when all display are
    * disconnected, Without headless mode Android will continuously crash.
    * Only single internal (primary) display is required to be in HEADLESS mode
@@ -193,15 +238,62 @@ class HwcDisplay {
   int64_t staged_mode_change_time_{};
   uint32_t staged_mode_config_id_{};
 
+  /* Only the first pipeline of the display may show the firmware's frame */
+  bool boot_mode_checked_{};
+  auto GetBootConfig() -> std::optional<uint32_t>;
+  void AdoptBootConfig(uint32_t config_id);
+
+  HWC2::PowerMode power_mode_ = HWC2::PowerMode::Off;
+  /* Lowest refresh rate config of the group of |config_id| */
+  auto GetLowestRefreshConfig(uint32_t config_id) -> uint32_t;
+
+  void EnterIdleRefresh();
+
+  /* Config the next frame is presented at, see GetFrameConfig() */
+  auto GetFrameConfig() -> uint32_t;
+  /* Resolved by ValidateDisplay(), so the test commit carries its mode */
+  std::optional<uint32_t> frame_config_id_;
+  /* Staged config once it's due, or the frame config */
+  auto GetCommitConfigId() -> uint32_t;
+  void MapUiFrames();
+  /* Frame configs a commit failed with, never selected again */
+  std::set<uint32_t> rejected_config_ids_;
+  void UpdateContentRate();
+  auto SelectContentRateConfig(uint32_t client_config_id, uint32_t rate)
+      -> uint32_t;
+
+  HWC2::ContentType content_type_ = HWC2::ContentType::None;
+  FrameRateEstimator content_rate_;
+  std::optional<hwc2_layer_t> video_layer_id_;
+  buffer_handle_t video_buffer_{};
+  struct ContentRateConfig {
+    uint32_t rate{};
+    uint32_t client_config_id{};
+    uint32_t config_id{};
+  };
+  std::optional<ContentRateConfig> content_rate_config_;
+
   DrmDisplayPipeline *pipeline_{};
 
   std::unique_ptr<Backend> backend_;
   std::shared_ptr<FlatteningController> flatcon_;
+  std::shared_ptr<IdleRefreshController> idlecon_;
 
   std::shared_ptr<VSyncWorker> vsync_worker_;
   bool vsync_event_en_{};
-  bool vsync_tracking_en_{};
-  int64_t last_vsync_ts_{};
+  /* SurfaceFlinger vsync is not delivered in DozeSuspend */
+  bool IsClientVSyncWanted() const {
+    return vsync_event_en_ && power_mode_ != HWC2::PowerMode::DozeSuspend;
+  }
+  /* Vsync is delivered by the real-time vsync thread, which must not wait
+   * for the main lock held by composition. The state it needs is published
+   * here by PublishVSyncState() instead.
+   */
+  std::atomic_bool client_vsync_en_{};
+  std::atomic<uint32_t> vsync_period_ns_{};
+  void PublishVSyncState();
+  std::atomic_bool vsync_tracking_en_{};
+  std::atomic<int64_t> last_vsync_ts_{};
 
   const hwc2_display_t handle_;
   HWC2::DisplayType type_;
@@ -215,6 +307,7 @@ class HwcDisplay {
   static constexpr int kCtmCols = 3;
   std::shared_ptr<drm_color_ctm> color_matrix_;
   android_color_transform_t color_transform_hint_{};
+  BufferTransfer output_transfer_ = BufferTransfer::kSdr;
 
   std::shared_ptr<DrmKmsPlan> current_plan_;
 
@@ -223,6 +316,9 @@ class HwcDisplay {
   Stats prev_stats_;
   std::string DumpDelta(HwcDisplay::Stats delta);
 
+  BandwidthEstimator bandwidth_;
+  void UpdateBandwidth();
+
   void SetColorMarixToIdentity();
 
   HWC2::Error Init();
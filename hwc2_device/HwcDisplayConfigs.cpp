@@ -18,9 +18,14 @@
 
 #include "HwcDisplayConfigs.h"
 
+#include <algorithm>
+#include <array>
 #include <cmath>
+#include <vector>
 
 #include "drm/DrmConnector.h"
+#include "drm/DrmDisplayPipeline.h"
+#include "drm/DrmPlane.h"
 #include "utils/log.h"
 
 constexpr uint32_t kHeadlessModeDisplayWidthMm = 163;
@@ -53,10 +58,12 @@ void HwcDisplayConfigs::FillHeadless() {
 
   mm_width = kHeadlessModeDisplayWidthMm;
   mm_height = kHeadlessModeDisplayHeightMm;
+  num_h_tiles = num_v_tiles = 1;
 }
 
 // NOLINTNEXTLINE (readability-function-cognitive-complexity): Fixme
-HWC2::Error HwcDisplayConfigs::Update(DrmConnector &connector) {
+HWC2::Error HwcDisplayConfigs::Update(DrmDisplayPipeline &pipe) {
+  auto &connector = *pipe.connector->Get();
   /* In case UpdateModes will fail we will still have one mode for headless
    * mode*/
   FillHeadless();
@@ -76,6 +83,12 @@ HWC2::Error HwcDisplayConfigs::Update(DrmConnector &connector) {
   mm_width = connector.GetMmWidth();
   mm_height = connector.GetMmHeight();
 
+  auto &tile = connector.GetTile();
+  if (!pipe.tiles.empty() && tile) {
+    num_h_tiles = tile->num_h_tile;
+    num_v_tiles = tile->num_v_tile;
+  }
+
   preferred_config_id = 0;
   uint32_t preferred_config_group_id = 0;
 
@@ -105,6 +118,14 @@ HWC2::Error HwcDisplayConfigs::Update(DrmConnector &connector) {
       disabled = true;
     }
 
+    if (num_h_tiles * num_v_tiles > 1 &&
+        (mode.GetRawMode().hdisplay != tile->h_size ||
+         mode.GetRawMode().vdisplay != tile->v_size)) {
+      ALOGI("Disabling display mode %s (Mode doesn't match the tile size)",
+            mode.GetName().c_str());
+      disabled = true;
+    }
+
     /* Add config */
     hwc_configs[last_config_id] = {
         .id = last_config_id,
@@ -198,7 +219,56 @@ HWC2::Error HwcDisplayConfigs::Update(DrmConnector &connector) {
     }
   }
 
+  AddReducedUiConfigs(pipe, preferred_config_group_id);
+
   return HWC2::Error::None;
 }
 
+/* A GPU load or thermal policy of the framework lowers the rendering
+ * resolution by switching to one of these with SetActiveConfig. They share
+ * the group of the full size configs, the mode stays the same.
+ */
+void HwcDisplayConfigs::AddReducedUiConfigs(DrmDisplayPipeline &pipe,
+                                            uint32_t group_id) {
+  constexpr std::array<uint32_t, 2> kReducedUiScalePercents = {75, 50};
+
+  std::vector<HwcDisplayConfig> full_size_configs;
+  for (auto &[id, config] : hwc_configs) {
+    if (config.group_id == group_id && !config.disabled)
+      full_size_configs.emplace_back(config);
+  }
+
+  for (auto scale : kReducedUiScalePercents) {
+    for (const auto &full_size_config : full_size_configs) {
+      auto config = full_size_config;
+      config.id = last_config_id;
+      config.ui_scale_percent = scale;
+      if (!IsUiScaleSupported(pipe, config)) {
+        ALOGI("Planes can't scale %u%% of display mode %s up, skipping it",
+              scale, config.mode.GetName().c_str());
+        continue;
+      }
+
+      hwc_configs[last_config_id++] = config;
+    }
+  }
+}
+
+auto HwcDisplayConfigs::IsUiScaleSupported(DrmDisplayPipeline &pipe,
+                                           const HwcDisplayConfig &config) const
+    -> bool {
+  if (config.ui_scale_percent == kFullUiScalePercent)
+    return true;
+
+  PresentInfo pi{};
+  pi.source_crop = {0.0F, 0.0F, float(GetUiWidth(config)),
+                    float(GetUiHeight(config))};
+  pi.display_frame = {0, 0, int(GetWidth(config)), int(GetHeight(config))};
+
+  auto planes = pipe.GetUsablePlanes();
+  return std::any_of(planes.begin(), planes.end(), [&pi](auto &plane) {
+    return plane->Get()->IsScalingSupported(pi);
+  });
+}
+
 }  // namespace android
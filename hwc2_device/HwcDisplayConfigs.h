@@ -24,13 +24,19 @@
 
 namespace android {
 
-class DrmConnector;
+struct DrmDisplayPipeline;
+
+inline constexpr uint32_t kFullUiScalePercent = 100;
 
 struct HwcDisplayConfig {
   uint32_t id{};
   uint32_t group_id{};
   DrmMode mode{};
   bool disabled{};
+  /* The framework renders at this fraction of the mode size, the display
+   * engine scales the client target and the layers up to the mode
+   */
+  uint32_t ui_scale_percent = kFullUiScalePercent;
 
   bool IsInterlaced() const {
     return (mode.GetRawMode().flags & DRM_MODE_FLAG_INTERLACE) != 0;
@@ -38,7 +44,7 @@ struct HwcDisplayConfig {
 };
 
 struct HwcDisplayConfigs {
-  HWC2::Error Update(DrmConnector &conn);
+  HWC2::Error Update(DrmDisplayPipeline &pipe);
   void FillHeadless();
 
   std::map<uint32_t /*config_id*/, struct HwcDisplayConfig> hwc_configs;
@@ -51,6 +57,36 @@ struct HwcDisplayConfigs {
 
   uint32_t mm_width = 0;
   uint32_t mm_height = 0;
+
+  /* Tiled displays are scanned out by several CRTCs at once. Modes describe
+   * a single tile, the display size is the tile size multiplied by these. */
+  uint32_t num_h_tiles = 1;
+  uint32_t num_v_tiles = 1;
+
+  auto GetWidth(const HwcDisplayConfig &config) const {
+    return config.mode.GetRawMode().hdisplay * num_h_tiles;
+  }
+
+  auto GetHeight(const HwcDisplayConfig &config) const {
+    return config.mode.GetRawMode().vdisplay * num_v_tiles;
+  }
+
+  /* Size reported to the framework */
+  auto GetUiWidth(const HwcDisplayConfig &config) const {
+    return GetWidth(config) * config.ui_scale_percent / kFullUiScalePercent;
+  }
+
+  auto GetUiHeight(const HwcDisplayConfig &config) const {
+    return GetHeight(config) * config.ui_scale_percent / kFullUiScalePercent;
+  }
+
+  /* True if a plane of |pipe| can scale the client target of |config| up to
+   * the mode size. Planes not probed yet are assumed to.
+   */
+  auto IsUiScaleSupported(DrmDisplayPipeline &pipe,
+                          const HwcDisplayConfig &config) const -> bool;
+
+  void AddReducedUiConfigs(DrmDisplayPipeline &pipe, uint32_t group_id);
 };
 
 }  // namespace android
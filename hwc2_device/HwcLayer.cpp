@@ -18,6 +18,8 @@
 
 #include "HwcLayer.h"
 
+#include <cmath>
+
 #include "HwcDisplay.h"
 #include "bufferinfo/BufferInfoGetter.h"
 #include "utils/log.h"
@@ -100,11 +102,75 @@ HWC2::Error HwcLayer::SetLayerDataspace(int32_t dataspace) {
     default:
       sample_range_ = BufferSampleRange::kUndefined;
   }
+
+  switch (dataspace & HAL_DATASPACE_TRANSFER_MASK) {
+    case HAL_DATASPACE_TRANSFER_ST2084:
+      transfer_ = BufferTransfer::kSt2084;
+      break;
+    case HAL_DATASPACE_TRANSFER_HLG:
+      transfer_ = BufferTransfer::kHlg;
+      break;
+    case HAL_DATASPACE_TRANSFER_UNSPECIFIED:
+      transfer_ = BufferTransfer::kUndefined;
+      break;
+    default:
+      transfer_ = BufferTransfer::kSdr;
+  }
+  return HWC2::Error::None;
+}
+
+#if __ANDROID_API__ > 27
+HWC2::Error HwcLayer::SetLayerPerFrameMetadata(uint32_t num_elements,
+                                               const int32_t *keys,
+                                               const float *metadata) {
+  HdrStaticMetadata hdr{};
+  for (uint32_t i = 0; i < num_elements; i++) {
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    const auto key = keys[i];
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    const auto value = metadata[i];
+    switch (key) {
+      case HWC2_DISPLAY_RED_PRIMARY_X:
+      case HWC2_DISPLAY_RED_PRIMARY_Y:
+      case HWC2_DISPLAY_GREEN_PRIMARY_X:
+      case HWC2_DISPLAY_GREEN_PRIMARY_Y:
+      case HWC2_DISPLAY_BLUE_PRIMARY_X:
+      case HWC2_DISPLAY_BLUE_PRIMARY_Y: {
+        auto index = key - HWC2_DISPLAY_RED_PRIMARY_X;
+        hdr.display_primaries[index / 2][index % 2] = value;
+        break;
+      }
+      case HWC2_WHITE_POINT_X:
+        hdr.white_point[0] = value;
+        break;
+      case HWC2_WHITE_POINT_Y:
+        hdr.white_point[1] = value;
+        break;
+      case HWC2_MAX_LUMINANCE:
+        hdr.max_mastering_luminance = value;
+        break;
+      case HWC2_MIN_LUMINANCE:
+        hdr.min_mastering_luminance = value;
+        break;
+      case HWC2_MAX_CONTENT_LIGHT_LEVEL:
+        hdr.max_content_light_level = value;
+        break;
+      case HWC2_MAX_FRAME_AVERAGE_LIGHT_LEVEL:
+        hdr.max_frame_average_light_level = value;
+        break;
+      default:
+        return HWC2::Error::Unsupported;
+    }
+  }
+
+  hdr_metadata_ = hdr;
   return HWC2::Error::None;
 }
+#endif
 
 HWC2::Error HwcLayer::SetLayerDisplayFrame(hwc_rect_t frame) {
-  layer_data_.pi.display_frame = frame;
+  ui_display_frame_ = frame;
+  layer_data_.pi.display_frame = parent_->UiToModeFrame(frame);
   return HWC2::Error::None;
 }
 
@@ -121,6 +187,16 @@ HWC2::Error HwcLayer::SetLayerSidebandStream(
 }
 
 HWC2::Error HwcLayer::SetLayerSourceCrop(hwc_frect_t crop) {
+  /* Float rounding of the framework leaves near-integer crops, which would
+   * need phasing (and a scaler) for no visible difference
+   */
+  constexpr float kSnapEpsilon = 1.0F / 1024;
+  for (auto *edge : {&crop.left, &crop.top, &crop.right, &crop.bottom}) {
+    auto rounded = std::round(*edge);
+    if (std::abs(*edge - rounded) < kSnapEpsilon)
+      *edge = rounded;
+  }
+
   layer_data_.pi.source_crop = crop;
   return HWC2::Error::None;
 }
@@ -155,12 +231,34 @@ HWC2::Error HwcLayer::SetLayerTransform(int32_t transform) {
   return HWC2::Error::None;
 }
 
-// NOLINTNEXTLINE(readability-convert-member-functions-to-static)
-HWC2::Error HwcLayer::SetLayerVisibleRegion(hwc_region_t /*visible*/) {
-  // TODO(nobody): We don't use this information, marking as unsupported
+HWC2::Error HwcLayer::SetLayerVisibleRegion(hwc_region_t visible) {
+  /* Clipping to the bounding box never hides a visible pixel */
+  if (visible.numRects == 0 || visible.rects == nullptr) {
+    ui_visible_bounds_ = {};
+    visible_bounds_ = {};
+    return HWC2::Error::None;
+  }
+
+  hwc_rect_t bounds = visible.rects[0];
+  for (size_t i = 1; i < visible.numRects; i++) {
+    const auto &r = visible.rects[i];
+    bounds.left = std::min(bounds.left, r.left);
+    bounds.top = std::min(bounds.top, r.top);
+    bounds.right = std::max(bounds.right, r.right);
+    bounds.bottom = std::max(bounds.bottom, r.bottom);
+  }
+
+  ui_visible_bounds_ = bounds;
+  visible_bounds_ = parent_->UiToModeFrame(bounds);
   return HWC2::Error::None;
 }
 
+void HwcLayer::MapUiFrames() {
+  layer_data_.pi.display_frame = parent_->UiToModeFrame(ui_display_frame_);
+  if (ui_visible_bounds_)
+    visible_bounds_ = parent_->UiToModeFrame(*ui_visible_bounds_);
+}
+
 HWC2::Error HwcLayer::SetLayerZOrder(uint32_t order) {
   z_order_ = order;
   return HWC2::Error::None;
@@ -219,6 +317,12 @@ void HwcLayer::PopulateLayerData() {
   if (sample_range_ != BufferSampleRange::kUndefined) {
     layer_data_.bi->sample_range = sample_range_;
   }
+  if (transfer_ != BufferTransfer::kUndefined) {
+    layer_data_.bi->transfer = transfer_;
+  }
+  if (hdr_metadata_) {
+    layer_data_.bi->hdr_metadata = *hdr_metadata_;
+  }
 }
 
 /* SwapChain Cache */
@@ -53,10 +53,45 @@ class HwcLayer {
     prior_buffer_scanout_flag_ = state;
   }
 
+  /* Device layer with nothing to show, gets no plane */
+  bool IsCulled() const {
+    return culled_;
+  }
+
+  void SetCulled(bool culled) {
+    culled_ = culled;
+  }
+
+  /* Bounding box of the visible region reported by the client */
+  auto &GetVisibleBounds() const {
+    return visible_bounds_;
+  }
+
+  /* The client reports the display frame and the visible region in the UI
+   * size of the config, planes need them in the mode size. Mapped with the
+   * config the frame is committed with.
+   */
+  void MapUiFrames();
+
+  /* Part of the display frame left visible by the layers above, the plane
+   * fetches only this rectangle */
+  auto &GetPlaneClip() const {
+    return plane_clip_;
+  }
+
+  void SetPlaneClip(std::optional<hwc_rect_t> clip) {
+    plane_clip_ = clip;
+  }
+
   uint32_t GetZOrder() const {
     return z_order_;
   }
 
+  /* Changes with every new frame of the layer */
+  auto GetBufferHandle() const {
+    return buffer_handle_;
+  }
+
   auto &GetLayerData() {
     return layer_data_;
   }
@@ -68,6 +103,11 @@ class HwcLayer {
   HWC2::Error SetLayerColor(hwc_color_t /*color*/);
   HWC2::Error SetLayerCompositionType(int32_t type);
   HWC2::Error SetLayerDataspace(int32_t dataspace);
+#if __ANDROID_API__ > 27
+  HWC2::Error SetLayerPerFrameMetadata(uint32_t num_elements,
+                                       const int32_t *keys,
+                                       const float *metadata);
+#endif
   HWC2::Error SetLayerDisplayFrame(hwc_rect_t frame);
   HWC2::Error SetLayerPlaneAlpha(float alpha);
   HWC2::Error SetLayerSidebandStream(const native_handle_t *stream);
@@ -95,11 +135,18 @@ class HwcLayer {
    */
   BufferColorSpace color_space_{};
   BufferSampleRange sample_range_{};
+  BufferTransfer transfer_{};
+  std::optional<HdrStaticMetadata> hdr_metadata_;
   BufferBlendMode blend_mode_{};
   buffer_handle_t buffer_handle_{};
   bool buffer_handle_updated_{};
 
   bool prior_buffer_scanout_flag_{};
+  bool culled_{};
+  hwc_rect_t ui_display_frame_{};
+  std::optional<hwc_rect_t> ui_visible_bounds_;
+  std::optional<hwc_rect_t> visible_bounds_;
+  std::optional<hwc_rect_t> plane_clip_;
 
   HwcDisplay *const parent_;
 
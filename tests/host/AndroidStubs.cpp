@@ -0,0 +1,265 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "hwc-android-stubs"
+
+#include "AndroidStubs.h"
+
+#include <cutils/trace.h>
+#include <gralloc_handle.h>
+#include <hardware/gralloc.h>
+#include <poll.h>
+#include <sync/sync.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include "utils/log.h"
+
+/* cutils/trace.h: tracing is always disabled on host */
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-non-const-global-variables)
+atomic_bool atrace_is_ready = true;
+uint64_t atrace_enabled_tags = 0;
+int atrace_marker_fd = -1;
+// NOLINTEND(cppcoreguidelines-avoid-non-const-global-variables)
+
+void atrace_setup() {
+}
+
+void atrace_update_tags() {
+}
+
+void atrace_set_debuggable(bool /*debuggable*/) {
+}
+
+void atrace_set_tracing_enabled(bool /*enabled*/) {
+}
+
+void atrace_init() {
+}
+
+uint64_t atrace_get_enabled_tags() {
+  return atrace_enabled_tags;
+}
+
+void atrace_begin_body(const char * /*name*/) {
+}
+
+void atrace_end_body() {
+}
+
+void atrace_async_begin_body(const char * /*name*/, int32_t /*cookie*/) {
+}
+
+void atrace_async_end_body(const char * /*name*/, int32_t /*cookie*/) {
+}
+
+void atrace_int_body(const char * /*name*/, int32_t /*value*/) {
+}
+
+void atrace_int64_body(const char * /*name*/, int64_t /*value*/) {
+}
+
+/* libsync: fences of the fake DRM device are eventfds, readable once
+ * signaled
+ */
+
+int sync_wait(int fd, int timeout) {
+  struct pollfd fds = {.fd = fd, .events = POLLIN, .revents = 0};
+  auto ret = poll(&fds, 1, timeout);
+  if (ret == 0) {
+    errno = ETIME;
+    return -1;
+  }
+
+  return ret < 0 ? -1 : 0;
+}
+
+int32_t sync_merge(const char * /*name*/, int32_t fd1, int32_t fd2) {
+  /* Fences are born signaled, any of them represents both */
+  if (sync_wait(fd2, -1) != 0)
+    return -1;
+
+  return dup(fd1);
+}
+
+/* Fake fences don't record the signal time, the time of the query stands in
+ * for it
+ */
+struct sync_file_info *sync_file_info(int32_t fd) {
+  auto size = sizeof(struct sync_file_info) + sizeof(struct sync_fence_info);
+  // NOLINTNEXTLINE(cppcoreguidelines-no-malloc)
+  auto *info = static_cast<struct sync_file_info *>(calloc(1, size));
+  if (info == nullptr)
+    return nullptr;
+
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+  auto *fence = reinterpret_cast<struct sync_fence_info *>(info + 1);
+  info->status = sync_wait(fd, 0) == 0 ? 1 : 0;
+  info->num_fences = 1;
+  info->sync_fence_info = uintptr_t(fence);
+
+  struct timespec ts {};
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  constexpr uint64_t kNsInSec = 1000000000ULL;
+  fence->status = info->status;
+  fence->timestamp_ns = uint64_t(ts.tv_sec) * kNsInSec + uint64_t(ts.tv_nsec);
+  return info;
+}
+
+void sync_file_info_free(struct sync_file_info *info) {
+  // NOLINTNEXTLINE(cppcoreguidelines-no-malloc)
+  free(info);
+}
+
+/* cutils/native_handle.h */
+
+native_handle_t *native_handle_create(int num_fds, int num_ints) {
+  auto size = sizeof(native_handle_t) +
+              sizeof(int) * size_t(num_fds + num_ints);
+  // NOLINTNEXTLINE(cppcoreguidelines-no-malloc)
+  auto *h = static_cast<native_handle_t *>(calloc(1, size));
+  if (h == nullptr)
+    return nullptr;
+
+  h->version = sizeof(native_handle_t);
+  h->numFds = num_fds;
+  h->numInts = num_ints;
+  return h;
+}
+
+int native_handle_close(const native_handle_t *h) {
+  for (int i = 0; i < h->numFds; i++)
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-constant-array-index)
+    close(h->data[i]);
+
+  return 0;
+}
+
+int native_handle_delete(native_handle_t *h) {
+  // NOLINTNEXTLINE(cppcoreguidelines-no-malloc)
+  free(h);
+  return 0;
+}
+
+/* libhardware: gralloc module impersonating gbm_gralloc */
+
+/* Bytes per luma sample of the semi-planar 4:2:0 formats, 0 for the rest */
+static auto GetYuvSampleSize(int hal_format) -> size_t {
+  switch (hal_format) {
+    case HAL_PIXEL_FORMAT_YCbCr_420_888:
+      return 1;
+    case HAL_PIXEL_FORMAT_YCBCR_P010:
+      return 2;
+    default:
+      return 0;
+  }
+}
+
+/* Semi-planar 4:2:0 (NV12, P010) layout, offsets returned as pointers from
+ * NULL */
+static int GrallocLockYCbCr(const gralloc_module_t * /*module*/,
+                            buffer_handle_t handle, int /*usage*/, int /*l*/,
+                            int /*t*/, int /*w*/, int /*h*/,
+                            struct android_ycbcr *ycbcr) {
+  auto *gr_handle = gralloc_handle(handle);
+  auto sample_size = GetYuvSampleSize(gr_handle->format);
+  if (sample_size == 0)
+    return -EINVAL;
+
+  auto luma_size = size_t(gr_handle->stride) * size_t(gr_handle->height);
+  // NOLINTBEGIN(performance-no-int-to-ptr)
+  ycbcr->y = nullptr;
+  ycbcr->cb = reinterpret_cast<void *>(luma_size);
+  ycbcr->cr = reinterpret_cast<void *>(luma_size + sample_size);
+  // NOLINTEND(performance-no-int-to-ptr)
+  ycbcr->ystride = gr_handle->stride;
+  ycbcr->cstride = gr_handle->stride;
+  ycbcr->chroma_step = 2 * sample_size;
+  return 0;
+}
+
+static int GrallocUnlock(const gralloc_module_t * /*module*/,
+                         buffer_handle_t /*handle*/) {
+  return 0;
+}
+
+int hw_get_module(const char *id, const struct hw_module_t **module) {
+  if (strcmp(id, GRALLOC_HARDWARE_MODULE_ID) != 0)
+    return -ENOENT;
+
+  static const gralloc_module_t kGralloc = [] {
+    gralloc_module_t gralloc{};
+    gralloc.common.tag = HARDWARE_MODULE_TAG;
+    gralloc.common.id = GRALLOC_HARDWARE_MODULE_ID;
+    gralloc.common.name = "GBM Memory Allocator";
+    gralloc.common.author = "drm_hwcomposer host build";
+    gralloc.unlock = GrallocUnlock;
+    gralloc.lock_ycbcr = GrallocLockYCbCr;
+    return gralloc;
+  }();
+
+  *module = &kGralloc.common;
+  return 0;
+}
+
+namespace android {
+
+auto CreateGrallocBuffer(uint32_t width, uint32_t height, uint32_t hal_format)
+    -> native_handle_t * {
+  auto sample_size = uint32_t(GetYuvSampleSize(int(hal_format)));
+  auto yuv = sample_size != 0;
+  auto bpp = hal_format == HAL_PIXEL_FORMAT_RGB_565 ? 2U : 4U;
+  auto stride = yuv ? width * sample_size : width * bpp;
+  /* NV12 and P010 have a half-height chroma plane after the luma one */
+  auto size = off_t(stride) * (yuv ? height + height / 2 : height);
+
+  auto fd = memfd_create("hwc-host-buffer", MFD_CLOEXEC);
+  if (fd < 0) {
+    ALOGE("Failed to create buffer: %s", strerror(errno));
+    return nullptr;
+  }
+
+  /* Non-empty, see BufferInfoGetter::GetUniqueId() */
+  if (ftruncate(fd, size) != 0) {
+    close(fd);
+    return nullptr;
+  }
+
+  auto *handle = gralloc_handle_create(int32_t(width), int32_t(height),
+                                       int32_t(hal_format), 0);
+  if (handle == nullptr) {
+    close(fd);
+    return nullptr;
+  }
+
+  auto *gr_handle = gralloc_handle(handle);
+  gr_handle->prime_fd = fd;
+  gr_handle->stride = stride;
+  return handle;
+}
+
+void FreeGrallocBuffer(native_handle_t *handle) {
+  native_handle_close(handle);
+  native_handle_delete(handle);
+}
+
+}  // namespace android
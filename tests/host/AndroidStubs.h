@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cutils/native_handle.h>
+
+#include <cstdint>
+
+namespace android {
+
+/* Host replacements of the Android libraries used by the composer: cutils
+ * (tracing, native handles), libsync and libhardware. The gralloc module
+ * impersonates gbm_gralloc, so buffers are described by gralloc_handle_t and
+ * decoded by the libdrm legacy getter.
+ */
+
+/* Buffer backed by a memfd, so it has a unique inode like a dma-buf */
+auto CreateGrallocBuffer(uint32_t width, uint32_t height, uint32_t hal_format)
+    -> native_handle_t *;
+void FreeGrallocBuffer(native_handle_t *handle);
+
+}  // namespace android
@@ -0,0 +1,1341 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "hwc-fake-drm"
+
+#include "FakeDrm.h"
+
+#include <drm/drm_fourcc.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <xf86drm.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <tuple>
+
+#include "utils/fd.h"
+#include "utils/log.h"
+
+#ifndef DRM_MODE_OBJECT_COLOROP
+// NOLINTNEXTLINE(cppcoreguidelines-macro-usage)
+#define DRM_MODE_OBJECT_COLOROP 0xfafafafa
+#endif
+
+/* Opaque in libdrm, layout is up to the implementation */
+// NOLINTNEXTLINE(bugprone-reserved-identifier, cert-dcl37-c, cert-dcl51-cpp)
+struct _drmModeAtomicReq {
+  std::vector<std::tuple<uint32_t, uint32_t, uint64_t>> items;
+};
+
+namespace android {
+
+namespace {
+
+constexpr int64_t kNsInSec = 1000000000;
+constexpr uint32_t kEncoderTypeTmds = 2;
+
+struct Property {
+  std::string name;
+  uint32_t flags{};
+  /* Range limits, or the values of the enum entries */
+  std::vector<uint64_t> values;
+  std::vector<std::string> enums;
+};
+
+struct Object {
+  uint32_t type{};
+  std::vector<std::pair<uint32_t /*prop_id*/, uint64_t>> props;
+};
+
+struct Fb {
+  uint32_t width{};
+  uint32_t height{};
+  uint32_t format{};
+};
+
+struct FakeDevice {
+  FakeDeviceConfig config;
+  std::string dir;
+  std::string path;
+  UniqueFd event_fd = MakeUniqueFd(-1);
+
+  uint32_t last_id{};
+  std::map<uint32_t, Property> properties;
+  std::map<std::string, uint32_t> property_ids;
+  std::map<uint32_t, Object> objects;
+  std::vector<uint32_t> crtcs;
+  std::vector<uint32_t> encoders;
+  std::vector<uint32_t> connectors;
+  std::vector<uint32_t> planes;
+
+  std::map<uint32_t, std::vector<uint8_t>> blobs;
+  /* Destroyed by the client, kept while a property still holds them */
+  std::set<uint32_t> destroyed_blobs;
+  std::map<uint32_t, Fb> fbs;
+  std::map<ino_t, uint32_t> gem_handles;
+  std::set<uint32_t> dumb_handles;
+  std::map<uint32_t /*crtc_id*/, int64_t> vblank_epochs;
+
+  FakeDrm::Stats stats;
+  FakeDrm::CommitCheck commit_check;
+
+  auto NewId() {
+    return ++last_id;
+  }
+
+  auto AddObject(uint32_t type) {
+    auto id = NewId();
+    objects[id].type = type;
+    return id;
+  }
+
+  void AddProperty(uint32_t obj_id, const std::string &name, uint32_t flags,
+                   std::vector<uint64_t> values, uint64_t value,
+                   std::vector<std::string> enums = {}) {
+    if (property_ids.count(name) == 0) {
+      auto id = NewId();
+      property_ids[name] = id;
+      properties[id] = {
+          .name = name,
+          .flags = flags,
+          .values = std::move(values),
+          .enums = std::move(enums),
+      };
+    }
+    objects[obj_id].props.emplace_back(property_ids[name], value);
+  }
+
+  /* For properties whose range or enum entries differ between objects. Not
+   * found by name.
+   */
+  void AddObjectProperty(uint32_t obj_id, const std::string &name,
+                         uint32_t flags, std::vector<uint64_t> values,
+                         uint64_t value, std::vector<std::string> enums = {}) {
+    auto id = NewId();
+    properties[id] = {
+        .name = name,
+        .flags = flags,
+        .values = std::move(values),
+        .enums = std::move(enums),
+    };
+    objects[obj_id].props.emplace_back(id, value);
+  }
+
+  auto AddBlob(std::vector<uint8_t> data) {
+    auto id = NewId();
+    blobs[id] = std::move(data);
+    return id;
+  }
+
+  auto IsBlobInUse(uint32_t blob_id) -> bool {
+    for (auto &[obj_id, obj] : objects) {
+      for (auto &[prop_id, value] : obj.props) {
+        if ((properties[prop_id].flags & DRM_MODE_PROP_BLOB) != 0 &&
+            value == blob_id)
+          return true;
+      }
+    }
+    return false;
+  }
+
+  void ReleaseDestroyedBlobs() {
+    for (auto it = destroyed_blobs.begin(); it != destroyed_blobs.end();) {
+      if (IsBlobInUse(*it)) {
+        ++it;
+        continue;
+      }
+
+      blobs.erase(*it);
+      it = destroyed_blobs.erase(it);
+    }
+  }
+
+  void SetValue(uint32_t obj_id, const std::string &name, uint64_t value) {
+    auto prop_id = property_ids[name];
+    for (auto &[id, v] : objects[obj_id].props) {
+      if (id == prop_id)
+        v = value;
+    }
+  }
+
+  auto GetValue(uint32_t obj_id, const std::string &name) -> uint64_t {
+    auto prop_id = property_ids[name];
+    for (auto &[id, value] : objects[obj_id].props) {
+      if (id == prop_id)
+        return value;
+    }
+    return 0;
+  }
+};
+
+// NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
+std::mutex gMutex;
+// NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
+std::unique_ptr<FakeDevice> gDevice;
+
+auto GetTimeNs() -> int64_t {
+  struct timespec ts {};
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * kNsInSec + ts.tv_nsec;
+}
+
+auto RangeOf(int64_t min, int64_t max) {
+  return std::vector<uint64_t>{uint64_t(min), uint64_t(max)};
+}
+
+void AddCrtc(FakeDevice &dev) {
+  auto id = dev.AddObject(DRM_MODE_OBJECT_CRTC);
+  dev.AddProperty(id, "ACTIVE", DRM_MODE_PROP_RANGE, RangeOf(0, 1), 0);
+  dev.AddProperty(id, "MODE_ID", DRM_MODE_PROP_BLOB, {}, 0);
+  dev.AddProperty(id, "OUT_FENCE_PTR", DRM_MODE_PROP_RANGE,
+                  {0, UINT64_MAX}, 0);
+  dev.AddProperty(id, "CTM", DRM_MODE_PROP_BLOB, {}, 0);
+  dev.AddProperty(id, "SCALING_FILTER", DRM_MODE_PROP_ENUM, {0, 1}, 0,
+                  {"Default", "Nearest Neighbor"});
+  dev.crtcs.emplace_back(id);
+}
+
+void AddConnector(FakeDevice &dev, const FakeConnectorConfig &cfg) {
+  auto enc_id = dev.AddObject(DRM_MODE_OBJECT_ENCODER);
+  dev.encoders.emplace_back(enc_id);
+
+  auto id = dev.AddObject(DRM_MODE_OBJECT_CONNECTOR);
+  dev.AddProperty(id, "DPMS", DRM_MODE_PROP_ENUM, {0, 1, 2, 3},
+                  DRM_MODE_DPMS_OFF, {"On", "Standby", "Suspend", "Off"});
+  dev.AddProperty(id, "CRTC_ID", DRM_MODE_PROP_OBJECT, {DRM_MODE_OBJECT_CRTC},
+                  0);
+
+  if (!cfg.edid.empty()) {
+    dev.AddProperty(id, "EDID", DRM_MODE_PROP_BLOB | DRM_MODE_PROP_IMMUTABLE,
+                    {}, dev.AddBlob(cfg.edid));
+  }
+
+  if (cfg.hdr) {
+    dev.AddProperty(id, "HDR_OUTPUT_METADATA", DRM_MODE_PROP_BLOB, {}, 0);
+    /* Values of DRM_MODE_COLORIMETRY_DEFAULT and _BT2020_RGB */
+    dev.AddProperty(id, "Colorspace", DRM_MODE_PROP_ENUM, {0, 9}, 0,
+                    {"Default", "BT2020_RGB"});
+  }
+
+  dev.connectors.emplace_back(id);
+}
+
+/* Returns the id of the first colorop */
+auto AddSdrToPqColorPipeline(FakeDevice &dev) -> uint32_t {
+  const std::vector<std::string> curves = {"sRGB EOTF", "PQ 125 EOTF",
+                                           "sRGB Inverse EOTF",
+                                           "PQ 125 Inverse EOTF"};
+  auto decode = dev.AddObject(DRM_MODE_OBJECT_COLOROP);
+  auto scale = dev.AddObject(DRM_MODE_OBJECT_COLOROP);
+  auto encode = dev.AddObject(DRM_MODE_OBJECT_COLOROP);
+  const std::vector<std::pair<uint32_t, uint32_t>> chain = {{decode, scale},
+                                                            {scale, encode},
+                                                            {encode, 0}};
+  for (auto [id, next] : chain) {
+    dev.AddProperty(id, "NEXT", DRM_MODE_PROP_OBJECT | DRM_MODE_PROP_IMMUTABLE,
+                    {DRM_MODE_OBJECT_COLOROP}, next);
+    dev.AddProperty(id, "BYPASS", DRM_MODE_PROP_RANGE, RangeOf(0, 1), 1);
+    if (id == scale) {
+      dev.AddProperty(id, "MULTIPLIER", DRM_MODE_PROP_RANGE,
+                      {0, UINT64_MAX}, uint64_t(1) << 32U);
+    } else {
+      dev.AddProperty(id, "CURVE_1D_TYPE", DRM_MODE_PROP_ENUM, {0, 1, 2, 3}, 0,
+                      curves);
+    }
+  }
+
+  return decode;
+}
+
+void AddPlane(FakeDevice &dev, const FakePlaneConfig &cfg, uint64_t zpos) {
+  auto id = dev.AddObject(DRM_MODE_OBJECT_PLANE);
+  dev.AddProperty(id, "type", DRM_MODE_PROP_ENUM | DRM_MODE_PROP_IMMUTABLE,
+                  {0, 1, 2}, cfg.type, {"Overlay", "Primary", "Cursor"});
+  dev.AddProperty(id, "FB_ID", DRM_MODE_PROP_OBJECT, {}, 0);
+  dev.AddProperty(id, "CRTC_ID", DRM_MODE_PROP_OBJECT, {DRM_MODE_OBJECT_CRTC},
+                  0);
+  dev.AddProperty(id, "CRTC_X", DRM_MODE_PROP_SIGNED_RANGE,
+                  RangeOf(INT_MIN, INT_MAX), 0);
+  dev.AddProperty(id, "CRTC_Y", DRM_MODE_PROP_SIGNED_RANGE,
+                  RangeOf(INT_MIN, INT_MAX), 0);
+  dev.AddProperty(id, "CRTC_W", DRM_MODE_PROP_RANGE, RangeOf(0, INT_MAX), 0);
+  dev.AddProperty(id, "CRTC_H", DRM_MODE_PROP_RANGE, RangeOf(0, INT_MAX), 0);
+  dev.AddProperty(id, "SRC_X", DRM_MODE_PROP_RANGE, RangeOf(0, UINT_MAX), 0);
+  dev.AddProperty(id, "SRC_Y", DRM_MODE_PROP_RANGE, RangeOf(0, UINT_MAX), 0);
+  dev.AddProperty(id, "SRC_W", DRM_MODE_PROP_RANGE, RangeOf(0, UINT_MAX), 0);
+  dev.AddProperty(id, "SRC_H", DRM_MODE_PROP_RANGE, RangeOf(0, UINT_MAX), 0);
+  dev.AddProperty(id, "IN_FENCE_FD", DRM_MODE_PROP_SIGNED_RANGE,
+                  RangeOf(-1, INT_MAX), uint64_t(-1));
+
+  if (cfg.zpos) {
+    dev.AddProperty(id, "zpos", DRM_MODE_PROP_RANGE,
+                    RangeOf(0, int64_t(dev.config.planes.size()) - 1), zpos);
+  }
+
+  if (cfg.rotation) {
+    /* Bitmask enum values are the bit numbers */
+    dev.AddProperty(id, "rotation", DRM_MODE_PROP_BITMASK,
+                    {0, 1, 2, 3, 4, 5}, DRM_MODE_ROTATE_0,
+                    {"rotate-0", "rotate-90", "rotate-180", "rotate-270",
+                     "reflect-x", "reflect-y"});
+  }
+
+  if (cfg.alpha) {
+    dev.AddProperty(id, "alpha", DRM_MODE_PROP_RANGE, RangeOf(0, UINT16_MAX),
+                    UINT16_MAX);
+  }
+
+  if (cfg.blend) {
+    dev.AddProperty(id, "pixel blend mode", DRM_MODE_PROP_ENUM, {0, 1, 2}, 1,
+                    {"None", "Pre-multiplied", "Coverage"});
+  }
+
+  if (cfg.color_encoding) {
+    dev.AddProperty(id, "COLOR_ENCODING", DRM_MODE_PROP_ENUM, {0, 1, 2}, 0,
+                    {"ITU-R BT.601 YCbCr", "ITU-R BT.709 YCbCr",
+                     "ITU-R BT.2020 YCbCr"});
+    dev.AddProperty(id, "COLOR_RANGE", DRM_MODE_PROP_ENUM, {0, 1}, 0,
+                    {"YCbCr limited range", "YCbCr full range"});
+  }
+
+  if (cfg.scaling_filter) {
+    dev.AddProperty(id, "SCALING_FILTER", DRM_MODE_PROP_ENUM, {0, 1}, 0,
+                    {"Default", "Nearest Neighbor"});
+  }
+
+  if (cfg.color_pipeline) {
+    /* Entries are the ids of the first colorops */
+    auto pipeline = AddSdrToPqColorPipeline(dev);
+    dev.AddObjectProperty(id, "COLOR_PIPELINE", DRM_MODE_PROP_ENUM,
+                          {0, pipeline}, 0,
+                          {"Bypass",
+                           "Color Pipeline " + std::to_string(pipeline)});
+  }
+
+  dev.planes.emplace_back(id);
+}
+
+auto GetFormatPlanes(uint32_t format) -> size_t {
+  switch (format) {
+    case DRM_FORMAT_NV12:
+    case DRM_FORMAT_NV21:
+    case DRM_FORMAT_NV15:
+    case DRM_FORMAT_NV16:
+    case DRM_FORMAT_P010:
+      return 2;
+    case DRM_FORMAT_YUV420:
+    case DRM_FORMAT_YVU420:
+      return 3;
+    default:
+      return 1;
+  }
+}
+
+auto GetBlobMode(FakeDevice &dev, uint64_t blob_id)
+    -> std::optional<drmModeModeInfo> {
+  auto blob = dev.blobs.find(uint32_t(blob_id));
+  if (blob == dev.blobs.end() || blob->second.size() < sizeof(drmModeModeInfo))
+    return {};
+
+  drmModeModeInfo mode{};
+  memcpy(&mode, blob->second.data(), sizeof(mode));
+  return mode;
+}
+
+auto GetPeriodNs(FakeDevice &dev, uint32_t crtc_id) -> int64_t {
+  auto mode = GetBlobMode(dev, dev.GetValue(crtc_id, "MODE_ID"));
+  if (!mode || mode->clock == 0)
+    return 0;
+
+  /* clock is in kHz */
+  return int64_t(mode->htotal) * mode->vtotal * 1000000 / mode->clock;
+}
+
+auto IsCrtcActive(FakeDevice &dev, uint32_t crtc_id) {
+  return dev.GetValue(crtc_id, "ACTIVE") != 0 && GetPeriodNs(dev, crtc_id) > 0;
+}
+
+/* Last vblank before |now| */
+auto GetVBlank(FakeDevice &dev, uint32_t crtc_id, int64_t now)
+    -> std::pair<uint64_t /*seq*/, int64_t /*ns*/> {
+  auto period = GetPeriodNs(dev, crtc_id);
+  auto epoch = dev.vblank_epochs[crtc_id];
+  auto seq = uint64_t((now - epoch) / period);
+  return {seq, epoch + int64_t(seq) * period};
+}
+
+void SendFlipEvent(FakeDevice &dev, uint32_t crtc_id, void *user_data) {
+  /* Flip completes on the next vblank */
+  auto [seq, ns] = GetVBlank(dev, crtc_id, GetTimeNs());
+  seq++;
+  ns += GetPeriodNs(dev, crtc_id);
+
+  struct drm_event_vblank ev {};
+  ev.base.type = DRM_EVENT_FLIP_COMPLETE;
+  ev.base.length = sizeof(ev);
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+  ev.user_data = reinterpret_cast<uintptr_t>(user_data);
+  ev.tv_sec = uint32_t(ns / kNsInSec);
+  ev.tv_usec = uint32_t((ns % kNsInSec) / 1000);
+  ev.sequence = uint32_t(seq);
+  ev.crtc_id = crtc_id;
+
+  if (write(*dev.event_fd, &ev, sizeof(ev)) != sizeof(ev))
+    ALOGW("Event queue is full, dropping flip event");
+}
+
+template <typename T>
+auto CopyArray(const std::vector<T> &v) -> T * {
+  if (v.empty())
+    return nullptr;
+
+  // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
+  auto *array = new T[v.size()];
+  std::copy(v.begin(), v.end(), array);
+  return array;
+}
+
+using PendingState = std::map<uint32_t /*obj*/,
+                              std::map<uint32_t /*prop*/, uint64_t>>;
+
+class AtomicCheck {
+ public:
+  AtomicCheck(FakeDevice &dev, const PendingState &pending)
+      : dev_(dev), pending_(pending){};
+
+  auto Get(uint32_t obj_id, const char *name) -> uint64_t {
+    auto obj = pending_.find(obj_id);
+    if (obj != pending_.end()) {
+      auto prop = obj->second.find(dev_.property_ids[name]);
+      if (prop != obj->second.end())
+        return prop->second;
+    }
+
+    return dev_.GetValue(obj_id, name);
+  }
+
+  auto IsChanged(uint32_t obj_id, const char *name) -> bool {
+    return Get(obj_id, name) != dev_.GetValue(obj_id, name);
+  }
+
+ private:
+  FakeDevice &dev_;
+  const PendingState &pending_;
+};
+
+auto IsSeamlessModeChange(FakeDevice &dev, uint64_t from_blob,
+                          uint64_t to_blob) -> bool {
+  auto from = GetBlobMode(dev, from_blob);
+  auto to = GetBlobMode(dev, to_blob);
+  return dev.config.seamless_refresh && from && to &&
+         from->hdisplay == to->hdisplay && from->vdisplay == to->vdisplay;
+}
+
+auto ValidateItem(FakeDevice &dev, uint32_t obj_id, uint32_t prop_id,
+                  uint64_t value) -> int {
+  if (dev.objects.count(obj_id) == 0 || dev.properties.count(prop_id) == 0)
+    return -ENOENT;
+
+  auto &props = dev.objects[obj_id].props;
+  if (std::none_of(props.begin(), props.end(),
+                   [prop_id](auto &p) { return p.first == prop_id; }))
+    return -ENOENT;
+
+  auto &prop = dev.properties[prop_id];
+  if ((prop.flags & DRM_MODE_PROP_IMMUTABLE) != 0)
+    return -EINVAL;
+
+  if ((prop.flags & DRM_MODE_PROP_BLOB) != 0 && value != 0 &&
+      dev.blobs.count(uint32_t(value)) == 0)
+    return -EINVAL;
+
+  if ((prop.flags & DRM_MODE_PROP_ENUM) != 0 &&
+      std::find(prop.values.begin(), prop.values.end(), value) ==
+          prop.values.end())
+    return -EINVAL;
+
+  if (prop.name == "FB_ID" && value != 0 && dev.fbs.count(uint32_t(value)) == 0)
+    return -ENOENT;
+
+  if (prop.name == "CRTC_ID" && value != 0 &&
+      std::find(dev.crtcs.begin(), dev.crtcs.end(), value) == dev.crtcs.end())
+    return -ENOENT;
+
+  return 0;
+}
+
+auto ValidatePlanes(FakeDevice &dev, AtomicCheck &state) -> int {
+  std::vector<FakePlaneState> active_planes;
+  for (size_t i = 0; i < dev.planes.size(); i++) {
+    auto plane_id = dev.planes[i];
+    auto &cfg = dev.config.planes[i];
+    auto fb_id = uint32_t(state.Get(plane_id, "FB_ID"));
+    auto crtc_id = uint32_t(state.Get(plane_id, "CRTC_ID"));
+
+    if ((fb_id == 0) != (crtc_id == 0))
+      return -EINVAL;
+
+    if (fb_id == 0)
+      continue;
+
+    auto crtc_index = std::find(dev.crtcs.begin(), dev.crtcs.end(), crtc_id) -
+                      dev.crtcs.begin();
+    if ((cfg.possible_crtcs & (1U << crtc_index)) == 0)
+      return -EINVAL;
+
+    /* Planes stay on a CRTC turned off, the CRTC is disabled without a mode */
+    if (state.Get(crtc_id, "MODE_ID") == 0)
+      return -EINVAL;
+
+    auto &fb = dev.fbs[fb_id];
+    if (std::find(cfg.formats.begin(), cfg.formats.end(), fb.format) ==
+        cfg.formats.end())
+      return -EINVAL;
+
+    FakePlaneState ps = {
+        .plane_id = plane_id,
+        .crtc_id = crtc_id,
+        .format = fb.format,
+        .crtc_x = int32_t(state.Get(plane_id, "CRTC_X")),
+        .crtc_y = int32_t(state.Get(plane_id, "CRTC_Y")),
+        .crtc_w = uint32_t(state.Get(plane_id, "CRTC_W")),
+        .crtc_h = uint32_t(state.Get(plane_id, "CRTC_H")),
+        .src_x = uint32_t(state.Get(plane_id, "SRC_X")),
+        .src_y = uint32_t(state.Get(plane_id, "SRC_Y")),
+        .src_w = uint32_t(state.Get(plane_id, "SRC_W")),
+        .src_h = uint32_t(state.Get(plane_id, "SRC_H")),
+        .zpos = cfg.zpos ? state.Get(plane_id, "zpos") : i,
+        .scaling_filter = state.Get(plane_id, "SCALING_FILTER"),
+    };
+
+    if (ps.crtc_w == 0 || ps.crtc_h == 0 || ps.src_w == 0 || ps.src_h == 0)
+      return -EINVAL;
+
+    constexpr int kFixedPointShift = 16;
+    if (uint64_t(ps.src_x) + ps.src_w > uint64_t(fb.width) << kFixedPointShift ||
+        uint64_t(ps.src_y) + ps.src_h > uint64_t(fb.height) << kFixedPointShift)
+      return -ENOSPC;
+
+    if (!cfg.scaling && ((ps.src_w >> kFixedPointShift) != ps.crtc_w ||
+                         (ps.src_h >> kFixedPointShift) != ps.crtc_h))
+      return -ERANGE;
+
+    constexpr double kFixedPointOne = 1 << kFixedPointShift;
+    auto scale_x = double(ps.crtc_w) * kFixedPointOne / ps.src_w;
+    auto scale_y = double(ps.crtc_h) * kFixedPointOne / ps.src_h;
+    if (cfg.min_scale != 0 && std::min(scale_x, scale_y) < cfg.min_scale)
+      return -ERANGE;
+
+    if (cfg.max_scale != 0 && std::max(scale_x, scale_y) > cfg.max_scale)
+      return -ERANGE;
+
+    constexpr uint32_t kFractionMask = (1U << kFixedPointShift) - 1;
+    if (!cfg.subpixel_src &&
+        ((ps.src_x | ps.src_y) & kFractionMask) != 0)
+      return -EINVAL;
+
+    active_planes.emplace_back(ps);
+  }
+
+  if (dev.commit_check)
+    return dev.commit_check(active_planes);
+
+  return 0;
+}
+
+auto Commit(FakeDevice &dev, drmModeAtomicReq &req, uint32_t flags,
+            void *user_data) -> int {
+  PendingState pending;
+  for (auto &[obj_id, prop_id, value] : req.items) {
+    auto err = ValidateItem(dev, obj_id, prop_id, value);
+    if (err != 0)
+      return err;
+
+    pending[obj_id][prop_id] = value;
+  }
+
+  AtomicCheck state(dev, pending);
+
+  auto modeset = false;
+  for (auto crtc_id : dev.crtcs) {
+    modeset |= state.IsChanged(crtc_id, "ACTIVE") ||
+               (state.IsChanged(crtc_id, "MODE_ID") &&
+                !IsSeamlessModeChange(dev, dev.GetValue(crtc_id, "MODE_ID"),
+                                      state.Get(crtc_id, "MODE_ID")));
+    if (state.Get(crtc_id, "ACTIVE") != 0 && state.Get(crtc_id, "MODE_ID") == 0)
+      return -EINVAL;
+  }
+  for (auto conn_id : dev.connectors)
+    modeset |= state.IsChanged(conn_id, "CRTC_ID");
+
+  if (modeset && (flags & DRM_MODE_ATOMIC_ALLOW_MODESET) == 0)
+    return -EINVAL;
+
+  auto err = ValidatePlanes(dev, state);
+  if (err != 0 || (flags & DRM_MODE_ATOMIC_TEST_ONLY) != 0)
+    return err;
+
+  dev.stats.modesets += modeset ? 1 : 0;
+
+  auto now = GetTimeNs();
+  std::vector<uint32_t> flipped_crtcs;
+  for (auto &[obj_id, props] : pending) {
+    auto &obj = dev.objects[obj_id];
+    for (auto &[id, value] : obj.props) {
+      if (props.count(id) != 0)
+        value = props[id];
+    }
+
+    if (obj.type != DRM_MODE_OBJECT_CRTC)
+      continue;
+
+    /* Pointer is valid only for the duration of the commit */
+    auto fence_ptr_id = dev.property_ids["OUT_FENCE_PTR"];
+    if (props.count(fence_ptr_id) != 0 && props[fence_ptr_id] != 0) {
+      /* Frames are "displayed" immediately, fence is born signaled */
+      // NOLINTNEXTLINE(performance-no-int-to-ptr)
+      *reinterpret_cast<int32_t *>(props[fence_ptr_id]) = eventfd(1,
+                                                                  EFD_CLOEXEC);
+    }
+    for (auto &[id, value] : obj.props) {
+      if (id == fence_ptr_id)
+        value = 0;
+    }
+
+    if (props.count(dev.property_ids["ACTIVE"]) != 0 ||
+        props.count(dev.property_ids["MODE_ID"]) != 0)
+      dev.vblank_epochs[obj_id] = now;
+
+    flipped_crtcs.emplace_back(obj_id);
+  }
+  dev.ReleaseDestroyedBlobs();
+
+  for (auto plane_id : dev.planes) {
+    auto crtc_id = uint32_t(dev.GetValue(plane_id, "CRTC_ID"));
+    if (pending.count(plane_id) != 0 && crtc_id != 0)
+      flipped_crtcs.emplace_back(crtc_id);
+  }
+
+  std::sort(flipped_crtcs.begin(), flipped_crtcs.end());
+  flipped_crtcs.erase(std::unique(flipped_crtcs.begin(), flipped_crtcs.end()),
+                      flipped_crtcs.end());
+
+  if ((flags & DRM_MODE_PAGE_FLIP_EVENT) != 0) {
+    for (auto crtc_id : flipped_crtcs) {
+      if (IsCrtcActive(dev, crtc_id))
+        SendFlipEvent(dev, crtc_id, user_data);
+    }
+  }
+
+  return 0;
+}
+
+/* As left by the firmware, scanning out a full-screen framebuffer */
+void ShowBootSplash(FakeDevice &dev) {
+  std::set<uint32_t> used_planes;
+  auto count = std::min(dev.crtcs.size(), dev.connectors.size());
+  for (size_t i = 0; i < count; i++) {
+    auto &modes = dev.config.connectors[i].modes;
+    if (modes.empty())
+      continue;
+
+    auto &mode = modes[0];
+    auto crtc_id = dev.crtcs[i];
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    auto *data = reinterpret_cast<const uint8_t *>(&mode);
+    dev.SetValue(crtc_id, "ACTIVE", 1);
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    dev.SetValue(crtc_id, "MODE_ID", dev.AddBlob({data, data + sizeof(mode)}));
+    dev.SetValue(dev.connectors[i], "CRTC_ID", crtc_id);
+    dev.SetValue(dev.connectors[i], "DPMS", DRM_MODE_DPMS_ON);
+
+    for (size_t p = 0; p < dev.planes.size(); p++) {
+      auto &cfg = dev.config.planes[p];
+      if (cfg.type != DRM_PLANE_TYPE_PRIMARY ||
+          (cfg.possible_crtcs & (1U << i)) == 0 ||
+          used_planes.count(dev.planes[p]) != 0)
+        continue;
+
+      auto fb_id = dev.NewId();
+      dev.fbs[fb_id] = {
+          .width = mode.hdisplay,
+          .height = mode.vdisplay,
+          .format = DRM_FORMAT_XRGB8888,
+      };
+
+      constexpr int kFixedPointShift = 16;
+      auto plane_id = dev.planes[p];
+      used_planes.emplace(plane_id);
+      dev.SetValue(plane_id, "FB_ID", fb_id);
+      dev.SetValue(plane_id, "CRTC_ID", crtc_id);
+      dev.SetValue(plane_id, "CRTC_W", mode.hdisplay);
+      dev.SetValue(plane_id, "CRTC_H", mode.vdisplay);
+      dev.SetValue(plane_id, "SRC_W",
+                   uint64_t(mode.hdisplay) << kFixedPointShift);
+      dev.SetValue(plane_id, "SRC_H",
+                   uint64_t(mode.vdisplay) << kFixedPointShift);
+      break;
+    }
+  }
+}
+
+}  // namespace
+
+auto FakeDrm::Install(const FakeDeviceConfig &config) -> std::string {
+  Uninstall();
+
+  auto dev = std::make_unique<FakeDevice>();
+  dev->config = config;
+
+  std::string dir_template = "/tmp/hwc-fake-drm-XXXXXX";
+  if (mkdtemp(dir_template.data()) == nullptr) {
+    ALOGE("Failed to create device directory: %s", strerror(errno));
+    return {};
+  }
+  dev->dir = dir_template;
+  dev->path = dev->dir + "/card0";
+
+  /* FIFO is pollable, so the composer can serve it by its reactor */
+  if (mkfifo(dev->path.c_str(), S_IRUSR | S_IWUSR) != 0) {
+    ALOGE("Failed to create device node: %s", strerror(errno));
+    rmdir(dev->dir.c_str());
+    return {};
+  }
+
+  dev->event_fd = MakeUniqueFd(
+      open(dev->path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC));
+  if (!dev->event_fd) {
+    ALOGE("Failed to open device node: %s", strerror(errno));
+    unlink(dev->path.c_str());
+    rmdir(dev->dir.c_str());
+    return {};
+  }
+
+  for (int i = 0; i < config.crtc_count; i++)
+    AddCrtc(*dev);
+
+  for (size_t i = 0; i < config.connectors.size(); i++)
+    AddConnector(*dev, config.connectors[i]);
+
+  for (size_t i = 0; i < config.planes.size(); i++)
+    AddPlane(*dev, config.planes[i], i);
+
+  if (config.boot_splash)
+    ShowBootSplash(*dev);
+
+  const std::lock_guard<std::mutex> lock(gMutex);
+  gDevice = std::move(dev);
+  return gDevice->path;
+}
+
+void FakeDrm::Uninstall() {
+  const std::lock_guard<std::mutex> lock(gMutex);
+  if (!gDevice)
+    return;
+
+  unlink(gDevice->path.c_str());
+  rmdir(gDevice->dir.c_str());
+  gDevice.reset();
+}
+
+void FakeDrm::SetCommitCheck(CommitCheck check) {
+  const std::lock_guard<std::mutex> lock(gMutex);
+  if (gDevice)
+    gDevice->commit_check = std::move(check);
+}
+
+auto FakeDrm::GetStats() -> Stats {
+  const std::lock_guard<std::mutex> lock(gMutex);
+  return gDevice ? gDevice->stats : Stats{};
+}
+
+void FakeDrm::ResetStats() {
+  const std::lock_guard<std::mutex> lock(gMutex);
+  if (gDevice)
+    gDevice->stats = {};
+}
+
+auto FakeDrm::MakeMode(uint16_t width, uint16_t height, uint32_t refresh)
+    -> drmModeModeInfo {
+  constexpr uint16_t kHBlank = 160;
+  constexpr uint16_t kVBlank = 45;
+
+  drmModeModeInfo mode{};
+  mode.hdisplay = width;
+  mode.hsync_start = width + 48;
+  mode.hsync_end = width + 80;
+  mode.htotal = width + kHBlank;
+  mode.vdisplay = height;
+  mode.vsync_start = height + 3;
+  mode.vsync_end = height + 8;
+  mode.vtotal = height + kVBlank;
+  mode.vrefresh = refresh;
+  mode.clock = uint32_t(uint64_t(mode.htotal) * mode.vtotal * refresh / 1000);
+  mode.type = DRM_MODE_TYPE_DRIVER;
+  snprintf(mode.name, sizeof(mode.name), "%ux%u", width, height);
+  return mode;
+}
+
+}  // namespace android
+
+using android::CopyArray;
+using android::gDevice;
+using android::GetTimeNs;
+using android::GetFormatPlanes;
+using android::GetVBlank;
+using android::gMutex;
+using android::IsCrtcActive;
+using android::kEncoderTypeTmds;
+
+/* libdrm entry points. The device fd is ignored, there is only one device */
+
+// NOLINTNEXTLINE(cppcoreguidelines-macro-usage)
+#define FAKE_DRM_LOCK_OR_RETURN(ret)              \
+  const std::lock_guard<std::mutex> lock(gMutex); \
+  if (!gDevice) {                                 \
+    return ret;                                   \
+  }                                               \
+  auto &dev = *gDevice
+
+int drmIoctl(int /*fd*/, unsigned long request, void *arg) {
+  FAKE_DRM_LOCK_OR_RETURN(-ENODEV);
+
+  switch (request) {
+    case DRM_IOCTL_MODE_CREATEPROPBLOB: {
+      auto *create = static_cast<drm_mode_create_blob *>(arg);
+      // NOLINTNEXTLINE(performance-no-int-to-ptr)
+      auto *data = reinterpret_cast<const uint8_t *>(create->data);
+      create->blob_id = dev.NewId();
+      // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+      dev.blobs[create->blob_id].assign(data, data + create->length);
+      return 0;
+    }
+    case DRM_IOCTL_MODE_DESTROYPROPBLOB: {
+      auto *destroy = static_cast<drm_mode_destroy_blob *>(arg);
+      if (dev.blobs.count(destroy->blob_id) == 0 ||
+          dev.destroyed_blobs.count(destroy->blob_id) != 0)
+        return -ENOENT;
+
+      dev.destroyed_blobs.emplace(destroy->blob_id);
+      dev.ReleaseDestroyedBlobs();
+      return 0;
+    }
+    case DRM_IOCTL_MODE_CREATE_DUMB: {
+      auto *create = static_cast<drm_mode_create_dumb *>(arg);
+      if (create->width == 0 || create->height == 0 || create->bpp == 0)
+        return -EINVAL;
+
+      constexpr uint32_t kBitsInByte = 8;
+      create->handle = dev.NewId();
+      create->pitch = create->width * create->bpp / kBitsInByte;
+      create->size = uint64_t(create->pitch) * create->height;
+      dev.dumb_handles.emplace(create->handle);
+      return 0;
+    }
+    case DRM_IOCTL_MODE_DESTROY_DUMB: {
+      auto *destroy = static_cast<drm_mode_destroy_dumb *>(arg);
+      return dev.dumb_handles.erase(destroy->handle) != 0 ? 0 : -ENOENT;
+    }
+    case DRM_IOCTL_GEM_CLOSE: {
+      auto *close = static_cast<drm_gem_close *>(arg);
+      auto it = std::find_if(dev.gem_handles.begin(), dev.gem_handles.end(),
+                             [close](auto &h) {
+                               return h.second == close->handle;
+                             });
+      if (it != dev.gem_handles.end())
+        dev.gem_handles.erase(it);
+      return 0;
+    }
+    default:
+      errno = EINVAL;
+      return -1;
+  }
+}
+
+drmVersionPtr drmGetVersion(int /*fd*/) {
+  FAKE_DRM_LOCK_OR_RETURN(nullptr);
+
+  // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
+  auto *ver = new drmVersion{};
+  auto &name = dev.config.driver_name;
+  ver->name = CopyArray(std::vector<char>(name.c_str(),
+                                          name.c_str() + name.size() + 1));
+  ver->name_len = int(name.size());
+  ver->date = CopyArray(std::vector<char>{'\0'});
+  ver->desc = CopyArray(std::vector<char>{'\0'});
+  return ver;
+}
+
+void drmFreeVersion(drmVersionPtr ver) {
+  if (ver == nullptr)
+    return;
+
+  // NOLINTBEGIN(cppcoreguidelines-owning-memory)
+  delete[] ver->name;
+  delete[] ver->date;
+  delete[] ver->desc;
+  delete ver;
+  // NOLINTEND(cppcoreguidelines-owning-memory)
+}
+
+int drmGetCap(int /*fd*/, uint64_t capability, uint64_t *value) {
+  switch (capability) {
+    case DRM_CAP_ADDFB2_MODIFIERS:
+    case DRM_CAP_CRTC_IN_VBLANK_EVENT:
+      *value = 1;
+      return 0;
+    default:
+      return -EINVAL;
+  }
+}
+
+int drmSetClientCap(int /*fd*/, uint64_t /*capability*/, uint64_t /*value*/) {
+  return 0;
+}
+
+int drmSetMaster(int /*fd*/) {
+  return 0;
+}
+
+int drmIsMaster(int /*fd*/) {
+  return 1;
+}
+
+/* vblank events are not emulated, VSyncWorker falls back to its timer */
+int drmWaitVBlank(int /*fd*/, drmVBlankPtr /*vbl*/) {
+  errno = EOPNOTSUPP;
+  return -1;
+}
+
+int drmCrtcGetSequence(int /*fd*/, uint32_t crtc_id, uint64_t *sequence,
+                       uint64_t *ns) {
+  FAKE_DRM_LOCK_OR_RETURN(-ENODEV);
+
+  if (!IsCrtcActive(dev, crtc_id))
+    return -EINVAL;
+
+  auto [seq, seq_ns] = GetVBlank(dev, crtc_id, GetTimeNs());
+  *sequence = seq;
+  *ns = uint64_t(seq_ns);
+  return 0;
+}
+
+int drmPrimeFDToHandle(int /*fd*/, int prime_fd, uint32_t *handle) {
+  FAKE_DRM_LOCK_OR_RETURN(-ENODEV);
+
+  struct stat sb {};
+  if (fstat(prime_fd, &sb) != 0)
+    return -errno;
+
+  /* Same buffer, same handle */
+  if (dev.gem_handles.count(sb.st_ino) == 0)
+    dev.gem_handles[sb.st_ino] = dev.NewId();
+
+  *handle = dev.gem_handles[sb.st_ino];
+  return 0;
+}
+
+drmModeResPtr drmModeGetResources(int /*fd*/) {
+  FAKE_DRM_LOCK_OR_RETURN(nullptr);
+
+  // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
+  auto *res = new drmModeRes{};
+  res->count_crtcs = int(dev.crtcs.size());
+  res->crtcs = CopyArray(dev.crtcs);
+  res->count_connectors = int(dev.connectors.size());
+  res->connectors = CopyArray(dev.connectors);
+  res->count_encoders = int(dev.encoders.size());
+  res->encoders = CopyArray(dev.encoders);
+  res->max_width = dev.config.max_width;
+  res->max_height = dev.config.max_height;
+  return res;
+}
+
+void drmModeFreeResources(drmModeResPtr res) {
+  if (res == nullptr)
+    return;
+
+  // NOLINTBEGIN(cppcoreguidelines-owning-memory)
+  delete[] res->crtcs;
+  delete[] res->connectors;
+  delete[] res->encoders;
+  delete res;
+  // NOLINTEND(cppcoreguidelines-owning-memory)
+}
+
+drmModeCrtcPtr drmModeGetCrtc(int /*fd*/, uint32_t crtc_id) {
+  FAKE_DRM_LOCK_OR_RETURN(nullptr);
+
+  if (std::find(dev.crtcs.begin(), dev.crtcs.end(), crtc_id) ==
+      dev.crtcs.end())
+    return nullptr;
+
+  // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
+  auto *crtc = new drmModeCrtc{};
+  crtc->crtc_id = crtc_id;
+
+  auto blob_id = uint32_t(dev.GetValue(crtc_id, "MODE_ID"));
+  if (dev.blobs.count(blob_id) != 0 &&
+      dev.blobs[blob_id].size() >= sizeof(drmModeModeInfo)) {
+    memcpy(&crtc->mode, dev.blobs[blob_id].data(), sizeof(crtc->mode));
+    crtc->mode_valid = 1;
+    crtc->width = crtc->mode.hdisplay;
+    crtc->height = crtc->mode.vdisplay;
+  }
+
+  return crtc;
+}
+
+void drmModeFreeCrtc(drmModeCrtcPtr crtc) {
+  // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
+  delete crtc;
+}
+
+drmModeEncoderPtr drmModeGetEncoder(int /*fd*/, uint32_t encoder_id) {
+  FAKE_DRM_LOCK_OR_RETURN(nullptr);
+
+  if (std::find(dev.encoders.begin(), dev.encoders.end(), encoder_id) ==
+      dev.encoders.end())
+    return nullptr;
+
+  // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
+  auto *enc = new drmModeEncoder{};
+  enc->encoder_id = encoder_id;
+  enc->encoder_type = kEncoderTypeTmds;
+  enc->possible_crtcs = (1U << dev.crtcs.size()) - 1;
+  return enc;
+}
+
+void drmModeFreeEncoder(drmModeEncoderPtr enc) {
+  // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
+  delete enc;
+}
+
+drmModeConnectorPtr drmModeGetConnector(int /*fd*/, uint32_t connector_id) {
+  FAKE_DRM_LOCK_OR_RETURN(nullptr);
+
+  auto it = std::find(dev.connectors.begin(), dev.connectors.end(),
+                      connector_id);
+  if (it == dev.connectors.end())
+    return nullptr;
+
+  auto index = size_t(it - dev.connectors.begin());
+  auto &cfg = dev.config.connectors[index];
+
+  // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
+  auto *conn = new drmModeConnector{};
+  conn->connector_id = connector_id;
+  conn->connector_type = cfg.type;
+  conn->connector_type_id = uint32_t(index + 1);
+  conn->connection = DRM_MODE_CONNECTED;
+  conn->mmWidth = cfg.mm_width;
+  conn->mmHeight = cfg.mm_height;
+  conn->subpixel = DRM_MODE_SUBPIXEL_UNKNOWN;
+
+  auto modes = cfg.modes;
+  if (!modes.empty())
+    modes[0].type |= DRM_MODE_TYPE_PREFERRED;
+  conn->count_modes = int(modes.size());
+  conn->modes = CopyArray(modes);
+
+  std::vector<uint32_t> props;
+  std::vector<uint64_t> values;
+  for (auto &[id, value] : dev.objects[connector_id].props) {
+    props.emplace_back(id);
+    values.emplace_back(value);
+  }
+  conn->count_props = int(props.size());
+  conn->props = CopyArray(props);
+  conn->prop_values = CopyArray(values);
+
+  conn->count_encoders = 1;
+  conn->encoders = CopyArray(std::vector<uint32_t>{dev.encoders[index]});
+  return conn;
+}
+
+void drmModeFreeConnector(drmModeConnectorPtr conn) {
+  if (conn == nullptr)
+    return;
+
+  // NOLINTBEGIN(cppcoreguidelines-owning-memory)
+  delete[] conn->modes;
+  delete[] conn->props;
+  delete[] conn->prop_values;
+  delete[] conn->encoders;
+  delete conn;
+  // NOLINTEND(cppcoreguidelines-owning-memory)
+}
+
+drmModePlaneResPtr drmModeGetPlaneResources(int /*fd*/) {
+  FAKE_DRM_LOCK_OR_RETURN(nullptr);
+
+  // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
+  auto *res = new drmModePlaneRes{};
+  res->count_planes = uint32_t(dev.planes.size());
+  res->planes = CopyArray(dev.planes);
+  return res;
+}
+
+void drmModeFreePlaneResources(drmModePlaneResPtr res) {
+  if (res == nullptr)
+    return;
+
+  // NOLINTBEGIN(cppcoreguidelines-owning-memory)
+  delete[] res->planes;
+  delete res;
+  // NOLINTEND(cppcoreguidelines-owning-memory)
+}
+
+drmModePlanePtr drmModeGetPlane(int /*fd*/, uint32_t plane_id) {
+  FAKE_DRM_LOCK_OR_RETURN(nullptr);
+
+  auto it = std::find(dev.planes.begin(), dev.planes.end(), plane_id);
+  if (it == dev.planes.end())
+    return nullptr;
+
+  auto &cfg = dev.config.planes[it - dev.planes.begin()];
+
+  // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
+  auto *plane = new drmModePlane{};
+  plane->plane_id = plane_id;
+  plane->crtc_id = uint32_t(dev.GetValue(plane_id, "CRTC_ID"));
+  plane->fb_id = uint32_t(dev.GetValue(plane_id, "FB_ID"));
+  plane->possible_crtcs = cfg.possible_crtcs & ((1U << dev.crtcs.size()) - 1);
+  plane->count_formats = uint32_t(cfg.formats.size());
+  plane->formats = CopyArray(cfg.formats);
+  return plane;
+}
+
+void drmModeFreePlane(drmModePlanePtr plane) {
+  if (plane == nullptr)
+    return;
+
+  // NOLINTBEGIN(cppcoreguidelines-owning-memory)
+  delete[] plane->formats;
+  delete plane;
+  // NOLINTEND(cppcoreguidelines-owning-memory)
+}
+
+drmModeObjectPropertiesPtr drmModeObjectGetProperties(int /*fd*/,
+                                                      uint32_t object_id,
+                                                      uint32_t object_type) {
+  FAKE_DRM_LOCK_OR_RETURN(nullptr);
+
+  if (dev.objects.count(object_id) == 0 ||
+      dev.objects[object_id].type != object_type)
+    return nullptr;
+
+  std::vector<uint32_t> props;
+  std::vector<uint64_t> values;
+  for (auto &[id, value] : dev.objects[object_id].props) {
+    props.emplace_back(id);
+    values.emplace_back(value);
+  }
+
+  // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
+  auto *res = new drmModeObjectProperties{};
+  res->count_props = uint32_t(props.size());
+  res->props = CopyArray(props);
+  res->prop_values = CopyArray(values);
+  return res;
+}
+
+void drmModeFreeObjectProperties(drmModeObjectPropertiesPtr props) {
+  if (props == nullptr)
+    return;
+
+  // NOLINTBEGIN(cppcoreguidelines-owning-memory)
+  delete[] props->props;
+  delete[] props->prop_values;
+  delete props;
+  // NOLINTEND(cppcoreguidelines-owning-memory)
+}
+
+drmModePropertyPtr drmModeGetProperty(int /*fd*/, uint32_t property_id) {
+  FAKE_DRM_LOCK_OR_RETURN(nullptr);
+
+  if (dev.properties.count(property_id) == 0)
+    return nullptr;
+
+  auto &prop = dev.properties[property_id];
+
+  // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
+  auto *res = new drmModePropertyRes{};
+  res->prop_id = property_id;
+  res->flags = prop.flags;
+  snprintf(res->name, sizeof(res->name), "%s", prop.name.c_str());
+  res->count_values = int(prop.values.size());
+  res->values = CopyArray(prop.values);
+
+  std::vector<drm_mode_property_enum> enums(prop.enums.size());
+  for (size_t i = 0; i < enums.size(); i++) {
+    enums[i].value = prop.values[i];
+    snprintf(enums[i].name, sizeof(enums[i].name), "%s",
+             prop.enums[i].c_str());
+  }
+  res->count_enums = int(enums.size());
+  res->enums = CopyArray(enums);
+  return res;
+}
+
+void drmModeFreeProperty(drmModePropertyPtr prop) {
+  if (prop == nullptr)
+    return;
+
+  // NOLINTBEGIN(cppcoreguidelines-owning-memory)
+  delete[] prop->values;
+  delete[] prop->enums;
+  delete prop;
+  // NOLINTEND(cppcoreguidelines-owning-memory)
+}
+
+drmModePropertyBlobPtr drmModeGetPropertyBlob(int /*fd*/, uint32_t blob_id) {
+  FAKE_DRM_LOCK_OR_RETURN(nullptr);
+
+  if (dev.blobs.count(blob_id) == 0)
+    return nullptr;
+
+  auto &data = dev.blobs[blob_id];
+
+  // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
+  auto *blob = new drmModePropertyBlobRes{};
+  blob->id = blob_id;
+  blob->length = uint32_t(data.size());
+  blob->data = CopyArray(data);
+  return blob;
+}
+
+void drmModeFreePropertyBlob(drmModePropertyBlobPtr blob) {
+  if (blob == nullptr)
+    return;
+
+  // NOLINTBEGIN(cppcoreguidelines-owning-memory)
+  delete[] static_cast<uint8_t *>(blob->data);
+  delete blob;
+  // NOLINTEND(cppcoreguidelines-owning-memory)
+}
+
+int drmModeConnectorSetProperty(int /*fd*/, uint32_t connector_id,
+                                uint32_t property_id, uint64_t value) {
+  FAKE_DRM_LOCK_OR_RETURN(-ENODEV);
+
+  for (auto &[id, val] : dev.objects[connector_id].props) {
+    if (id == property_id) {
+      val = value;
+      return 0;
+    }
+  }
+
+  return -EINVAL;
+}
+
+int drmModeAddFB2WithModifiers(int /*fd*/, uint32_t width, uint32_t height,
+                               uint32_t pixel_format,
+                               const uint32_t bo_handles[4],
+                               const uint32_t pitches[4],
+                               const uint32_t offsets[4],
+                               const uint64_t /*modifier*/[4],
+                               uint32_t *buf_id, uint32_t /*flags*/) {
+  FAKE_DRM_LOCK_OR_RETURN(-ENODEV);
+
+  if (width == 0 || height == 0 || width > dev.config.max_width ||
+      height > dev.config.max_height)
+    return -EINVAL;
+
+  /* As drm_framebuffer_check(), every plane of the format and nothing else */
+  constexpr size_t kMaxPlanes = 4;
+  auto planes = GetFormatPlanes(pixel_format);
+  for (size_t i = 0; i < kMaxPlanes; i++) {
+    // NOLINTBEGIN(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    if (i < planes ? bo_handles[i] == 0
+                   : bo_handles[i] != 0 || pitches[i] != 0 || offsets[i] != 0)
+      return -EINVAL;
+    // NOLINTEND(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  }
+
+  *buf_id = dev.NewId();
+  dev.fbs[*buf_id] = {
+      .width = width,
+      .height = height,
+      .format = pixel_format,
+  };
+  dev.stats.fbs_created++;
+  return 0;
+}
+
+int drmModeAddFB2(int fd, uint32_t width, uint32_t height,
+                  uint32_t pixel_format, const uint32_t bo_handles[4],
+                  const uint32_t pitches[4], const uint32_t offsets[4],
+                  uint32_t *buf_id, uint32_t flags) {
+  return drmModeAddFB2WithModifiers(fd, width, height, pixel_format,
+                                    bo_handles, pitches, offsets, nullptr,
+                                    buf_id, flags);
+}
+
+int drmModeRmFB(int /*fd*/, uint32_t buffer_id) {
+  FAKE_DRM_LOCK_OR_RETURN(-ENODEV);
+
+  if (dev.fbs.erase(buffer_id) == 0)
+    return -ENOENT;
+
+  dev.stats.fbs_removed++;
+  return 0;
+}
+
+drmModeAtomicReqPtr drmModeAtomicAlloc() {
+  // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
+  return new drmModeAtomicReq{};
+}
+
+void drmModeAtomicFree(drmModeAtomicReqPtr req) {
+  // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
+  delete req;
+}
+
+int drmModeAtomicAddProperty(drmModeAtomicReqPtr req, uint32_t object_id,
+                             uint32_t property_id, uint64_t value) {
+  if (req == nullptr)
+    return -EINVAL;
+
+  req->items.emplace_back(object_id, property_id, value);
+  return int(req->items.size());
+}
+
+int drmModeAtomicCommit(int /*fd*/, drmModeAtomicReqPtr req, uint32_t flags,
+                        void *user_data) {
+  FAKE_DRM_LOCK_OR_RETURN(-ENODEV);
+
+  auto test_only = (flags & DRM_MODE_ATOMIC_TEST_ONLY) != 0;
+  auto err = android::Commit(dev, *req, flags, user_data);
+  if (test_only) {
+    dev.stats.test_commits++;
+    dev.stats.failed_test_commits += err != 0 ? 1 : 0;
+  } else {
+    dev.stats.commits++;
+    dev.stats.failed_commits += err != 0 ? 1 : 0;
+  }
+
+  return err;
+}
@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <xf86drmMode.h>
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace android {
+
+/* In-memory KMS device, backing the libdrm entry points of the host build.
+ *
+ * Only one device exists at a time. It is opened through a FIFO node, which
+ * also carries the DRM events (flip completion) to the composer, so the DRM
+ * fd can be served by the reactor like a real one.
+ */
+struct FakePlaneConfig {
+  uint32_t type = DRM_PLANE_TYPE_OVERLAY;
+  std::vector<uint32_t> formats;
+  uint32_t possible_crtcs = UINT32_MAX;
+  bool zpos = true;
+  bool rotation = false;
+  bool alpha = true;
+  bool blend = true;
+  bool scaling = true;
+  /* Scaling limits as display frame / source size, 0 is unlimited */
+  double min_scale = 0;
+  double max_scale = 0;
+  /* Source position with a fractional part */
+  bool subpixel_src = true;
+  bool scaling_filter = false;
+  /* COLOR_ENCODING and COLOR_RANGE of YCbCr formats */
+  bool color_encoding = false;
+  /* COLOR_PIPELINE bringing SDR content to PQ: sRGB EOTF, multiplier and
+   * PQ 125 inverse EOTF colorops
+   */
+  bool color_pipeline = false;
+};
+
+struct FakeConnectorConfig {
+  uint32_t type = DRM_MODE_CONNECTOR_HDMIA;
+  uint32_t mm_width = 600;
+  uint32_t mm_height = 340;
+  std::vector<drmModeModeInfo> modes;
+  /* Exposed as the EDID blob if not empty */
+  std::vector<uint8_t> edid;
+  /* HDR_OUTPUT_METADATA and Colorspace */
+  bool hdr = false;
+};
+
+struct FakeDeviceConfig {
+  std::string driver_name = "fake";
+  int crtc_count = 1;
+  uint32_t max_width = 8192;
+  uint32_t max_height = 8192;
+  /* Modes of the same size are switched without a modeset */
+  bool seamless_refresh = false;
+  /* CRTCs come up lit by the firmware, each driving the connector of the
+   * same index in its first mode with a splash on a primary plane
+   */
+  bool boot_splash = false;
+  std::vector<FakeConnectorConfig> connectors;
+  std::vector<FakePlaneConfig> planes;
+};
+
+/* Plane state of an atomic commit being checked */
+struct FakePlaneState {
+  uint32_t plane_id;
+  uint32_t crtc_id;
+  uint32_t format;
+  int32_t crtc_x, crtc_y;
+  uint32_t crtc_w, crtc_h;
+  /* 16.16 fixed point */
+  uint32_t src_x, src_y, src_w, src_h;
+  uint64_t zpos;
+  /* 0 is "Default", 1 is "Nearest Neighbor" */
+  uint64_t scaling_filter;
+};
+
+class FakeDrm {
+ public:
+  FakeDrm() = delete;
+
+  /* Replaces the current device. Returns the node path to be passed in
+   * vendor.hwc.drm.device, empty string on failure.
+   */
+  static auto Install(const FakeDeviceConfig &config) -> std::string;
+  static void Uninstall();
+
+  /* Extra driver-specific check, called for every atomic commit after the
+   * generic validation. Returns 0 or a negative errno.
+   */
+  using CommitCheck =
+      std::function<int(const std::vector<FakePlaneState> &planes)>;
+  static void SetCommitCheck(CommitCheck check);
+
+  struct Stats {
+    uint64_t commits{};
+    uint64_t test_commits{};
+    uint64_t failed_commits{};
+    uint64_t failed_test_commits{};
+    /* Committed, blanking the display */
+    uint64_t modesets{};
+    uint64_t fbs_created{};
+    uint64_t fbs_removed{};
+  };
+
+  static auto GetStats() -> Stats;
+  static void ResetStats();
+
+  /* Mode with reduced blanking timings */
+  static auto MakeMode(uint16_t width, uint16_t height, uint32_t refresh)
+      -> drmModeModeInfo;
+};
+
+}  // namespace android
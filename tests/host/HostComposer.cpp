@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "hwc-host-composer"
+
+#include "HostComposer.h"
+
+#include <cstdlib>
+
+#include "utils/log.h"
+
+namespace android {
+
+auto HostComposer::CreateInstance(const FakeDeviceConfig &config)
+    -> std::unique_ptr<HostComposer> {
+  auto path = FakeDrm::Install(config);
+  if (path.empty())
+    return {};
+
+  setenv("vendor.hwc.drm.device", path.c_str(), 1);
+
+  auto composer = std::unique_ptr<HostComposer>(new HostComposer());
+  const std::unique_lock lock(composer->GetMainLock());
+  composer->hwc.RegisterCallback(HWC2_CALLBACK_HOTPLUG, composer.get(),
+                                 // NOLINTNEXTLINE(*-reinterpret-cast)
+                                 reinterpret_cast<hwc2_function_pointer_t>(
+                                     &HostComposer::OnHotplug));
+
+  composer->display = composer->hwc.GetDisplay(kPrimaryDisplay);
+  if (composer->display == nullptr || composer->display->IsInHeadlessMode()) {
+    ALOGE("Fake display was not detected");
+    return {};
+  }
+
+  if (composer->display->SetPowerMode(HWC2_POWER_MODE_ON) !=
+      HWC2::Error::None) {
+    ALOGE("Failed to power on the display");
+    return {};
+  }
+
+  return composer;
+}
+
+HostComposer::~HostComposer() {
+  {
+    const std::unique_lock lock(GetMainLock());
+    hwc.RegisterCallback(HWC2_CALLBACK_HOTPLUG, nullptr, nullptr);
+  }
+  FakeDrm::Uninstall();
+}
+
+void HostComposer::OnHotplug(hwc2_callback_data_t /*data*/,
+                             hwc2_display_t /*display*/,
+                             int32_t /*connected*/) {
+}
+
+}  // namespace android
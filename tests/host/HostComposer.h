@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+
+#include "FakeDrm.h"
+#include "hwc2_device/DrmHwcTwo.h"
+
+namespace android {
+
+/* Composer instance bound to a freshly installed fake device, with the
+ * primary display powered on.
+ */
+class HostComposer {
+ public:
+  static auto CreateInstance(const FakeDeviceConfig &config)
+      -> std::unique_ptr<HostComposer>;
+
+  HostComposer(const HostComposer &) = delete;
+  ~HostComposer();
+
+  auto GetMainLock() -> std::recursive_mutex & {
+    return hwc.GetResMan().GetMainLock();
+  }
+
+  DrmHwcTwo hwc;
+  HwcDisplay *display{};
+
+ private:
+  HostComposer() = default;
+
+  static void OnHotplug(hwc2_callback_data_t data, hwc2_display_t display,
+                        int32_t connected);
+};
+
+}  // namespace android
@@ -0,0 +1,451 @@
+// SPDX-License-Identifier: Apache-2.0
+
+/* Microbenchmarks of the composition hot paths. Built for the host (see
+ * tests/host) and running against the fake DRM device, so the numbers
+ * measure the composer itself and can be compared between commits on any
+ * generic CI runner.
+ *
+ * Usage: hwc-bench [--filter <substring>] [--min-time-ms <ms>]
+ *                  [--output <file>] [--baseline <file>]
+ *                  [--max-regression <percent>]
+ *
+ * Results are printed as "<name> <iterations> <ns/op>". With --baseline,
+ * every benchmark is compared to the baseline results and the tool fails if
+ * any of them got slower by more than --max-regression percent.
+ */
+
+#define LOG_TAG "hwc-bench"
+
+#include <hardware/hwcomposer2.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "backend/Backend.h"
+#include "bufferinfo/BufferInfoGetter.h"
+#include "compositor/DrmKmsPlan.h"
+#include "drm/DrmDevice.h"
+#include "drm/DrmPlane.h"
+#include "hwc2_device/DrmHwcTwo.h"
+#include "tests/host/AndroidStubs.h"
+#include "tests/host/FakeDrm.h"
+#include "tests/host/HostComposer.h"
+#include "utils/log.h"
+
+namespace android {
+
+/* Exposes the protected helpers of the generic backend */
+class BenchBackend : public Backend {
+ public:
+  using Backend::CalcPixOps;
+  using Backend::GetExtraClientRange;
+
+  /* Done once per ValidateDisplay() */
+  void FetchPlanes(HwcDisplay *display) {
+    planes_ = display->GetPipe().GetUsablePlanes();
+  }
+};
+
+template <typename T>
+inline void DoNotOptimize(const T &value) {
+  asm volatile("" : : "g"(&value) : "memory");
+}
+
+struct BenchResult {
+  std::string name;
+  uint64_t iterations{};
+  double ns_per_op{};
+};
+
+class BenchRunner {
+ public:
+  BenchRunner(std::string filter, int64_t min_time_ns)
+      : filter_(std::move(filter)), min_time_ns_(min_time_ns){};
+
+  /* Calibrates the iteration count to |min_time_ns_| and reports the median
+   * of several runs, single runs are too noisy for gating.
+   */
+  template <typename Fn>
+  void Run(const std::string &name, Fn &&fn) {
+    if (!filter_.empty() && name.find(filter_) == std::string::npos)
+      return;
+
+    constexpr int kRepetitions = 5;
+    constexpr uint64_t kMaxGrowth = 100;
+
+    uint64_t iterations = 1;
+    for (;;) {
+      auto elapsed = Measure(fn, iterations);
+      if (elapsed >= min_time_ns_ / kRepetitions)
+        break;
+
+      auto target = double(min_time_ns_) / kRepetitions * 1.2 /
+                    double(std::max<int64_t>(elapsed, 1)) * double(iterations);
+      iterations = std::clamp(uint64_t(target), iterations * 2,
+                              iterations * kMaxGrowth);
+    }
+
+    std::vector<double> runs;
+    for (int i = 0; i < kRepetitions; i++)
+      runs.emplace_back(double(Measure(fn, iterations)) / double(iterations));
+
+    std::sort(runs.begin(), runs.end());
+    BenchResult result = {
+        .name = name,
+        .iterations = iterations,
+        .ns_per_op = runs[kRepetitions / 2],
+    };
+
+    printf("%-44s %12" PRIu64 " %12.1f ns/op\n", name.c_str(),
+           result.iterations, result.ns_per_op);
+    results_.emplace_back(std::move(result));
+  }
+
+  auto &GetResults() const {
+    return results_;
+  }
+
+ private:
+  template <typename Fn>
+  static auto Measure(Fn &fn, uint64_t iterations) -> int64_t {
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < iterations; i++)
+      fn();
+
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+        .count();
+  }
+
+  std::string filter_;
+  int64_t min_time_ns_;
+  std::vector<BenchResult> results_;
+};
+
+/* Layer with its own triple-buffered swapchain */
+struct BenchLayer {
+  hwc2_layer_t id{};
+  std::vector<native_handle_t *> buffers;
+  size_t next_buffer{};
+
+  void QueueBuffer(HwcLayer *layer) {
+    layer->SetLayerBuffer(buffers[next_buffer], -1);
+    next_buffer = (next_buffer + 1) % buffers.size();
+  }
+};
+
+class BenchScene {
+ public:
+  BenchScene(HwcDisplay *display, size_t layer_count, uint32_t width,
+             uint32_t height)
+      : display_(display) {
+    constexpr size_t kSwapchainSize = 3;
+    for (size_t i = 0; i < layer_count; i++) {
+      BenchLayer bl;
+      display_->CreateLayer(&bl.id);
+
+      /* Fullscreen background, then windows cascading over it */
+      auto w = i == 0 ? width : width / 2;
+      auto h = i == 0 ? height : height / 2;
+      auto offset = i == 0 ? 0 : int(i * 32);
+      for (size_t b = 0; b < kSwapchainSize; b++)
+        bl.buffers.emplace_back(
+            CreateGrallocBuffer(w, h, HAL_PIXEL_FORMAT_RGBA_8888));
+
+      auto *layer = display_->get_layer(bl.id);
+      layer->SetLayerCompositionType(int32_t(HWC2::Composition::Device));
+      layer->SetLayerBlendMode(int32_t(HWC2::BlendMode::Premultiplied));
+      layer->SetLayerZOrder(uint32_t(i));
+      layer->SetLayerSourceCrop({0, 0, float(w), float(h)});
+      layer->SetLayerDisplayFrame(
+          {offset, offset, offset + int(w), offset + int(h)});
+      bl.QueueBuffer(layer);
+      layer->PopulateLayerData();
+      layers_.emplace_back(std::move(bl));
+    }
+
+    for (size_t b = 0; b < kSwapchainSize; b++)
+      client_buffers_.emplace_back(
+          CreateGrallocBuffer(width, height, HAL_PIXEL_FORMAT_RGBA_8888));
+  }
+
+  BenchScene(const BenchScene &) = delete;
+  ~BenchScene() {
+    for (auto &bl : layers_) {
+      display_->DestroyLayer(bl.id);
+      for (auto *buffer : bl.buffers)
+        FreeGrallocBuffer(buffer);
+    }
+
+    for (auto *buffer : client_buffers_)
+      FreeGrallocBuffer(buffer);
+  }
+
+  /* Next buffer of every layer, as SurfaceFlinger does each frame */
+  void QueueBuffers() {
+    for (auto &bl : layers_) {
+      auto *layer = display_->get_layer(bl.id);
+      bl.QueueBuffer(layer);
+      layer->PopulateLayerData();
+    }
+  }
+
+  auto GetLayerData() -> std::vector<LayerData> {
+    std::vector<LayerData> composition;
+    for (auto *layer : display_->GetOrderLayersByZPos())
+      composition.emplace_back(layer->GetLayerData());
+
+    return composition;
+  }
+
+  auto PresentFrame() -> bool {
+    uint32_t num_types = 0;
+    uint32_t num_requests = 0;
+    QueueBuffers();
+    display_->SetClientTarget(client_buffers_[frame_ % client_buffers_.size()],
+                              -1, HAL_DATASPACE_UNKNOWN, {});
+    display_->ValidateDisplay(&num_types, &num_requests);
+    display_->AcceptDisplayChanges();
+
+    int32_t present_fence = -1;
+    auto err = display_->PresentDisplay(&present_fence);
+    if (present_fence >= 0)
+      close(present_fence);
+
+    frame_++;
+    return err == HWC2::Error::None;
+  }
+
+ private:
+  HwcDisplay *const display_;
+  std::vector<BenchLayer> layers_;
+  std::vector<native_handle_t *> client_buffers_;
+  size_t frame_{};
+};
+
+/* Mid-range SoC: one primary and three overlay planes */
+static auto MakeDeviceConfig(uint16_t width, uint16_t height)
+    -> FakeDeviceConfig {
+  const std::vector<uint32_t> formats = {
+      DRM_FORMAT_ARGB8888, DRM_FORMAT_XRGB8888, DRM_FORMAT_ABGR8888,
+      DRM_FORMAT_XBGR8888, DRM_FORMAT_RGB565,   DRM_FORMAT_BGR888,
+  };
+
+  FakeDeviceConfig config;
+  config.connectors.push_back({
+      .modes = {FakeDrm::MakeMode(width, height, 60)},
+  });
+
+  constexpr int kOverlayPlanes = 3;
+  config.planes.push_back({
+      .type = DRM_PLANE_TYPE_PRIMARY,
+      .formats = formats,
+  });
+  for (int i = 0; i < kOverlayPlanes; i++) {
+    config.planes.push_back({
+        .type = DRM_PLANE_TYPE_OVERLAY,
+        .formats = formats,
+    });
+  }
+
+  return config;
+}
+
+static void RunBenchmarks(BenchRunner &runner, HostComposer &composer,
+                          uint32_t width, uint32_t height) {
+  auto *display = composer.display;
+  auto &pipe = display->GetPipe();
+
+  {
+    const std::unique_lock lock(composer.GetMainLock());
+    const BenchScene scene(display, 8, width, height);
+    auto layers = display->GetOrderLayersByZPos();
+
+    runner.Run("CalcPixOps/layers:8", [&] {
+      DoNotOptimize(BenchBackend::CalcPixOps(layers, 0, layers.size()));
+    });
+
+    BenchBackend backend;
+    backend.FetchPlanes(display);
+    runner.Run("GetExtraClientRange/layers:8", [&] {
+      DoNotOptimize(backend.GetExtraClientRange(display, layers, -1, 0));
+    });
+  }
+
+  const std::unique_lock lock(composer.GetMainLock());
+  BenchScene scene(display, 4, width, height);
+  auto composition = scene.GetLayerData();
+
+  runner.Run("CreateDrmKmsPlan/layers:4", [&] {
+    DoNotOptimize(DrmKmsPlan::CreateDrmKmsPlan(pipe, composition));
+  });
+
+  auto plan = DrmKmsPlan::CreateDrmKmsPlan(pipe, composition);
+  if (plan) {
+    auto crtc_id = pipe.crtc->Get()->GetId();
+    runner.Run("AtomicSetState/planes:4", [&] {
+      auto pset = MakeDrmModeAtomicReqUnique();
+      for (auto &joining : plan->plan) {
+        joining.plane->Get()->AtomicSetState(*pset, joining.layer,
+                                             joining.z_pos, crtc_id,
+                                             joining.z_pos == 0);
+      }
+      DoNotOptimize(pset);
+    });
+  } else {
+    ALOGE("Failed to create the composition plan");
+  }
+
+  auto &importer = pipe.device->GetDrmFbImporter();
+  auto bi = composition[0].bi;
+  auto fb = importer.GetOrCreateFbId(&bi.value());
+  runner.Run("FbCache/hit", [&] {
+    DoNotOptimize(importer.GetOrCreateFbId(&bi.value()));
+  });
+
+  fb.reset();
+  composition.clear();
+
+  /* Buffer not referenced by any layer, so its FB dies with the handle */
+  auto *buffer = CreateGrallocBuffer(width, height,
+                                     HAL_PIXEL_FORMAT_RGBA_8888);
+  auto own_bi = BufferInfoGetter::GetInstance()->GetBoInfo(buffer);
+  if (own_bi) {
+    runner.Run("FbCache/import+release", [&] {
+      DoNotOptimize(importer.GetOrCreateFbId(&own_bi.value()));
+    });
+  }
+  FreeGrallocBuffer(buffer);
+
+  runner.Run("SwapchainCache/layers:4", [&] { scene.QueueBuffers(); });
+
+  runner.Run("Frame/validate+present:layers:4", [&] {
+    DoNotOptimize(scene.PresentFrame());
+  });
+}
+
+static auto ReadBaseline(const std::string &path)
+    -> std::map<std::string, double> {
+  std::map<std::string, double> baseline;
+  std::ifstream file(path);
+  std::string line;
+  while (std::getline(file, line)) {
+    std::istringstream ss(line);
+    std::string name;
+    uint64_t iterations = 0;
+    double ns_per_op = 0;
+    if (ss >> name >> iterations >> ns_per_op)
+      baseline[name] = ns_per_op;
+  }
+
+  return baseline;
+}
+
+/* Returns false if any benchmark regressed */
+static auto CompareToBaseline(const std::vector<BenchResult> &results,
+                              const std::map<std::string, double> &baseline,
+                              double max_regression) -> bool {
+  auto ok = true;
+  printf("\nComparison to baseline (max regression %.1f%%):\n",
+         max_regression);
+  for (const auto &r : results) {
+    if (baseline.count(r.name) == 0) {
+      printf("%-44s %12s\n", r.name.c_str(), "new");
+      continue;
+    }
+
+    auto base = baseline.at(r.name);
+    auto change = (r.ns_per_op - base) / base * 100.0;
+    auto regressed = change > max_regression;
+    printf("%-44s %+11.1f%%%s\n", r.name.c_str(), change,
+           regressed ? "  REGRESSION" : "");
+    ok &= !regressed;
+  }
+
+  return ok;
+}
+
+}  // namespace android
+
+int main(int argc, char *argv[]) {
+  using namespace android;  // NOLINT(google-build-using-namespace)
+
+  std::string filter;
+  std::string output;
+  std::string baseline;
+  constexpr int64_t kNsInMs = 1000000;
+  int64_t min_time_ms = 500;
+  double max_regression = 10.0;
+
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    auto has_value = i + 1 < argc;
+    if (arg == "--filter" && has_value) {
+      filter = argv[++i];
+    } else if (arg == "--min-time-ms" && has_value) {
+      min_time_ms = std::strtoll(argv[++i], nullptr, 10);
+    } else if (arg == "--output" && has_value) {
+      output = argv[++i];
+    } else if (arg == "--baseline" && has_value) {
+      baseline = argv[++i];
+    } else if (arg == "--max-regression" && has_value) {
+      max_regression = std::strtod(argv[++i], nullptr);
+    } else {
+      std::cerr << "Unknown argument: " << arg << std::endl;
+      return -EINVAL;
+    }
+  }
+
+  constexpr uint16_t kWidth = 1920;
+  constexpr uint16_t kHeight = 1080;
+  auto composer = HostComposer::CreateInstance(
+      MakeDeviceConfig(kWidth, kHeight));
+  if (!composer) {
+    std::cerr << "Failed to start the composer" << std::endl;
+    return -ENODEV;
+  }
+
+  BenchRunner runner(filter, min_time_ms * kNsInMs);
+  RunBenchmarks(runner, *composer, kWidth, kHeight);
+
+  auto stats = FakeDrm::GetStats();
+  printf("\nDRM: %" PRIu64 " commits (%" PRIu64 " failed), %" PRIu64
+         " TEST_ONLY (%" PRIu64 " failed), %" PRIu64 " FBs created\n",
+         stats.commits, stats.failed_commits, stats.test_commits,
+         stats.failed_test_commits, stats.fbs_created);
+
+  composer.reset();
+
+  if (!output.empty()) {
+    std::ofstream file(output);
+    for (const auto &r : runner.GetResults())
+      file << r.name << " " << r.iterations << " " << r.ns_per_op << "\n";
+  }
+
+  if (!baseline.empty()) {
+    auto base = ReadBaseline(baseline);
+    if (base.empty()) {
+      std::cerr << "No baseline results in " << baseline << ", skipping"
+                << std::endl;
+      return 0;
+    }
+
+    if (!CompareToBaseline(runner.GetResults(), base, max_regression))
+      return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,653 @@
+// SPDX-License-Identifier: Apache-2.0
+
+/* Composition efficiency of the plane assignment. Every scenario of the
+ * corpus (a representative layer stack) is composed on every display
+ * controller model for a number of frames, and the following is reported
+ * for each pair:
+ *
+ *   gpu%      share of the layer pixels composed by the GPU, the same
+ *             metric as "Composition efficiency" of the display dump
+ *   test      TEST_ONLY commits per frame
+ *   failed    share of frames whose planned composition was rejected, by
+ *             the planner itself or by the kernel, and fell back to GPU
+ *   plan_us   median ValidateDisplay() time
+ *   scan_MBps estimated scanout bandwidth of the last frame
+ *
+ * Usage: hwc-scenarios [--filter <substring>] [--frames <count>]
+ *                      [--output <file>] [--baseline <file>]
+ *
+ * With --baseline, the tool fails if any pair composes more pixels on the
+ * GPU or needs more TEST_ONLY commits than in the baseline. Planning time is
+ * reported, but not gated, it is covered by hwc-bench.
+ */
+
+#define LOG_TAG "hwc-scenarios"
+
+#include <hardware/hwcomposer2.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "hwc2_device/DrmHwcTwo.h"
+#include "tests/host/AndroidStubs.h"
+#include "tests/host/FakeDrm.h"
+#include "tests/host/HostComposer.h"
+#include "utils/log.h"
+
+namespace android {
+
+constexpr uint16_t kWidth = 1920;
+constexpr uint16_t kHeight = 1080;
+
+struct ScenarioLayer {
+  uint32_t hal_format;
+  uint32_t width;
+  uint32_t height;
+  hwc_rect_t frame;
+  HWC2::BlendMode blend = HWC2::BlendMode::Premultiplied;
+  HWC2::Composition type = HWC2::Composition::Device;
+  int32_t dataspace = HAL_DATASPACE_UNKNOWN;
+};
+
+struct Scenario {
+  std::string name;
+  std::vector<ScenarioLayer> layers;
+  /* Falls back to On where the display can't doze */
+  HWC2::PowerMode power_mode = HWC2::PowerMode::On;
+};
+
+struct ControllerModel {
+  std::string name;
+  FakeDeviceConfig config;
+  FakeDrm::CommitCheck check;
+  /* Composer properties, set for the lifetime of the model */
+  std::map<std::string, std::string> properties{};
+};
+
+/* Layer stacks as SurfaceFlinger produces them, bottom to top */
+static auto MakeScenarios() -> std::vector<Scenario> {
+  constexpr uint32_t kRgba = HAL_PIXEL_FORMAT_RGBA_8888;
+  constexpr uint32_t kRgbx = HAL_PIXEL_FORMAT_RGBX_8888;
+  constexpr uint32_t kYuv = HAL_PIXEL_FORMAT_YCbCr_420_888;
+  constexpr uint32_t kP010 = HAL_PIXEL_FORMAT_YCBCR_P010;
+  constexpr auto kOpaque = HWC2::BlendMode::None;
+  constexpr auto kDevice = HWC2::Composition::Device;
+  constexpr int32_t kBt2020Pq = HAL_DATASPACE_STANDARD_BT2020 |
+                                HAL_DATASPACE_TRANSFER_ST2084 |
+                                HAL_DATASPACE_RANGE_LIMITED;
+
+  const ScenarioLayer status_bar = {kRgba, kWidth, 72, {0, 0, kWidth, 72}};
+  const ScenarioLayer nav_bar = {kRgba,
+                                 kWidth,
+                                 96,
+                                 {0, kHeight - 96, kWidth, kHeight}};
+  const ScenarioLayer fullscreen_app = {kRgbx,
+                                        kWidth,
+                                        kHeight,
+                                        {0, 0, kWidth, kHeight},
+                                        kOpaque};
+
+  return {
+      {"video+ui",
+       {
+           {kYuv, kWidth, kHeight, {0, 0, kWidth, kHeight}, kOpaque},
+           {kRgba, 1280, 120, {320, 700, 1600, 820}},
+           {kRgba, kWidth, 240, {0, 840, kWidth, kHeight}},
+           status_bar,
+       }},
+      {"hdr-video",
+       {
+           {kP010, kWidth, kHeight, {0, 0, kWidth, kHeight}, kOpaque, kDevice,
+            kBt2020Pq},
+           {kRgba, 1280, 120, {320, 700, 1600, 820}},
+           status_bar,
+       }},
+      {"game+overlay",
+       {
+           /* Rendered at a lower resolution, upscaled by the display */
+           {kRgbx, 1280, 720, {0, 0, kWidth, kHeight}, kOpaque},
+           {kRgba, 256, 64, {16, 16, 272, 80}},
+           {kRgba, 960, 160, {480, 24, 1440, 184}},
+       }},
+      {"pixel-art",
+       {
+           /* Emulator output, upscaled 3x with sharp pixels */
+           {kRgbx, 640, 360, {0, 0, kWidth, kHeight}, kOpaque},
+           {kRgba, 480, 64, {720, 1000, 1200, 1064}},
+       }},
+      {"launcher",
+       {
+           fullscreen_app,
+           {kRgba, kWidth, kHeight, {0, 0, kWidth, kHeight}},
+           status_bar,
+           nav_bar,
+       }},
+      {"app-over-wallpaper",
+       {
+           /* Fully hidden by the app */
+           {kRgbx, kWidth, kHeight, {0, 0, kWidth, kHeight}, kOpaque},
+           fullscreen_app,
+           status_bar,
+           nav_bar,
+       }},
+      {"split-screen",
+       {
+           /* Bottom half stays visible under the translucent app */
+           {kRgbx, kWidth, kHeight, {0, 0, kWidth, kHeight}, kOpaque},
+           {kRgbx, kWidth, 540, {0, 0, kWidth, 540}, kOpaque},
+           {kRgba, kWidth, 540, {0, 540, kWidth, kHeight}},
+           status_bar,
+       }},
+      {"swipe",
+       {
+           /* Mid-gesture, both apps extend beyond the screen */
+           {kRgbx, kWidth, kHeight, {-600, 0, kWidth - 600, kHeight}, kOpaque},
+           {kRgbx, kWidth, kHeight, {kWidth - 600, 0, 2 * kWidth - 600, kHeight},
+            kOpaque},
+           status_bar,
+       }},
+      {"opaque-rgba",
+       {
+           fullscreen_app,
+           /* Apps drawing to RGBA buffers, but declared opaque */
+           {kRgba, 952, 912, {0, 72, 952, 984}, kOpaque},
+           {kRgba, 952, 912, {968, 72, kWidth, 984}, kOpaque},
+       }},
+      {"multi-window",
+       {
+           fullscreen_app,
+           {kRgbx, 952, 912, {0, 72, 952, 984}, kOpaque},
+           {kRgbx, 952, 912, {968, 72, kWidth, 984}, kOpaque},
+           {kRgba, 16, 912, {952, 72, 968, 984}},
+           status_bar,
+           nav_bar,
+       }},
+      {"pip",
+       {
+           fullscreen_app,
+           {kYuv, 640, 360, {1392, 664, 1872, 934}, kOpaque},
+           status_bar,
+           nav_bar,
+       }},
+      {"blur-dialog",
+       {
+           fullscreen_app,
+           /* Blurred backdrop, SurfaceFlinger renders it itself */
+           {kRgba,
+            kWidth,
+            kHeight,
+            {0, 0, kWidth, kHeight},
+            HWC2::BlendMode::Premultiplied,
+            HWC2::Composition::Client},
+           {kRgba, 960, 540, {480, 270, 1440, 810}},
+           status_bar,
+       }},
+      {"aod",
+       {
+           /* Clock and notification icons over a black screen */
+           {kRgba, 640, 240, {640, 300, 1280, 540}},
+           {kRgba, 480, 48, {720, 600, 1200, 648}},
+       },
+       HWC2::PowerMode::Doze},
+  };
+}
+
+static auto MakeConfig(const std::vector<FakePlaneConfig> &planes)
+    -> FakeDeviceConfig {
+  FakeDeviceConfig config;
+  config.connectors.push_back({
+      .modes = {FakeDrm::MakeMode(kWidth, kHeight, 60)},
+  });
+  config.planes = planes;
+  return config;
+}
+
+/* Base block and a CTA-861 extension with BT2020_RGB colorimetry and PQ
+ * static metadata, about 1000/400/0.05 nits
+ */
+static auto MakeHdrEdid() -> std::vector<uint8_t> {
+  constexpr size_t kBlockSize = 128;
+  std::vector<uint8_t> edid(2 * kBlockSize);
+  const uint8_t header[] = {0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00};
+  std::copy(std::begin(header), std::end(header), edid.begin());
+  edid[126] = 1;
+
+  const uint8_t cta[] = {
+      0x02, 0x03, 0x0f, 0x00,
+      /* Colorimetry: BT2020_RGB */
+      0xe3, 0x05, 0x80, 0x00,
+      /* HDR static metadata: SDR and PQ EOTFs, type 1, luminance codes */
+      0xe6, 0x06, 0x05, 0x01, 0x8a, 0x60, 0x12,
+  };
+  std::copy(std::begin(cta), std::end(cta), edid.begin() + kBlockSize);
+
+  for (size_t b = 0; b < edid.size(); b += kBlockSize) {
+    uint8_t sum = 0;
+    for (size_t i = b; i < b + kBlockSize - 1; i++)
+      sum += edid[i];
+    edid[b + kBlockSize - 1] = uint8_t(0x100 - sum);
+  }
+
+  return edid;
+}
+
+/* Display controllers we ship on, reduced to what matters for planning */
+static auto MakeModels() -> std::vector<ControllerModel> {
+  const std::vector<uint32_t> rgb = {
+      DRM_FORMAT_ARGB8888, DRM_FORMAT_XRGB8888, DRM_FORMAT_ABGR8888,
+      DRM_FORMAT_XBGR8888, DRM_FORMAT_RGB565,
+  };
+  auto rgb_yuv = rgb;
+  rgb_yuv.emplace_back(DRM_FORMAT_NV12);
+  rgb_yuv.emplace_back(DRM_FORMAT_P010);
+
+  const FakePlaneConfig primary = {
+      .type = DRM_PLANE_TYPE_PRIMARY,
+      .formats = rgb,
+  };
+  const FakePlaneConfig overlay = {
+      .type = DRM_PLANE_TYPE_OVERLAY,
+      .formats = rgb_yuv,
+      .color_encoding = true,
+  };
+  const FakePlaneConfig yuv_overlay = {
+      .type = DRM_PLANE_TYPE_OVERLAY,
+      .formats = {DRM_FORMAT_NV12},
+  };
+  const FakePlaneConfig opaque_overlay = {
+      .type = DRM_PLANE_TYPE_OVERLAY,
+      .formats = {DRM_FORMAT_XRGB8888, DRM_FORMAT_XBGR8888, DRM_FORMAT_RGB565,
+                  DRM_FORMAT_NV12},
+      .alpha = false,
+      .blend = false,
+  };
+
+  std::vector<ControllerModel> models;
+  models.push_back({"1-overlay", MakeConfig({primary, overlay}), {}});
+  models.push_back(
+      {"3-overlays", MakeConfig({primary, overlay, overlay, overlay}), {}});
+
+  /* Overlays of both CRTCs come from one pool */
+  auto shared = MakeConfig({primary, primary, overlay, overlay, overlay});
+  shared.crtc_count = 2;
+  shared.planes[0].possible_crtcs = 1U << 0U;
+  shared.planes[1].possible_crtcs = 1U << 1U;
+  shared.connectors.push_back(shared.connectors[0]);
+  models.push_back({"shared-overlays", shared, {}});
+
+  /* A single scaler, shared by all planes. The kernel rejects the commit
+   * when more than one plane scales.
+   */
+  models.push_back(
+      {"one-scaler", MakeConfig({primary, overlay, overlay, overlay}),
+       [](const std::vector<FakePlaneState> &planes) {
+         constexpr uint32_t kFixedPointShift = 16;
+         auto scaled = std::count_if(planes.begin(), planes.end(),
+                                     [&](const FakePlaneState &p) {
+                                       return p.src_w >> kFixedPointShift !=
+                                                  p.crtc_w ||
+                                              p.src_h >> kFixedPointShift !=
+                                                  p.crtc_h;
+                                     });
+         return scaled > 1 ? -EINVAL : 0;
+       }});
+
+  models.push_back(
+      {"yuv-only-overlays", MakeConfig({primary, yuv_overlay, yuv_overlay}),
+       {}});
+  models.push_back({"no-alpha-overlays",
+                    MakeConfig({primary, opaque_overlay, opaque_overlay,
+                                opaque_overlay}),
+                    {}});
+
+  /* Planes must stay within the CRTC, the driver does not clip */
+  models.push_back(
+      {"no-offscreen", MakeConfig({primary, overlay, overlay, overlay}),
+       [](const std::vector<FakePlaneState> &planes) {
+         auto offscreen = std::any_of(planes.begin(), planes.end(),
+                                      [](const FakePlaneState &p) {
+                                        return p.crtc_x < 0 || p.crtc_y < 0 ||
+                                               p.crtc_x + p.crtc_w > kWidth ||
+                                               p.crtc_y + p.crtc_h > kHeight;
+                                      });
+         return offscreen ? -EINVAL : 0;
+       }});
+
+  /* Only the overlays scale, within 0.5x..2x and from whole pixels */
+  auto fixed_primary = primary;
+  fixed_primary.scaling = false;
+  auto limited_overlay = overlay;
+  limited_overlay.min_scale = 0.5;
+  limited_overlay.max_scale = 2.0;
+  limited_overlay.subpixel_src = false;
+  models.push_back({"fixed-primary",
+                    MakeConfig({fixed_primary, limited_overlay,
+                                limited_overlay, limited_overlay}),
+                    {}});
+
+  /* Nearest neighbour filtering of whole-number ratios only, as handheld
+   * display controllers do
+   */
+  auto filtered_primary = primary;
+  filtered_primary.scaling_filter = true;
+  auto filtered_overlay = overlay;
+  filtered_overlay.scaling_filter = true;
+  models.push_back(
+      {"integer-nearest",
+       MakeConfig({filtered_primary, filtered_overlay, filtered_overlay}),
+       [](const std::vector<FakePlaneState> &planes) {
+         constexpr uint32_t kFixedPointShift = 16;
+         constexpr uint32_t kFractionMask = (1U << kFixedPointShift) - 1;
+         auto fractional = std::any_of(
+             planes.begin(), planes.end(), [&](const FakePlaneState &p) {
+               auto src_w = p.src_w >> kFixedPointShift;
+               auto src_h = p.src_h >> kFixedPointShift;
+               return p.scaling_filter != 0 &&
+                      ((p.src_w & kFractionMask) != 0 ||
+                       (p.src_h & kFractionMask) != 0 ||
+                       p.crtc_w % src_w != 0 || p.crtc_h % src_h != 0);
+             });
+         return fractional ? -EINVAL : 0;
+       },
+       {{"vendor.hwc.drm.scaling_filter", "INTEGER_NEAREST"}}});
+
+  /* Underflows instead of failing the commit, budget keeps it in limits */
+  models.push_back(
+      {"budget", MakeConfig({primary, overlay, overlay, overlay}), {},
+       {{"vendor.hwc.drm.budget.bandwidth_mbps", "1000"},
+        {"vendor.hwc.drm.budget.scalers", "1"}}});
+
+  /* HDR10 TV, every plane brings SDR content to the PQ output */
+  auto hdr_plane = overlay;
+  hdr_plane.color_pipeline = true;
+  auto hdr_primary = hdr_plane;
+  hdr_primary.type = DRM_PLANE_TYPE_PRIMARY;
+  auto hdr_tv = MakeConfig({hdr_primary, hdr_plane, hdr_plane});
+  hdr_tv.connectors[0].edid = MakeHdrEdid();
+  hdr_tv.connectors[0].hdr = true;
+  models.push_back({"hdr-tv", hdr_tv, {}});
+
+  /* Built-in panel, refreshing at 60, 30 or 15 Hz without a modeset. Lit by
+   * the bootloader.
+   */
+  auto panel = MakeConfig({primary, overlay, overlay});
+  panel.connectors[0].type = DRM_MODE_CONNECTOR_DSI;
+  panel.connectors[0].modes.emplace_back(FakeDrm::MakeMode(kWidth, kHeight,
+                                                           30));
+  panel.connectors[0].modes.emplace_back(FakeDrm::MakeMode(kWidth, kHeight,
+                                                           15));
+  panel.seamless_refresh = true;
+  panel.boot_splash = true;
+  models.push_back({"panel", panel, {}});
+  return models;
+}
+
+struct ScenarioResult {
+  std::string name;
+  double gpu_fraction{};
+  double test_commits{};
+  double failed_frames{};
+  double plan_us{};
+  double scanout_mbps{};
+};
+
+class ScenarioRunner {
+ public:
+  ScenarioRunner(HwcDisplay *display, const Scenario &scenario)
+      : display_(display) {
+    constexpr size_t kSwapchainSize = 3;
+    for (const auto &sl : scenario.layers) {
+      Layer l{.type = sl.type};
+      display_->CreateLayer(&l.id);
+      for (size_t b = 0; b < kSwapchainSize; b++)
+        l.buffers.emplace_back(
+            CreateGrallocBuffer(sl.width, sl.height, sl.hal_format));
+
+      auto *layer = display_->get_layer(l.id);
+      layer->SetLayerCompositionType(int32_t(sl.type));
+      layer->SetLayerBlendMode(int32_t(sl.blend));
+      layer->SetLayerDataspace(sl.dataspace);
+      layer->SetLayerZOrder(uint32_t(layers_.size()));
+      layer->SetLayerSourceCrop(
+          {0, 0, float(sl.width), float(sl.height)});
+      layer->SetLayerDisplayFrame(sl.frame);
+      layers_.emplace_back(std::move(l));
+    }
+
+    for (size_t b = 0; b < kSwapchainSize; b++)
+      client_buffers_.emplace_back(
+          CreateGrallocBuffer(kWidth, kHeight, HAL_PIXEL_FORMAT_RGBA_8888));
+  }
+
+  ScenarioRunner(const ScenarioRunner &) = delete;
+  ~ScenarioRunner() {
+    for (auto &l : layers_) {
+      display_->DestroyLayer(l.id);
+      for (auto *buffer : l.buffers)
+        FreeGrallocBuffer(buffer);
+    }
+
+    for (auto *buffer : client_buffers_)
+      FreeGrallocBuffer(buffer);
+  }
+
+  /* Returns ValidateDisplay() duration in ns */
+  auto PresentFrame() -> int64_t {
+    for (auto &l : layers_) {
+      auto *layer = display_->get_layer(l.id);
+      layer->SetLayerBuffer(l.buffers[frame_ % l.buffers.size()], -1);
+      /* SurfaceFlinger resets the type every frame */
+      layer->SetLayerCompositionType(int32_t(l.type));
+    }
+
+    display_->SetClientTarget(client_buffers_[frame_ % client_buffers_.size()],
+                              -1, HAL_DATASPACE_UNKNOWN, {});
+
+    uint32_t num_types = 0;
+    uint32_t num_requests = 0;
+    auto start = std::chrono::steady_clock::now();
+    display_->ValidateDisplay(&num_types, &num_requests);
+    auto end = std::chrono::steady_clock::now();
+    display_->AcceptDisplayChanges();
+
+    int32_t present_fence = -1;
+    display_->PresentDisplay(&present_fence);
+    if (present_fence >= 0)
+      close(present_fence);
+
+    frame_++;
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+        .count();
+  }
+
+ private:
+  struct Layer {
+    HWC2::Composition type;
+    hwc2_layer_t id{};
+    std::vector<native_handle_t *> buffers;
+  };
+
+  HwcDisplay *const display_;
+  std::vector<Layer> layers_;
+  std::vector<native_handle_t *> client_buffers_;
+  size_t frame_{};
+};
+
+static auto RunScenario(HostComposer &composer, const Scenario &scenario,
+                        const std::string &name, int frames)
+    -> ScenarioResult {
+  auto *display = composer.display;
+  const std::unique_lock lock(composer.GetMainLock());
+  ScenarioRunner runner(display, scenario);
+  if (scenario.power_mode != HWC2::PowerMode::On)
+    display->SetPowerMode(int32_t(scenario.power_mode));
+
+  /* The first frame imports the buffers */
+  runner.PresentFrame();
+
+  FakeDrm::ResetStats();
+  auto stats_before = display->total_stats();
+  std::vector<int64_t> plan_ns;
+  for (int i = 0; i < frames; i++)
+    plan_ns.emplace_back(runner.PresentFrame());
+
+  auto delta = display->total_stats().minus(stats_before);
+  auto drm_stats = FakeDrm::GetStats();
+  display->SetPowerMode(int32_t(HWC2::PowerMode::On));
+  std::sort(plan_ns.begin(), plan_ns.end());
+
+  constexpr double kNsInUs = 1000.0;
+  constexpr double kBytesInMb = 1e6;
+  return {
+      .name = name,
+      .gpu_fraction = delta.total_pixops_ == 0
+                          ? 0.0
+                          : double(delta.gpu_pixops_) /
+                                double(delta.total_pixops_),
+      .test_commits = double(drm_stats.test_commits) / frames,
+      .failed_frames = double(delta.failed_kms_validate_) / frames,
+      .plan_us = double(plan_ns[plan_ns.size() / 2]) / kNsInUs,
+      .scanout_mbps = double(display->GetBandwidth().GetLast().scanout_bps) /
+                      kBytesInMb,
+  };
+}
+
+static auto ReadBaseline(const std::string &path)
+    -> std::map<std::string, ScenarioResult> {
+  std::map<std::string, ScenarioResult> baseline;
+  std::ifstream file(path);
+  std::string line;
+  while (std::getline(file, line)) {
+    std::istringstream ss(line);
+    ScenarioResult r;
+    if (ss >> r.name >> r.gpu_fraction >> r.test_commits >>
+        r.failed_frames >> r.plan_us >> r.scanout_mbps)
+      baseline[r.name] = r;
+  }
+
+  return baseline;
+}
+
+/* Returns false if the composition of any pair got worse */
+static auto CompareToBaseline(const std::vector<ScenarioResult> &results,
+                              const std::map<std::string, ScenarioResult>
+                                  &baseline) -> bool {
+  constexpr double kEpsilon = 1e-4;
+  auto ok = true;
+  printf("\nComparison to baseline:\n");
+  for (const auto &r : results) {
+    if (baseline.count(r.name) == 0) {
+      printf("%-36s %s\n", r.name.c_str(), "new");
+      continue;
+    }
+
+    const auto &base = baseline.at(r.name);
+    auto gpu_change = (r.gpu_fraction - base.gpu_fraction) * 100.0;
+    auto test_change = r.test_commits - base.test_commits;
+    auto regressed = gpu_change > kEpsilon || test_change > kEpsilon;
+    printf("%-36s gpu %+6.1f%% test %+5.2f plan %+7.1fus scan %+7.1fMB/s%s\n",
+           r.name.c_str(), gpu_change, test_change, r.plan_us - base.plan_us,
+           r.scanout_mbps - base.scanout_mbps,
+           regressed ? "  REGRESSION" : "");
+    ok &= !regressed;
+  }
+
+  return ok;
+}
+
+}  // namespace android
+
+int main(int argc, char *argv[]) {
+  using namespace android;  // NOLINT(google-build-using-namespace)
+
+  std::string filter;
+  std::string output;
+  std::string baseline;
+  int frames = 30;
+
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    auto has_value = i + 1 < argc;
+    if (arg == "--filter" && has_value) {
+      filter = argv[++i];
+    } else if (arg == "--frames" && has_value) {
+      frames = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--output" && has_value) {
+      output = argv[++i];
+    } else if (arg == "--baseline" && has_value) {
+      baseline = argv[++i];
+    } else {
+      std::cerr << "Unknown argument: " << arg << std::endl;
+      return -EINVAL;
+    }
+  }
+
+  const auto scenarios = MakeScenarios();
+  std::vector<ScenarioResult> results;
+  for (const auto &model : MakeModels()) {
+    for (const auto &[name, value] : model.properties)
+      setenv(name.c_str(), value.c_str(), 1);
+
+    auto composer = HostComposer::CreateInstance(model.config);
+    if (!composer) {
+      std::cerr << "Failed to start the composer for " << model.name
+                << std::endl;
+      return -ENODEV;
+    }
+
+    FakeDrm::SetCommitCheck(model.check);
+    for (const auto &scenario : scenarios) {
+      auto name = scenario.name + "/" + model.name;
+      if (!filter.empty() && name.find(filter) == std::string::npos)
+        continue;
+
+      results.emplace_back(RunScenario(*composer, scenario, name, frames));
+    }
+
+    FakeDrm::SetCommitCheck({});
+    composer.reset();
+    for (const auto &[name, value] : model.properties)
+      unsetenv(name.c_str());
+  }
+
+  printf("\n%-36s %7s %6s %7s %9s %10s\n", "scenario/model", "gpu%", "test",
+         "failed", "plan_us", "scan_MBps");
+  for (const auto &r : results) {
+    printf("%-36s %6.1f%% %6.2f %7.2f %9.1f %10.1f\n", r.name.c_str(),
+           r.gpu_fraction * 100.0, r.test_commits, r.failed_frames, r.plan_us,
+           r.scanout_mbps);
+  }
+
+  if (!output.empty()) {
+    std::ofstream file(output);
+    for (const auto &r : results)
+      file << r.name << " " << r.gpu_fraction << " " << r.test_commits << " "
+           << r.failed_frames << " " << r.plan_us << " " << r.scanout_mbps
+           << "\n";
+  }
+
+  if (!baseline.empty()) {
+    auto base = ReadBaseline(baseline);
+    if (base.empty()) {
+      std::cerr << "No baseline results in " << baseline << ", skipping"
+                << std::endl;
+      return 0;
+    }
+
+    if (!CompareToBaseline(results, base))
+      return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,332 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Before the reactor, every periodic or fd-driven job (vsync, flattening
+ * timeout, fence cleanup, uevents) had its own thread, sleeping in its own
+ * blocking call. Each wakeup was a separate context switch, and none of those
+ * threads could be stopped cleanly or placed on a particular CPU.
+ *
+ * The reactor multiplexes all such event sources over a single epoll instance:
+ * timers are timerfd-based, fences and the DRM fd are plain readable fds.
+ */
+
+#define LOG_TAG "hwc-reactor"
+
+#include "Reactor.h"
+
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <ctime>
+#include <sstream>
+
+#include "log.h"
+
+namespace android {
+
+/* Sources are identified by (fd, generation) to filter out stale events
+ * for the fd number reused right after removal.
+ */
+static constexpr uint64_t kWakeSourceData = UINT64_MAX;
+static constexpr int kGenerationShift = 32;
+
+static auto GetTimeMonotonicNs() -> int64_t {
+  struct timespec ts {};
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  constexpr int64_t kNsInSec = 1000000000LL;
+  return int64_t(ts.tv_sec) * kNsInSec + int64_t(ts.tv_nsec);
+}
+
+auto Reactor::CreateInstance(const std::string &name, ThreadPolicy policy)
+    -> std::shared_ptr<Reactor> {
+  auto reactor = std::shared_ptr<Reactor>(new Reactor());
+
+  reactor->name_ = name;
+  reactor->policy_ = std::move(policy);
+
+  reactor->epoll_fd_ = MakeUniqueFd(epoll_create1(EPOLL_CLOEXEC));
+  reactor->wake_fd_ = MakeUniqueFd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+  if (!reactor->epoll_fd_ || !reactor->wake_fd_) {
+    ALOGE("Failed to create %s reactor: errno=%i", name.c_str(), errno);
+    return {};
+  }
+
+  struct epoll_event ev {};
+  ev.events = EPOLLIN;
+  ev.data.u64 = kWakeSourceData;
+  if (epoll_ctl(*reactor->epoll_fd_, EPOLL_CTL_ADD, *reactor->wake_fd_, &ev) !=
+      0) {
+    ALOGE("Failed to add wake fd to %s reactor: errno=%i", name.c_str(),
+          errno);
+    return {};
+  }
+
+  reactor->running_ = true;
+  /* The thread keeps the reactor alive until Stop() is called */
+  std::thread([reactor]() { reactor->ThreadFn(); }).detach();
+
+  return reactor;
+}
+
+auto Reactor::AddFd(int fd, Callback callback) -> int {
+  const std::lock_guard<std::mutex> lock(mutex_);
+  if (exit_)
+    return -ENODEV;
+
+  if (sources_.count(fd) != 0)
+    return -EEXIST;
+
+  auto generation = ++last_generation_;
+  struct epoll_event ev {};
+  ev.events = EPOLLIN;
+  ev.data.u64 = (uint64_t(generation) << kGenerationShift) | uint32_t(fd);
+  if (epoll_ctl(*epoll_fd_, EPOLL_CTL_ADD, fd, &ev) != 0) {
+    auto err = -errno;
+    ALOGE("Failed to add fd %i to %s reactor: errno=%i", fd, name_.c_str(),
+          -err);
+    return err;
+  }
+
+  sources_[fd] = {.generation = generation,
+                  .callback = std::make_shared<Callback>(std::move(callback))};
+  return 0;
+}
+
+void Reactor::RemoveFd(int fd) {
+  Source removed;
+  {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    auto it = sources_.find(fd);
+    if (it == sources_.end())
+      return;
+
+    epoll_ctl(*epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+    removed = std::move(it->second);
+    sources_.erase(it);
+  }
+  /* Captured state of the callback is released outside of the lock */
+}
+
+void Reactor::RemoveFdSync(int fd) {
+  Source removed;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto it = sources_.find(fd);
+    if (it == sources_.end())
+      return;
+
+    epoll_ctl(*epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+    removed = std::move(it->second);
+    sources_.erase(it);
+
+    /* The callback removing its own fd can't wait for itself */
+    if (!IsReactorThread()) {
+      cv_.wait(lock, [this, &removed]() {
+        return dispatching_generation_ != removed.generation;
+      });
+    }
+  }
+}
+
+auto Reactor::CreateTimer(Callback callback) -> std::unique_ptr<ReactorTimer> {
+  auto fd = MakeUniqueFd(
+      timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK));
+  if (!fd) {
+    ALOGE("Failed to create timerfd: errno=%i", errno);
+    return {};
+  }
+
+  const int tfd = *fd;
+  auto deadline = std::make_shared<std::atomic<int64_t>>(0);
+  auto ret = AddFd(tfd, [this, tfd, deadline,
+                         callback = std::move(callback)]() {
+    uint64_t expirations = 0;
+    /* Fails with EAGAIN if the timer was re-armed after expiration */
+    if (read(tfd, &expirations, sizeof(expirations)) <= 0)
+      return;
+
+    ReportWakeupLatency(GetTimeMonotonicNs() - deadline->load());
+    callback();
+  });
+  if (ret != 0)
+    return {};
+
+  return std::unique_ptr<ReactorTimer>(
+      new ReactorTimer(shared_from_this(), std::move(fd),
+                       std::move(deadline)));
+}
+
+void Reactor::Stop() {
+  {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    if (exit_)
+      return;
+
+    exit_ = true;
+  }
+
+  Wake();
+
+  if (IsReactorThread())
+    return;
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  cv_.wait(lock, [this]() { return !running_; });
+}
+
+void Reactor::Wake() const {
+  const uint64_t value = 1;
+  if (write(*wake_fd_, &value, sizeof(value)) < 0)
+    ALOGE("Failed to wake %s reactor: errno=%i", name_.c_str(), errno);
+}
+
+void Reactor::ReportWakeupLatency(int64_t latency_ns) {
+  latency_ns = std::max(latency_ns, int64_t(0));
+
+  const std::lock_guard<std::mutex> lock(mutex_);
+  wakeup_stats_.count++;
+  wakeup_stats_.total_ns += latency_ns;
+  wakeup_stats_.max_ns = std::max(wakeup_stats_.max_ns, latency_ns);
+}
+
+auto Reactor::GetWakeupStats() -> WakeupStats {
+  const std::lock_guard<std::mutex> lock(mutex_);
+  return wakeup_stats_;
+}
+
+auto Reactor::Dump() -> std::string {
+  auto stats = GetWakeupStats();
+  constexpr int64_t kNsInUs = 1000;
+
+  std::stringstream ss;
+  ss << " " << name_ << " (" << policy_.ToString() << "): ";
+  if (stats.count == 0) {
+    ss << "no wakeups measured";
+  } else {
+    ss << stats.count << " wakeups, latency avg "
+       << stats.total_ns / int64_t(stats.count) / kNsInUs << "us, max "
+       << stats.max_ns / kNsInUs << "us";
+  }
+
+  return ss.str();
+}
+
+void Reactor::ThreadFn() {
+  {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    thread_id_ = std::this_thread::get_id();
+  }
+
+  /* Thread names are limited to 16 bytes including the terminator */
+  constexpr size_t kMaxThreadNameLen = 15;
+  pthread_setname_np(pthread_self(),
+                     name_.substr(0, kMaxThreadNameLen).c_str());
+  policy_.Apply();
+
+  constexpr int kMaxEvents = 16;
+  std::array<struct epoll_event, kMaxEvents> events{};
+
+  for (;;) {
+    auto count = epoll_wait(*epoll_fd_, events.data(), kMaxEvents, -1);
+    if (count < 0) {
+      if (errno == EINTR)
+        continue;
+
+      ALOGE("epoll_wait failed for %s reactor: errno=%i", name_.c_str(),
+            errno);
+      break;
+    }
+
+    for (int i = 0; i < count; i++) {
+      auto data = events[i].data.u64;
+      if (data == kWakeSourceData) {
+        uint64_t value = 0;
+        read(*wake_fd_, &value, sizeof(value));
+        continue;
+      }
+
+      std::shared_ptr<Callback> callback;
+      {
+        const std::lock_guard<std::mutex> lock(mutex_);
+        if (exit_)
+          break;
+
+        auto it = sources_.find(int(uint32_t(data)));
+        if (it == sources_.end() ||
+            it->second.generation != uint32_t(data >> kGenerationShift))
+          continue;
+
+        callback = it->second.callback;
+        dispatching_generation_ = it->second.generation;
+      }
+
+      (*callback)();
+
+      {
+        const std::lock_guard<std::mutex> lock(mutex_);
+        dispatching_generation_ = 0;
+      }
+      cv_.notify_all();
+    }
+
+    const std::lock_guard<std::mutex> lock(mutex_);
+    if (exit_)
+      break;
+  }
+
+  decltype(sources_) sources;
+  {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    sources = std::move(sources_);
+    sources_.clear();
+    running_ = false;
+  }
+  cv_.notify_all();
+
+  ALOGI("Reactor %s thread exit", name_.c_str());
+}
+
+ReactorTimer::~ReactorTimer() {
+  reactor_->RemoveFd(*fd_);
+}
+
+void ReactorTimer::ArmAt(int64_t monotonic_ns) {
+  deadline_->store(monotonic_ns);
+
+  constexpr int64_t kOneSecondNs = 1000LL * 1000 * 1000;
+  struct itimerspec spec {};
+  spec.it_value.tv_sec = time_t(monotonic_ns / kOneSecondNs);
+  spec.it_value.tv_nsec = long(monotonic_ns % kOneSecondNs);
+  /* A zero it_value disarms the timer, fire immediately instead */
+  if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0)
+    spec.it_value.tv_nsec = 1;
+
+  if (timerfd_settime(*fd_, TFD_TIMER_ABSTIME, &spec, nullptr) != 0)
+    ALOGE("Failed to arm timer: errno=%i", errno);
+}
+
+void ReactorTimer::Disarm() {
+  const struct itimerspec spec {};
+  timerfd_settime(*fd_, 0, &spec, nullptr);
+}
+
+}  // namespace android
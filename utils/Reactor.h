@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "ThreadPolicy.h"
+#include "fd.h"
+
+namespace android {
+
+class ReactorTimer;
+
+/* Event loop thread, serving file descriptors (DRM fd, sync fences, netlink
+ * socket) and timers using a single epoll instance.
+ *
+ * Callbacks are invoked on the reactor thread without any reactor lock held,
+ * so they may add or remove sources. Callbacks must not block.
+ */
+class Reactor : public std::enable_shared_from_this<Reactor> {
+ public:
+  using Callback = std::function<void()>;
+
+  Reactor(const Reactor &) = delete;
+  ~Reactor() = default;
+
+  /* |policy| is applied by the reactor thread on start */
+  static auto CreateInstance(const std::string &name, ThreadPolicy policy)
+      -> std::shared_ptr<Reactor>;
+
+  /* Calls |callback| every time |fd| becomes readable. Level-triggered, the
+   * callback must consume the data or remove the fd.
+   */
+  auto AddFd(int fd, Callback callback) -> int;
+  void RemoveFd(int fd);
+
+  /* Also waits for the callback of |fd| to return if it is running on the
+   * reactor thread, so the state it captures can be freed right after.
+   * Must not be called with a lock held that the callback may take.
+   */
+  void RemoveFdSync(int fd);
+
+  auto CreateTimer(Callback callback) -> std::unique_ptr<ReactorTimer>;
+
+  /* Terminates the thread. Waits for the thread to exit unless called from
+   * the reactor thread itself.
+   */
+  void Stop();
+
+  auto IsReactorThread() const -> bool {
+    return std::this_thread::get_id() == thread_id_;
+  }
+
+  /* Delay between the moment event was due (timer deadline, vblank
+   * timestamp) and the moment reactor thread handled it. Timers report it
+   * automatically.
+   */
+  void ReportWakeupLatency(int64_t latency_ns);
+
+  struct WakeupStats {
+    uint64_t count{};
+    int64_t total_ns{};
+    int64_t max_ns{};
+  };
+
+  auto GetWakeupStats() -> WakeupStats;
+
+  auto Dump() -> std::string;
+
+ private:
+  Reactor() = default;
+
+  void ThreadFn();
+  void Wake() const;
+
+  struct Source {
+    uint32_t generation{};
+    std::shared_ptr<Callback> callback;
+  };
+
+  std::string name_;
+  ThreadPolicy policy_;
+  WakeupStats wakeup_stats_;
+
+  UniqueFd epoll_fd_ = MakeUniqueFd(-1);
+  UniqueFd wake_fd_ = MakeUniqueFd(-1);
+
+  std::thread::id thread_id_;
+  std::map<int /*fd*/, Source> sources_;
+  uint32_t last_generation_{};
+  /* Generation of the source whose callback is running, 0 if none */
+  uint32_t dispatching_generation_{};
+  bool exit_{};
+  bool running_{};
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+};
+
+/* One-shot timer, backed by timerfd and served by the reactor thread */
+class ReactorTimer {
+ public:
+  ReactorTimer(const ReactorTimer &) = delete;
+  ~ReactorTimer();
+
+  /* Absolute CLOCK_MONOTONIC time. Re-arming replaces the previous deadline */
+  void ArmAt(int64_t monotonic_ns);
+  void Disarm();
+
+ private:
+  friend class Reactor;
+  ReactorTimer(std::shared_ptr<Reactor> reactor, UniqueFd fd,
+               std::shared_ptr<std::atomic<int64_t>> deadline)
+      : reactor_(std::move(reactor)),
+        fd_(std::move(fd)),
+        deadline_(std::move(deadline)){};
+
+  std::shared_ptr<Reactor> reactor_;
+  UniqueFd fd_;
+  std::shared_ptr<std::atomic<int64_t>> deadline_;
+};
+
+}  // namespace android
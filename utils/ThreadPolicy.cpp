@@ -0,0 +1,228 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "hwc-thread-policy"
+
+#include "ThreadPolicy.h"
+
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <sstream>
+
+#include "log.h"
+#include "properties.h"
+
+namespace android {
+
+/* Not every libc exposes sched_setattr(), use the kernel ABI directly */
+struct SchedAttr {
+  uint32_t size;
+  uint32_t sched_policy;
+  uint64_t sched_flags;
+  int32_t sched_nice;
+  uint32_t sched_priority;
+  uint64_t sched_runtime;
+  uint64_t sched_deadline;
+  uint64_t sched_period;
+  uint32_t sched_util_min;
+  uint32_t sched_util_max;
+};
+
+constexpr uint64_t kSchedFlagKeepPolicy = 0x08;
+constexpr uint64_t kSchedFlagKeepParams = 0x10;
+constexpr uint64_t kSchedFlagUtilClampMin = 0x20;
+constexpr uint64_t kSchedFlagUtilClampMax = 0x40;
+constexpr int kUclampMax = 1024;
+
+/* SurfaceFlinger main thread runs at SCHED_FIFO 2, vsync delivery should
+ * not be preempted by it.
+ */
+constexpr int kDefaultVSyncFifoPriority = 2;
+
+static auto GetIntProperty(const std::string &name, int64_t default_value,
+                           int base = 10) -> int64_t {
+  char proptext[PROPERTY_VALUE_MAX];
+  if (property_get(name.c_str(), proptext, "") <= 0)
+    return default_value;
+
+  char *end = nullptr;
+  auto value = strtoll(proptext, &end, base);
+  if (end == proptext) {
+    ALOGE("Invalid value for %s: %s", name.c_str(), proptext);
+    return default_value;
+  }
+
+  return value;
+}
+
+auto ThreadPolicy::ForRole(const std::string &role) -> ThreadPolicy {
+  ThreadPolicy policy{};
+  policy.role = role;
+  if (role == "vsync")
+    policy.fifo_priority = kDefaultVSyncFifoPriority;
+
+  constexpr int kHex = 16;
+  const std::string prefix = "vendor.hwc.drm.sched." + role + ".";
+  policy.fifo_priority = int(
+      GetIntProperty(prefix + "fifo", policy.fifo_priority));
+  policy.nice = int(GetIntProperty(prefix + "nice", policy.nice));
+  policy.uclamp_min = int(
+      GetIntProperty(prefix + "uclamp_min", policy.uclamp_min));
+  policy.uclamp_max = int(
+      GetIntProperty(prefix + "uclamp_max", policy.uclamp_max));
+  policy.cpu_mask = uint64_t(
+      GetIntProperty(prefix + "cpus",
+                     GetIntProperty("vendor.hwc.drm.sched.cpus", 0, kHex),
+                     kHex));
+
+  return policy;
+}
+
+auto ThreadPolicy::Apply() const -> int {
+  int ret = 0;
+  auto fail = [&ret](const char *what, const std::string &role) {
+    auto err = -errno;
+    ALOGE("Failed to set %s for %s thread: errno=%i", what, role.c_str(),
+          -err);
+    if (ret == 0)
+      ret = err;
+  };
+
+  if (fifo_priority > 0) {
+    struct sched_param param {};
+    param.sched_priority = fifo_priority;
+    if (sched_setscheduler(0, SCHED_FIFO, &param) != 0)
+      fail("SCHED_FIFO", role);
+  } else if (nice != 0) {
+    if (setpriority(PRIO_PROCESS, 0, nice) != 0)
+      fail("nice", role);
+  }
+
+  if (uclamp_min >= 0 || uclamp_max >= 0) {
+    SchedAttr attr{};
+    attr.size = sizeof(attr);
+    attr.sched_flags = kSchedFlagKeepPolicy | kSchedFlagKeepParams;
+    if (uclamp_min >= 0) {
+      attr.sched_flags |= kSchedFlagUtilClampMin;
+      attr.sched_util_min = uint32_t(std::min(uclamp_min, kUclampMax));
+    }
+    if (uclamp_max >= 0) {
+      attr.sched_flags |= kSchedFlagUtilClampMax;
+      attr.sched_util_max = uint32_t(std::min(uclamp_max, kUclampMax));
+    }
+    if (syscall(__NR_sched_setattr, 0, &attr, 0) != 0)
+      fail("uclamp", role);
+  }
+
+  if (cpu_mask != 0) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (size_t cpu = 0; cpu < sizeof(cpu_mask) * CHAR_BIT; cpu++) {
+      if ((cpu_mask & (1ULL << cpu)) != 0)
+        CPU_SET(cpu, &cpus);
+    }
+    if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0)
+      fail("CPU affinity", role);
+  }
+
+  return ret;
+}
+
+ScopedThreadPolicy::ScopedThreadPolicy(const ThreadPolicy &policy)
+    : policy_(policy) {
+  if (policy_.IsDefault())
+    return;
+
+  if (policy_.fifo_priority > 0 || policy_.nice != 0) {
+    struct sched_param param {};
+    saved_sched_policy_ = sched_getscheduler(0);
+    errno = 0;
+    saved_nice_ = getpriority(PRIO_PROCESS, 0);
+    sched_saved_ = saved_sched_policy_ >= 0 && errno == 0 &&
+                   sched_getparam(0, &param) == 0;
+    saved_sched_priority_ = param.sched_priority;
+  }
+
+  if (policy_.uclamp_min >= 0 || policy_.uclamp_max >= 0) {
+    SchedAttr attr{};
+    uclamp_saved_ = syscall(__NR_sched_getattr, 0, &attr, sizeof(attr), 0) ==
+                    0;
+    saved_uclamp_min_ = attr.sched_util_min;
+    saved_uclamp_max_ = attr.sched_util_max;
+  }
+
+  if (policy_.cpu_mask != 0) {
+    CPU_ZERO(&saved_cpus_);
+    affinity_saved_ = sched_getaffinity(0, sizeof(saved_cpus_),
+                                        &saved_cpus_) == 0;
+  }
+
+  policy_.Apply();
+}
+
+ScopedThreadPolicy::~ScopedThreadPolicy() {
+  if (sched_saved_) {
+    struct sched_param param {};
+    param.sched_priority = saved_sched_priority_;
+    if (sched_setscheduler(0, saved_sched_policy_, &param) != 0 ||
+        setpriority(PRIO_PROCESS, 0, saved_nice_) != 0)
+      ALOGE("Failed to restore scheduling after %s policy: errno=%i",
+            policy_.role.c_str(), errno);
+  }
+
+  if (uclamp_saved_) {
+    SchedAttr attr{};
+    attr.size = sizeof(attr);
+    attr.sched_flags = kSchedFlagKeepPolicy | kSchedFlagKeepParams |
+                       kSchedFlagUtilClampMin | kSchedFlagUtilClampMax;
+    attr.sched_util_min = saved_uclamp_min_;
+    attr.sched_util_max = saved_uclamp_max_;
+    if (syscall(__NR_sched_setattr, 0, &attr, 0) != 0)
+      ALOGE("Failed to restore uclamp after %s policy: errno=%i",
+            policy_.role.c_str(), errno);
+  }
+
+  if (affinity_saved_ &&
+      sched_setaffinity(0, sizeof(saved_cpus_), &saved_cpus_) != 0)
+    ALOGE("Failed to restore CPU affinity after %s policy: errno=%i",
+          policy_.role.c_str(), errno);
+}
+
+auto ThreadPolicy::ToString() const -> std::string {
+  std::stringstream ss;
+  if (fifo_priority > 0) {
+    ss << "SCHED_FIFO " << fifo_priority;
+  } else {
+    ss << "nice " << nice;
+  }
+
+  if (uclamp_min >= 0 || uclamp_max >= 0)
+    ss << ", uclamp " << uclamp_min << ".." << uclamp_max;
+
+  if (cpu_mask != 0)
+    ss << ", cpus 0x" << std::hex << cpu_mask;
+
+  return ss.str();
+}
+
+}  // namespace android
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <sched.h>
+
+#include <cstdint>
+#include <string>
+
+namespace android {
+
+/* Scheduling parameters of a composer thread role ("vsync", "cleanup",
+ * "uevent", "commit"). Every field can be overridden by
+ * vendor.hwc.drm.sched.<role>.<field> property:
+ *  fifo       - SCHED_FIFO priority, 0 keeps SCHED_OTHER
+ *  nice       - nice value for SCHED_OTHER
+ *  uclamp_min - utilization clamp 0..1024, -1 keeps default
+ *  uclamp_max - utilization clamp 0..1024, -1 keeps default
+ *  cpus       - hex CPU mask, 0 allows any CPU. Defaults to
+ *               vendor.hwc.drm.sched.cpus
+ */
+struct ThreadPolicy {
+  std::string role;
+  int fifo_priority{};
+  int nice{};
+  int uclamp_min = -1;
+  int uclamp_max = -1;
+  uint64_t cpu_mask{};
+
+  static auto ForRole(const std::string &role) -> ThreadPolicy;
+
+  /* Applies the policy to the calling thread, returns 0 or -errno of the
+   * first failed step. Remaining steps are still applied.
+   */
+  auto Apply() const -> int;
+
+  auto ToString() const -> std::string;
+
+  /* Nothing to apply */
+  auto IsDefault() const -> bool {
+    return fifo_priority <= 0 && nice == 0 && uclamp_min < 0 &&
+           uclamp_max < 0 && cpu_mask == 0;
+  }
+};
+
+/* Applies |policy| to the calling thread for the lifetime of the object, then
+ * restores the scheduling the thread had before. For threads the composer
+ * doesn't own, such as binder threads, which rely on priority inheritance
+ * for the rest of their calls.
+ */
+class ScopedThreadPolicy {
+ public:
+  explicit ScopedThreadPolicy(const ThreadPolicy &policy);
+  ~ScopedThreadPolicy();
+
+  ScopedThreadPolicy(const ScopedThreadPolicy &) = delete;
+  ScopedThreadPolicy &operator=(const ScopedThreadPolicy &) = delete;
+
+ private:
+  const ThreadPolicy &policy_;
+
+  bool sched_saved_{};
+  int saved_sched_policy_{};
+  int saved_sched_priority_{};
+  int saved_nice_{};
+
+  bool uclamp_saved_{};
+  uint32_t saved_uclamp_min_{};
+  uint32_t saved_uclamp_max_{};
+
+  bool affinity_saved_{};
+  cpu_set_t saved_cpus_{};
+};
+
+}  // namespace android
@@ -77,6 +77,10 @@ class UEvent {
     return std::string(buffer);
   }
 
+  auto GetFd() const {
+    return *fd_;
+  }
+
  private:
   explicit UEvent(UniqueFd &fd) : fd_(std::move(fd)){};
   UniqueFd fd_;